@@ -0,0 +1,51 @@
+#ifndef BENCH_BENCHHARNESS_H
+#define BENCH_BENCHHARNESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/*
+    Minimal self-contained benchmark helpers.
+
+    Each benchmark is a callable that runs `iters` operations and returns
+    a value that is folded into a sink, so the optimizer cannot drop the
+    work. Results are printed one per line:
+
+        <name>  <ns/op>  <Mops/s>
+*/
+
+namespace bench
+{
+
+static volatile uint64_t g_sink;
+
+inline void doNotOptimize(uint64_t v)
+{
+    g_sink = g_sink + v;
+}
+
+struct Result
+{
+    const char *name;
+    uint64_t iters;
+    double ns_per_op;
+};
+
+template <typename Fn>
+Result run(const char *name, uint64_t iters, Fn &&fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    doNotOptimize(fn(iters));
+    auto t1 = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    Result r{name, iters, iters ? ns / (double)iters : 0.0};
+    printf("%-44s %10.2f ns/op %10.2f Mops/s\n",
+           r.name, r.ns_per_op, r.ns_per_op > 0 ? 1000.0 / r.ns_per_op : 0.0);
+    return r;
+}
+
+} // namespace bench
+
+#endif // BENCH_BENCHHARNESS_H
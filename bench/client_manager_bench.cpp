@@ -0,0 +1,247 @@
+// client_manager_bench.cpp -- cost of the client and handshake tables
+//
+// ClientManager lookups (by UDP address, session id and VPN IP), client
+// churn, address allocation on nearly full pools, dead-client sweeps, and
+// ClientSession lookups with many handshakes pending. Keys are visited in
+// a shuffled order so the numbers include cache misses on large tables.
+//
+//     client_manager_bench [max_clients]   (default 1000000)
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench/BenchHarness.h"
+#include "sessions/client/Client_Manager.h"
+#include "sessions/session/ClientSession.h"
+#include "utils/logger.h"
+
+static constexpr uint64_t LOOKUPS = 1 << 21;
+static const uint32_t BASE_IP = ntohl(inet_addr("10.8.0.2"));
+
+// Distinct client endpoints: 127.1.0.0 + i / 16, port 20000 + i % 16
+static sockaddr_in clientAddr(uint32_t i)
+{
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(0x7F010000u + i / 16);
+    a.sin_port = htons((uint16_t)(20000 + i % 16));
+    return a;
+}
+
+struct Table
+{
+    std::unique_ptr<ClientManager> cm;
+    std::vector<sockaddr_in> addrs;
+    std::vector<uint32_t> sessions;
+    std::vector<uint32_t> ips;
+};
+
+// `n` connected clients in a pool of `pool` addresses
+static Table fill(uint32_t n, uint32_t pool)
+{
+    Table t;
+    t.cm = std::make_unique<ClientManager>((int)pool, "10.8.0.2");
+    t.addrs.reserve(n);
+    t.sessions.reserve(n);
+    t.ips.reserve(n);
+    uint8_t key = 0x5A;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        // Addresses in order without getNextAvailableIp(), which would
+        // make filling a 1M table quadratic
+        uint32_t ip = BASE_IP + i;
+        uint32_t sid = t.cm->generateSessionId();
+        sockaddr_in a = clientAddr(i);
+        t.cm->addClient(a, ip, key, sid);
+        t.addrs.push_back(a);
+        t.sessions.push_back(sid);
+        t.ips.push_back(ip);
+    }
+    return t;
+}
+
+// Shuffled visiting order, so big tables are not walked in insertion order
+static std::vector<uint32_t> order(uint32_t n)
+{
+    std::vector<uint32_t> o(n);
+    for (uint32_t i = 0; i < n; i++)
+        o[i] = i;
+    std::shuffle(o.begin(), o.end(), std::mt19937(42));
+    return o;
+}
+
+static std::string label(const char *what, uint32_t n)
+{
+    char buf[64];
+    if (n >= 1000000)
+        snprintf(buf, sizeof(buf), "%s/%uM", what, n / 1000000);
+    else if (n >= 1000)
+        snprintf(buf, sizeof(buf), "%s/%uk", what, n / 1000);
+    else
+        snprintf(buf, sizeof(buf), "%s/%u", what, n);
+    return buf;
+}
+
+static void lookups(uint32_t n)
+{
+    Table t = fill(n, n);
+    std::vector<uint32_t> o = order(n);
+
+    bench::run(label("cm/getClientByUdp", n).c_str(), LOOKUPS, [&](uint64_t iters) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            hits += t.cm->getClientByUdp(t.addrs[o[i % n]]) != nullptr;
+        return hits;
+    });
+    bench::run(label("cm/getClientByUdp_miss", n).c_str(), LOOKUPS, [&](uint64_t iters) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            hits += t.cm->getClientByUdp(clientAddr(n + (uint32_t)(i % n))) != nullptr;
+        return hits;
+    });
+    bench::run(label("cm/getClientBySessionId", n).c_str(), LOOKUPS, [&](uint64_t iters) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            hits += t.cm->getClientBySessionId(t.sessions[o[i % n]]) != nullptr;
+        return hits;
+    });
+    bench::run(label("cm/getClientByServerIp", n).c_str(), LOOKUPS, [&](uint64_t iters) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            hits += t.cm->getClientByServerIp(t.ips[o[i % n]]) != nullptr;
+        return hits;
+    });
+}
+
+// One client leaves and another joins, with `n` clients staying connected
+static void churn(uint32_t n)
+{
+    Table t = fill(n, n + 1);
+    uint32_t next = n;
+    uint8_t key = 0x5A;
+    // getNextAvailableIp() scans the pool, so big tables get fewer rounds
+    uint64_t rounds = std::min<uint64_t>(200000, std::max<uint64_t>(1000, 200000000ULL / n));
+    bench::run(label("cm/addClient+freeIp", n).c_str(), rounds, [&](uint64_t iters) {
+        uint64_t ok = 0;
+        for (uint64_t i = 0; i < iters; i++)
+        {
+            // Oldest client leaves, its address is handed out again
+            uint32_t slot = (uint32_t)(i % n);
+            t.cm->freeIp(t.ips[slot]);
+            uint32_t ip = t.cm->getNextAvailableIp();
+            uint32_t sid = t.cm->generateSessionId();
+            ok += t.cm->addClient(clientAddr(next++), ip, key, sid) != nullptr;
+            t.ips[slot] = ip;
+        }
+        return ok;
+    });
+}
+
+// Pool of `pool` addresses with only the last few free: the allocation
+// every HELLO does when the server is close to its client limit
+static void nearlyFull(uint32_t pool)
+{
+    auto cm = std::make_unique<ClientManager>((int)pool, "10.8.0.2");
+    for (uint32_t i = 0; i + 1 < pool; i++)
+        cm->makeIpInUse(BASE_IP + i);
+
+    uint64_t iters = std::max<uint64_t>(1000, 200000000ULL / pool);
+    bench::run(label("cm/getNextAvailableIp_full", pool).c_str(), iters, [&](uint64_t it) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < it; i++)
+        {
+            uint32_t ip = cm->getNextAvailableIp();
+            sum += ip;
+            cm->freeIp(ip);
+        }
+        return sum;
+    });
+}
+
+// One sweep over `n` clients of which `dead_pct` percent have gone silent
+static void sweep(uint32_t n, int dead_pct)
+{
+    Table t = fill(n, n);
+    uint32_t dead = (uint32_t)((uint64_t)n * dead_pct / 100);
+    uint32_t marked = 0;
+    t.cm->forEachClient([&](Client &c) {
+        if (marked < dead)
+        {
+            c.last_seen = 0;
+            marked++;
+        }
+    });
+
+    std::string name = label("cm/sweepDeadClients", n) + "_dead" + std::to_string(dead_pct) + "%";
+    // Reported per client scanned
+    bench::run(name.c_str(), n, [&](uint64_t) {
+        return (uint64_t)t.cm->sweepDeadClients(60);
+    });
+}
+
+// `pending` handshakes between HELLO and CLIENT_ACK
+static void pendingHandshakes(uint32_t pending)
+{
+    ClientSession cs;
+    for (uint32_t i = 0; i < pending; i++)
+        cs.addSession(clientAddr(i), i, 0x0A080002 + i, 9, 1000, 1000 + i, HandshakeExt{});
+    std::vector<uint32_t> o = order(pending);
+
+    uint64_t iters = std::max<uint64_t>(1000, (uint64_t)(LOOKUPS * 16) / pending);
+    bench::run(label("session/getSession", pending).c_str(), iters, [&](uint64_t it) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < it; i++)
+            hits += cs.getSession(clientAddr(o[i % pending])) != nullptr;
+        return hits;
+    });
+    bench::run(label("session/getSession_miss", pending).c_str(), iters, [&](uint64_t it) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < it; i++)
+            hits += cs.getSession(clientAddr(pending + (uint32_t)(i % pending))) != nullptr;
+        return hits;
+    });
+    // A HELLO arrives and the oldest pending handshake completes
+    bench::run(label("session/add+erase", pending).c_str(), iters, [&](uint64_t it) {
+        for (uint64_t i = 0; i < it; i++)
+        {
+            uint32_t slot = (uint32_t)(i % pending);
+            cs.eraseSession(clientAddr(o[slot]));
+            cs.addSession(clientAddr(o[slot]), slot, 0x0A080002 + slot, 9, 1000, 1000 + slot,
+                          HandshakeExt{});
+        }
+        return it;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_clients = argc > 1 ? (uint32_t)atol(argv[1]) : 1000000;
+
+    // ClientManager logs every removal; keep the writer thread but not the output
+    log_init_file("/dev/null");
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    printf("ClientManager / ClientSession, sizeof(Client) = %zu, up to %u clients\n",
+           sizeof(Client), max_clients);
+
+    for (uint32_t n : {100u, 10000u, max_clients})
+        lookups(n);
+    for (uint32_t n : {100u, 10000u, max_clients})
+        churn(n);
+    for (uint32_t pool : {256u, 65536u, max_clients})
+        nearlyFull(pool);
+    sweep(max_clients, 0);
+    sweep(max_clients, 1);
+    for (uint32_t pending : {10u, 1000u, 10000u})
+        pendingHandshakes(pending);
+
+    log_flush();
+    log_shutdown();
+    return 0;
+}
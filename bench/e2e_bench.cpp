@@ -0,0 +1,457 @@
+// e2e_bench.cpp -- whole-pipeline scenarios with regression tracking
+//
+// Each scenario runs a fresh DataPlane in-process over a FakeTunDevice
+// (reflector on, so every echo request comes back as a reply) and drives
+// it with LoadGenerator clients over loopback UDP. No root, no tun0.
+//
+//     e2e_bench [-s name,...] [-d seconds] [-r runs] [-o results.json]
+//               [-b baseline.json] [-T pct] [-L pct] [-P port] [-l logfile]
+//
+// Results are one JSON object per scenario. Metrics:
+//   rx_pps, gbps       echo replies received, and their UDP payload rate
+//   loss_pct           echo requests never answered (after a drain)
+//   rtt_p50/p99_us     echo round trip through the whole pipeline
+//   handshakes_per_s   HELLO..CLIENT_ACK completions while connecting
+//   handshake_p99_us   HELLO sent -> WELCOME received
+//   cpu_ns_per_pkt     data-plane thread CPU time / packets it forwarded
+//   *_cycles_per_pkt   from the profiling counters (ENABLE_PROFILING only)
+//
+// With -b, every metric present in both runs is compared to the baseline
+// and the exit status is 1 if any moved the wrong way by more than -T
+// percent (-L for latencies, which are noisier). -r runs every scenario
+// several times and keeps each metric's median, which takes most of the
+// noise out of shared machines. -o of a good run is the next baseline.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "net/tun/FakeTunDevice.h"
+#include "server/DataPlane.h"
+#include "tools/LoadGenerator.h"
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+
+static constexpr uint64_t NS = 1000000000ULL;
+static constexpr uint64_t DRAIN_NS = 300000000ULL; // replies still in flight at the end
+static constexpr uint64_t CONNECT_POLL_NS = 50000000ULL;
+
+struct Scenario
+{
+    const char *name;
+    int clients;
+    int size;
+    double pps_per_client;
+    double handshake_rate;
+    double roam_s;
+    double keepalive_s;
+    bool storm;          ///< The measured phase is the handshake phase itself
+    int connect_timeout; ///< Seconds allowed to bring every client up
+};
+
+// clang-format off
+static const Scenario k_scenarios[] = {
+    // name              clients  size   pps/client  hello/s  roam_s keepalive storm  connect_s
+    {"pkt64",              100,    64,    1000,       20000,   0,     5,        false, 10},
+    {"pkt512",             100,    512,   1000,       20000,   0,     5,        false, 10},
+    {"pkt1400",            100,    1400,  1000,       20000,   0,     5,        false, 10},
+    {"clients1",           1,      512,   20000,      20000,   0,     5,        false, 10},
+    {"clients100",         100,    512,   100,        20000,   0,     5,        false, 10},
+    {"clients100k",        100000, 512,   0.1,        5000,    0,     30,       false, 60},
+    {"handshake_storm",    10000,  64,    0,          50000,   0,     30,       true,  30},
+    {"roaming_churn",      1000,   512,   50,         20000,   0.5,   5,        false, 10},
+};
+// clang-format on
+
+using Metrics = std::map<std::string, double>;
+
+struct Result
+{
+    std::string name;
+    Metrics m;
+};
+
+static uint64_t cpuNs(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * NS + (uint64_t)ts.tv_nsec;
+}
+
+// Brings clients up; returns false if not all of them made it in time
+static bool connectAll(LoadGenerator &gen, int clients, int timeout_s)
+{
+    uint64_t deadline = LoadGenerator::nowNs() + (uint64_t)timeout_s * NS;
+    while (gen.connected() < clients)
+    {
+        if (LoadGenerator::nowNs() >= deadline)
+            return false;
+        gen.runFor(CONNECT_POLL_NS);
+    }
+    return true;
+}
+
+// Runs on its own thread while the data plane runs on the main one
+static Result drive(const Scenario &sc, double seconds, uint16_t port, clockid_t plane_clk)
+{
+    Result r;
+    r.name = sc.name;
+
+    LoadGenConfig cfg;
+    cfg.server.sin_port = htons(port);
+    cfg.clients = sc.clients;
+    cfg.sizes = {{sc.size, 1}};
+    cfg.rates = {{sc.pps_per_client, 1}};
+    cfg.handshake_rate = sc.handshake_rate;
+    cfg.roam_s = sc.roam_s;
+    cfg.keepalive_s = sc.keepalive_s;
+    LoadGenerator gen(cfg);
+
+    uint64_t t0 = LoadGenerator::nowNs();
+    bool up = connectAll(gen, sc.clients, sc.connect_timeout);
+    uint64_t t1 = LoadGenerator::nowNs();
+    r.m["connected"] = gen.connected();
+    if (sc.storm || !up)
+    {
+        // Also shown when connecting fell short; the data phase then runs
+        // with the clients that made it
+        const LoadGenStats &s = gen.stats();
+        r.m["handshakes_per_s"] = s.handshakes / ((double)(t1 - t0) / NS);
+        r.m["handshake_p99_us"] = s.handshake_ns.percentile(99) / 1e3;
+        r.m["handshake_timeouts"] = (double)s.handshake_timeouts;
+        if (sc.storm)
+            return r;
+    }
+
+    LoadGenStats g0 = gen.stats();
+    StatsSnapshot s0 = StatsSnapshot::collect();
+    uint64_t c0 = cpuNs(plane_clk);
+    uint64_t w0 = LoadGenerator::nowNs();
+
+    gen.runFor((uint64_t)(seconds * NS));
+
+    uint64_t w1 = LoadGenerator::nowNs();
+    uint64_t c1 = cpuNs(plane_clk);
+    StatsSnapshot d = StatsSnapshot::collect() - s0;
+    LoadGenStats g = gen.stats() - g0;
+
+    gen.drain(DRAIN_NS);
+    gen.disconnect();
+
+    double dt = (double)(w1 - w0) / NS;
+    uint64_t fwd = d.udp_rx_pkts + d.tun_rx_pkts;
+    r.m["tx_pps"] = g.data_tx / dt;
+    r.m["rx_pps"] = g.echo_rx / dt;
+    r.m["gbps"] = g.rx_bytes * 8 / dt / 1e9;
+    r.m["loss_pct"] = gen.stats().data_tx ? 100.0 * gen.lost() / gen.stats().data_tx : 0;
+    r.m["rtt_p50_us"] = g.rtt_ns.percentile(50) / 1e3;
+    r.m["rtt_p99_us"] = g.rtt_ns.percentile(99) / 1e3;
+    r.m["cpu_ns_per_pkt"] = fwd ? (double)(c1 - c0) / fwd : 0;
+    if (sc.roam_s > 0)
+        r.m["roams"] = (double)g.roams;
+#if ENABLE_PROFILING
+    if (d.tun_tx_pkts)
+    {
+        r.m["udp_to_tun_cycles_per_pkt"] = (double)d.udp_to_tun_cycles / d.tun_tx_pkts;
+        r.m["dec_cycles_per_pkt"] = (double)d.dec_cycles / d.tun_tx_pkts;
+        r.m["lookup_cycles_per_pkt"] = (double)d.lookup_cycles / d.tun_tx_pkts;
+    }
+    if (d.udp_tx_pkts)
+        r.m["enc_cycles_per_pkt"] = (double)d.enc_cycles / d.udp_tx_pkts;
+#endif
+    return r;
+}
+
+static Result runScenario(const Scenario &sc, double seconds, uint16_t port)
+{
+    FakeTunDevice dev;
+    dev.startReflector();
+
+    DataPlaneConfig pc;
+    pc.udp_port = port;
+    // Retried HELLOs hold their first reservation until it times out
+    pc.max_clients = sc.clients + sc.clients / 8 + 16;
+    DataPlane plane(dev, pc);
+
+    clockid_t clk;
+    pthread_getcpuclockid(pthread_self(), &clk);
+
+    Result r;
+    std::string error;
+    std::thread driver([&] {
+        try
+        {
+            r = drive(sc, seconds, port, clk);
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        plane.stop();
+    });
+    plane.run();
+    driver.join();
+    dev.stopReflector();
+
+    if (!error.empty())
+    {
+        fprintf(stderr, "%s: %s\n", sc.name, error.c_str());
+        r.name = sc.name;
+    }
+    return r;
+}
+
+// Per-metric median over repeated runs of one scenario
+static Result median(const std::vector<Result> &runs)
+{
+    Result r;
+    r.name = runs.front().name;
+    std::map<std::string, std::vector<double>> values;
+    for (const Result &run : runs)
+        for (const auto &kv : run.m)
+            values[kv.first].push_back(kv.second);
+    for (auto &kv : values)
+    {
+        std::vector<double> &v = kv.second;
+        std::sort(v.begin(), v.end());
+        r.m[kv.first] = v[v.size() / 2];
+    }
+    return r;
+}
+
+// ---------------- Results file ----------------
+
+static void writeResults(FILE *f, const std::vector<Result> &results)
+{
+    fprintf(f, "{\"profiling\": %d, \"scenarios\": [\n", ENABLE_PROFILING);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        fprintf(f, "{\"name\": \"%s\"", results[i].name.c_str());
+        for (const auto &kv : results[i].m)
+            fprintf(f, ", \"%s\": %.6g", kv.first.c_str(), kv.second);
+        fprintf(f, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "]}\n");
+}
+
+// Reads files written by writeResults(): one scenario object per line
+static bool readResults(const char *path, std::map<std::string, Metrics> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), f))
+    {
+        const char *p = strstr(line, "{\"name\": \"");
+        if (!p)
+            continue;
+        p += 10;
+        const char *q = strchr(p, '"');
+        if (!q)
+            continue;
+        Metrics &m = out[std::string(p, q)];
+        p = q + 1;
+        while ((p = strstr(p, ", \"")) != nullptr)
+        {
+            p += 3;
+            q = strstr(p, "\": ");
+            if (!q)
+                break;
+            std::string key(p, q);
+            m[key] = strtod(q + 3, nullptr);
+            p = q + 3;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+struct Check
+{
+    const char *metric;
+    bool higher_is_better;
+    bool latency; ///< Uses the latency threshold
+    double slack; ///< Absolute change always tolerated (noise floor)
+};
+
+static const Check k_checks[] = {
+    {"rx_pps", true, false, 0},
+    {"gbps", true, false, 0},
+    {"handshakes_per_s", true, false, 0},
+    {"loss_pct", false, false, 0.5},
+    {"cpu_ns_per_pkt", false, false, 0},
+    {"udp_to_tun_cycles_per_pkt", false, false, 0},
+    {"enc_cycles_per_pkt", false, false, 0},
+    {"dec_cycles_per_pkt", false, false, 0},
+    {"lookup_cycles_per_pkt", false, false, 0},
+    {"rtt_p99_us", false, true, 20},
+    {"handshake_p99_us", false, true, 100},
+};
+
+static int compare(const std::vector<Result> &results, const std::map<std::string, Metrics> &base,
+                   double threshold, double lat_threshold)
+{
+    int regressions = 0;
+    printf("\n%-18s %-26s %12s %12s %8s\n", "scenario", "metric", "baseline", "current", "change");
+    for (const Result &r : results)
+    {
+        auto b = base.find(r.name);
+        if (b == base.end())
+            continue;
+        for (const Check &c : k_checks)
+        {
+            auto cur = r.m.find(c.metric);
+            auto old = b->second.find(c.metric);
+            if (cur == r.m.end() || old == b->second.end())
+                continue;
+            double pct = c.latency ? lat_threshold : threshold;
+            double was = old->second, now = cur->second;
+            bool bad = c.higher_is_better ? now < was * (1 - pct / 100) - c.slack
+                                          : now > was * (1 + pct / 100) + c.slack;
+            double change = was != 0 ? 100.0 * (now - was) / was : 0;
+            printf("%-18s %-26s %12.4g %12.4g %+7.1f%%%s\n", r.name.c_str(), c.metric, was, now,
+                   change, bad ? "  REGRESSION" : "");
+            regressions += bad;
+        }
+    }
+    return regressions;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-s name,...] [-d seconds] [-r runs] [-o results.json] [-b baseline.json]\n"
+            "          [-T pct] [-L pct] [-P port] [-l logfile]\n"
+            "scenarios:",
+            argv0);
+    for (const Scenario &sc : k_scenarios)
+        fprintf(stderr, " %s", sc.name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    std::string only;
+    double seconds = 3;
+    int runs = 1;
+    const char *out_path = nullptr;
+    const char *base_path = nullptr;
+    double threshold = 10;
+    double lat_threshold = 50;
+    uint16_t port = 5601;
+    const char *log_path = "e2e_bench.log";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:r:o:b:T:L:P:l:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            only = std::string(",") + optarg + ",";
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 'r':
+            runs = std::max(1, atoi(optarg));
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'b':
+            base_path = optarg;
+            break;
+        case 'T':
+            threshold = atof(optarg);
+            break;
+        case 'L':
+            lat_threshold = atof(optarg);
+            break;
+        case 'P':
+            port = (uint16_t)atoi(optarg);
+            break;
+        case 'l':
+            log_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::map<std::string, Metrics> base;
+    if (base_path && !readResults(base_path, base))
+    {
+        if (errno == ENOENT)
+            fprintf(stderr, "no baseline at %s; run e2e_baseline first "
+                "(cmake --build . --target e2e_baseline)\n", base_path);
+        else
+            fprintf(stderr, "cannot read baseline %s: %s\n", base_path, strerror(errno));
+        return 2;
+    }
+
+    // Server logs would interleave with the table
+    log_init_file(log_path);
+
+    std::vector<Result> results;
+    for (const Scenario &sc : k_scenarios)
+    {
+        if (!only.empty() && only.find(std::string(",") + sc.name + ",") == std::string::npos)
+            continue;
+        std::vector<Result> repeats;
+        for (int i = 0; i < runs; i++)
+        {
+            try
+            {
+                repeats.push_back(runScenario(sc, seconds, port));
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "%s: %s\n", sc.name, e.what());
+                repeats.push_back(Result{sc.name, {}});
+            }
+        }
+        results.push_back(median(repeats));
+        const Result &r = results.back();
+        printf("%-18s", r.name.c_str());
+        for (const auto &kv : r.m)
+            printf(" %s=%.4g", kv.first.c_str(), kv.second);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    log_flush();
+    log_shutdown();
+
+    if (out_path)
+    {
+        FILE *f = fopen(out_path, "w");
+        if (!f)
+        {
+            fprintf(stderr, "cannot write %s: %s\n", out_path, strerror(errno));
+            return 2;
+        }
+        writeResults(f, results);
+        fclose(f);
+    }
+    if (base_path)
+    {
+        int n = compare(results, base, threshold, lat_threshold);
+        printf("%d regression(s) against %s (threshold %.0f%%, latency %.0f%%)\n", n, base_path,
+               threshold, lat_threshold);
+        return n ? 1 : 0;
+    }
+    return 0;
+}
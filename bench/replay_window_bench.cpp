@@ -0,0 +1,93 @@
+// replay_window_bench.cpp -- cost of the anti-replay check on synthetic traces
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "protocol/ReplayWindow.h"
+#include "bench/BenchHarness.h"
+
+static constexpr size_t TRACE_LEN = 1 << 20;
+
+// Strictly increasing sequence numbers: the common case.
+static std::vector<uint64_t> inOrderTrace()
+{
+    std::vector<uint64_t> t(TRACE_LEN);
+    for (size_t i = 0; i < TRACE_LEN; i++)
+        t[i] = i + 1;
+    return t;
+}
+
+// Blocks of `span` packets shuffled locally, as produced by multipath/ECMP.
+static std::vector<uint64_t> reorderedTrace(size_t span)
+{
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> t = inOrderTrace();
+    for (size_t i = 0; i + span <= TRACE_LEN; i += span)
+        std::shuffle(t.begin() + i, t.begin() + i + span, rng);
+    return t;
+}
+
+// Every packet is sent `copies` times, copies interleaved with new data.
+static std::vector<uint64_t> replayHeavyTrace(int copies)
+{
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> t;
+    t.reserve(TRACE_LEN);
+    uint64_t seq = 1;
+    while (t.size() < TRACE_LEN)
+    {
+        t.push_back(seq);
+        for (int c = 1; c < copies && t.size() < TRACE_LEN; c++)
+            t.push_back(seq - (rng() % std::min<uint64_t>(seq, 512)));
+        seq++;
+    }
+    return t;
+}
+
+// Jumps far ahead now and then, leaving most of the window stale.
+static std::vector<uint64_t> jumpyTrace()
+{
+    std::mt19937_64 rng(3);
+    std::vector<uint64_t> t(TRACE_LEN);
+    uint64_t seq = 1;
+    for (size_t i = 0; i < TRACE_LEN; i++)
+    {
+        seq += (rng() % 64 == 0) ? 5000 : 1;
+        t[i] = seq;
+    }
+    return t;
+}
+
+static void runTrace(const char *name, const std::vector<uint64_t> &trace, int rounds)
+{
+    uint64_t accepted = 0;
+    bench::run(name, trace.size() * (uint64_t)rounds, [&](uint64_t) {
+        for (int r = 0; r < rounds; r++)
+        {
+            ReplayWindow w;
+            for (uint64_t s : trace)
+                accepted += w.accept(s);
+        }
+        return accepted;
+    });
+    printf("    accepted %.1f%%\n", 100.0 * accepted / (trace.size() * (double)rounds));
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+
+    printf("ReplayWindow: %u words, %lu-packet window, %zu-packet traces x %d\n",
+           ReplayWindow::WORDS, (unsigned long)ReplayWindow::WINDOW_SIZE,
+           TRACE_LEN, rounds);
+
+    runTrace("replay/in_order", inOrderTrace(), rounds);
+    runTrace("replay/reordered_span_64", reorderedTrace(64), rounds);
+    runTrace("replay/reordered_span_2048", reorderedTrace(2048), rounds);
+    runTrace("replay/duplicate_x2", replayHeavyTrace(2), rounds);
+    runTrace("replay/duplicate_x8", replayHeavyTrace(8), rounds);
+    runTrace("replay/jump_ahead", jumpyTrace(), rounds);
+    return 0;
+}
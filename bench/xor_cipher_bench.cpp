@@ -0,0 +1,43 @@
+// xor_cipher_bench.cpp -- XorCipher::crypt throughput by packet size
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench/BenchHarness.h"
+#include "crypto/XorCipher.h"
+
+// Total bytes pushed through crypt() per size
+static constexpr uint64_t BYTES_PER_RUN = 1ULL << 30;
+
+int main(int argc, char **argv)
+{
+    uint64_t bytes = argc > 1 ? strtoull(argv[1], nullptr, 0) : BYTES_PER_RUN;
+    XorCipher &enc = XorCipher::getInstance();
+
+    std::vector<char> in(9000), out(9000);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (char)(i * 131 + 7);
+    uint8_t key = 0xA7;
+
+    printf("XorCipher::crypt, %lu bytes per size\n", (unsigned long)bytes);
+    for (int len : {20, 64, 512, 1400, 9000})
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "xor/crypt_%d", len);
+        uint64_t iters = bytes / (uint64_t)len;
+        bench::Result r = bench::run(name, iters, [&](uint64_t it) {
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < it; i++)
+            {
+                // Feed the output back in so iterations cannot be hoisted
+                enc.crypt(in.data(), len, out.data(), key);
+                sum += (uint8_t)out[i % (uint64_t)len];
+                in[0] = out[len - 1];
+            }
+            return sum;
+        });
+        printf("    %.2f GB/s\n", r.ns_per_op > 0 ? len / r.ns_per_op : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include "Lz4Codec.h"
+
+#include <cstring>
+
+/* LZ4 block format constants */
+static constexpr int MIN_MATCH = 4;
+static constexpr int LAST_LITERALS = 5; // last 5 bytes are always literals
+static constexpr int MF_LIMIT = 12;     // last match must start 12 bytes before end
+static constexpr int MAX_OFFSET = 65535;
+
+static constexpr int HASH_LOG = 12;
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// Appends an LZ4 length continuation (255, 255, ..., rest)
+static inline uint8_t *writeLength(uint8_t *op, int len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+bool Lz4Codec::looksCompressible(const uint8_t *src, int len)
+{
+    if (len < MIN_INPUT)
+        return false;
+
+    uint64_t seen[4] = {0, 0, 0, 0};
+    int step = len / 128;
+    if (step < 1)
+        step = 1;
+    for (int i = 0, s = 0; i < len && s < 128; i += step, s++)
+        seen[src[i] >> 6] |= 1ULL << (src[i] & 63);
+
+    int distinct = __builtin_popcountll(seen[0]) + __builtin_popcountll(seen[1]) +
+                   __builtin_popcountll(seen[2]) + __builtin_popcountll(seen[3]);
+    return distinct < 90;
+}
+
+int Lz4Codec::compress(const uint8_t *src, int len, uint8_t *dst, int cap)
+{
+    if (len < MIN_INPUT || len > MAX_INPUT)
+        return 0;
+
+    // Never cleared: entries from older packets fail the read32() check below
+    static thread_local uint16_t table[1 << HASH_LOG];
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *const iend = src + len;
+    const uint8_t *const mflimit = iend - MF_LIMIT;
+    const uint8_t *const matchlimit = iend - LAST_LITERALS;
+
+    uint8_t *op = dst;
+    uint8_t *const oend = dst + (cap < len ? cap : len - 1); // must beat the input
+
+    table[hash4(read32(ip))] = 0;
+    ip++;
+
+    while (ip < mflimit)
+    {
+        uint32_t seq = read32(ip);
+        uint32_t h = hash4(seq);
+        const uint8_t *ref = src + table[h];
+        table[h] = (uint16_t)(ip - src);
+
+        if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != seq)
+        {
+            // Skip faster through data that keeps missing
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        // Extend backwards over bytes we would otherwise emit as literals
+        while (ip > anchor && ref > src && ip[-1] == ref[-1])
+        {
+            ip--;
+            ref--;
+        }
+
+        const uint8_t *mp = ip + MIN_MATCH;
+        const uint8_t *mr = ref + MIN_MATCH;
+        while (mp < matchlimit && *mp == *mr)
+        {
+            mp++;
+            mr++;
+        }
+
+        int lit_len = ip - anchor;
+        int match_len = (mp - ip) - MIN_MATCH;
+
+        // token + literal run + offset + match run, worst case
+        if (op + 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1 > oend)
+            return 0;
+
+        uint8_t *token = op++;
+        if (lit_len >= 15)
+        {
+            *token = 15 << 4;
+            op = writeLength(op, lit_len - 15);
+        }
+        else
+        {
+            *token = (uint8_t)(lit_len << 4);
+        }
+        memcpy(op, anchor, lit_len);
+        op += lit_len;
+
+        uint16_t offset = (uint16_t)(ip - ref);
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+
+        if (match_len >= 15)
+        {
+            *token |= 15;
+            op = writeLength(op, match_len - 15);
+        }
+        else
+        {
+            *token |= (uint8_t)match_len;
+        }
+
+        ip = mp;
+        anchor = ip;
+    }
+
+    // Last literals
+    int lit_len = iend - anchor;
+    if (op + 1 + lit_len / 255 + 1 + lit_len > oend)
+        return 0;
+
+    uint8_t *token = op++;
+    if (lit_len >= 15)
+    {
+        *token = 15 << 4;
+        op = writeLength(op, lit_len - 15);
+    }
+    else
+    {
+        *token = (uint8_t)(lit_len << 4);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    return op - dst;
+}
+
+int Lz4Codec::decompress(const uint8_t *src, int len, uint8_t *dst, int cap)
+{
+    const uint8_t *ip = src;
+    const uint8_t *const iend = src + len;
+    uint8_t *op = dst;
+    uint8_t *const oend = dst + cap;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        // ---- literals ----
+        int lit_len = token >> 4;
+        if (lit_len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (lit_len > iend - ip || lit_len > oend - op)
+            return -1;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        if (ip == iend)
+            break; // last sequence has no match part
+
+        // ---- match ----
+        if (iend - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst)
+            return -1;
+
+        int match_len = token & 15;
+        if (match_len == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += MIN_MATCH;
+        if (match_len > oend - op)
+            return -1;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= match_len)
+        {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        }
+        else
+        {
+            // Overlapping copy (runs); must go byte by byte
+            for (int i = 0; i < match_len; i++)
+                *op++ = *ref++;
+        }
+    }
+
+    return op - dst;
+}
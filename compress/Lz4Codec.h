@@ -0,0 +1,48 @@
+#ifndef LZ4CODEC_H
+#define LZ4CODEC_H
+
+#include <cstdint>
+
+/**
+ * @brief In-tree LZ4 block codec for single packets.
+ *
+ * Produces and consumes the standard LZ4 *block* format (no frame header),
+ * so payloads can be inspected with any LZ4 implementation. Tuned for
+ * inputs of one IP packet (< 64KB): offsets are 16-bit and the match
+ * finder is a single 4096-entry hash table per thread that is never
+ * cleared - stale entries are rejected by verifying the candidate bytes.
+ */
+class Lz4Codec
+{
+public:
+    static constexpr int MIN_INPUT = 128; ///< Smaller packets are never worth it
+    static constexpr int MAX_INPUT = 65535;
+
+    /**
+     * @brief Quick entropy probe over a strided sample of the packet.
+     *
+     * Counts distinct byte values in up to 128 samples. Encrypted or
+     * already-compressed data (TLS, JPEG, gzip) hits ~100 distinct values,
+     * text and telemetry stay well below that.
+     *
+     * @return false if compressing would almost certainly not help
+     */
+    static bool looksCompressible(const uint8_t *src, int len);
+
+    /**
+     * @brief Compresses src into dst.
+     *
+     * @return compressed size, or 0 if the result would not be smaller
+     *         than the input or does not fit in cap
+     */
+    static int compress(const uint8_t *src, int len, uint8_t *dst, int cap);
+
+    /**
+     * @brief Decompresses a block, never writing past dst + cap.
+     *
+     * @return decompressed size, or -1 on malformed input
+     */
+    static int decompress(const uint8_t *src, int len, uint8_t *dst, int cap);
+};
+
+#endif // LZ4CODEC_H
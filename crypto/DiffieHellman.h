@@ -1,21 +1,27 @@
 /* This program calculates the Key for two persons
 using the Diffie-Hellman Key exchange algorithm using C++ */
+#ifndef DIFFIEHELLMAN_H
+#define DIFFIEHELLMAN_H
+
+// Everything is inline so the server and the load generator can both
+// link against the same key derivation.
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 
 using namespace std;
-long long int P=127;
-long long int G=9;
+inline long long int P=127;
+inline long long int G=9;
 
-long long int randomNumGen(int lower, int upper) {
+inline long long int randomNumGen(int lower, int upper) {
     return rand() % (upper - lower + 1) + lower;
 }
-uint8_t calculateXORKey(uint32_t s) {
+inline uint8_t calculateXORKey(uint32_t s) {
     return (s ^ (s >> 8) ^ (s >> 16) ^ (s >> 24)) & 0xFF;
 }
 
 // Power function to return value of a ^ b mod P
-long long modexp(long long base, long long exp, long long mod)
+inline long long modexp(long long base, long long exp, long long mod)
 {
     long long result = 1;
     base = base % mod;
@@ -30,3 +36,5 @@ long long modexp(long long base, long long exp, long long mod)
     }
     return result;
 }
+
+#endif // DIFFIEHELLMAN_H
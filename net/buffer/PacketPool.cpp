@@ -0,0 +1,114 @@
+#include "PacketPool.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "utils/logger.h"
+
+static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+static constexpr int MPOL_PREFERRED_ = 1; // <numaif.h> without linking libnuma
+
+static size_t roundUp(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+// Prefers the calling thread's node for pages not yet touched
+static int bindToLocalNode(void *addr, size_t len)
+{
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+        return -1;
+    unsigned long mask[4] = {};
+    if (node >= sizeof(mask) * 8)
+        return -1;
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED_, mask, sizeof(mask) * 8, 0) != 0)
+        return -1;
+    return (int)node;
+}
+
+PacketPool::PacketPool(uint32_t count)
+    : count_(count)
+{
+    if (count == 0)
+        throw std::runtime_error("PacketPool: empty pool");
+
+    size_t want = (size_t)count * BUF_SIZE;
+    map_len_ = roundUp(want, HUGE_PAGE);
+    void *p = mmap(nullptr, map_len_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        huge_ = true;
+    }
+    else
+    {
+        // No reserved huge pages (vm.nr_hugepages): let THP back it if it can
+        p = mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::runtime_error(std::string("PacketPool: mmap: ") + strerror(errno));
+        madvise(p, map_len_, MADV_HUGEPAGE);
+    }
+    base_ = (unsigned char *)p;
+    node_ = bindToLocalNode(base_, map_len_);
+
+    // Fault everything in now, not on the first packets
+    for (size_t off = 0; off < map_len_; off += 4096)
+        base_[off] = 0;
+
+    free_.reserve(count);
+    for (uint32_t i = count; i > 0; i--)
+        free_.push_back(i - 1); // handle 0 is handed out first
+
+    LOG(LOG_INFO, "Packet pool: %u x %d bytes, %s pages, NUMA node %d",
+        count, BUF_SIZE, huge_ ? "2 MB huge" : "normal", node_);
+}
+
+PacketPool::~PacketPool()
+{
+    munmap(base_, map_len_);
+}
+
+uint32_t PacketPool::take(PktHandle *out, uint32_t n)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    uint32_t got = 0;
+    while (got < n && !free_.empty())
+    {
+        out[got++] = free_.back();
+        free_.pop_back();
+    }
+    return got;
+}
+
+void PacketPool::give(const PktHandle *in, uint32_t n)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    free_.insert(free_.end(), in, in + n);
+}
+
+PacketPool::Cache::~Cache()
+{
+    if (n_)
+        pool_.give(stack_, n_);
+}
+
+bool PacketPool::Cache::refill()
+{
+    n_ = pool_.take(stack_, CACHE_BATCH);
+    return n_ > 0;
+}
+
+void PacketPool::Cache::spill()
+{
+    // Keep the most recently freed (cache-warm) half
+    pool_.give(stack_, CACHE_BATCH);
+    memmove(stack_, stack_ + CACHE_BATCH, (n_ - CACHE_BATCH) * sizeof(PktHandle));
+    n_ -= CACHE_BATCH;
+}
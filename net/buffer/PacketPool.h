@@ -0,0 +1,108 @@
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Index of a buffer in a PacketPool
+using PktHandle = uint32_t;
+constexpr PktHandle PKT_NONE = UINT32_MAX;
+
+/**
+ * @brief Fixed-size packet buffers in one preallocated mapping.
+ *
+ * All buffers are mapped and touched in the constructor: 2 MB huge pages
+ * (MAP_HUGETLB) when the kernel has them reserved, otherwise normal pages
+ * with a transparent-huge-page hint. The mapping is bound to the NUMA node
+ * of the constructing thread (preferred policy) before it is touched, so
+ * build the pool on the thread that runs the packet loop.
+ *
+ * Every buffer is BUF_SIZE bytes with HEADROOM bytes reserved in front of
+ * data(), so a stage can prepend its header in place instead of copying
+ * the packet behind it.
+ *
+ * Buffers are handed out through a Cache, one per thread: alloc() and
+ * free() are O(1) on a small stack and only every CACHE_BATCH-th call
+ * takes the pool's lock to refill or spill.
+ */
+class PacketPool
+{
+public:
+    static constexpr int BUF_SIZE = 2048;
+    static constexpr int HEADROOM = 64;
+    static constexpr int DATA_SIZE = BUF_SIZE - HEADROOM; ///< Room after data()
+
+    /// Maps `count` buffers; throws std::runtime_error if that fails.
+    explicit PacketPool(uint32_t count);
+    ~PacketPool();
+
+    PacketPool(const PacketPool &) = delete;
+    PacketPool &operator=(const PacketPool &) = delete;
+
+    /// Start of the buffer, headroom included
+    unsigned char *buf(PktHandle h) const { return base_ + (size_t)h * BUF_SIZE; }
+    /// Where a packet normally starts
+    unsigned char *data(PktHandle h) const { return buf(h) + HEADROOM; }
+
+    uint32_t capacity() const { return count_; }
+    bool hugePages() const { return huge_; }
+    int numaNode() const { return node_; }
+
+    /// Per-thread front end of the pool. Not thread-safe; returns its
+    /// buffers to the pool when destroyed.
+    class Cache
+    {
+    public:
+        explicit Cache(PacketPool &pool) : pool_(pool) {}
+        ~Cache();
+
+        Cache(const Cache &) = delete;
+        Cache &operator=(const Cache &) = delete;
+
+        /// PKT_NONE when the pool is exhausted
+        PktHandle alloc()
+        {
+            if (n_ == 0 && !refill())
+                return PKT_NONE;
+            return stack_[--n_];
+        }
+
+        void free(PktHandle h)
+        {
+            if (n_ == CACHE_SIZE)
+                spill();
+            stack_[n_++] = h;
+        }
+
+        PacketPool &pool() const { return pool_; }
+
+    private:
+        static constexpr uint32_t CACHE_SIZE = 64;
+        static constexpr uint32_t CACHE_BATCH = 32;
+
+        bool refill();
+        void spill();
+
+        PacketPool &pool_;
+        uint32_t n_ = 0;
+        PktHandle stack_[CACHE_SIZE];
+    };
+
+private:
+    /// Moves up to `n` free handles into `out`; returns how many.
+    uint32_t take(PktHandle *out, uint32_t n);
+    void give(const PktHandle *in, uint32_t n);
+
+    unsigned char *base_ = nullptr;
+    size_t map_len_ = 0;
+    uint32_t count_;
+    bool huge_ = false;
+    int node_ = -1;
+
+    std::mutex mu_;
+    std::vector<PktHandle> free_; ///< Shared free list, guarded by mu_
+};
+
+#endif // PACKETPOOL_H
@@ -0,0 +1,58 @@
+#ifndef BATCHSIZER_H
+#define BATCHSIZER_H
+
+#include <algorithm>
+
+/**
+ * @brief Picks the next batch size from how full the last ones were.
+ *
+ * A batch that came back full means more was queued behind it, so the
+ * size doubles. SHRINK_AFTER batches in a row that were at most a quarter
+ * full, or one batch that ran past its latency cap (tooSlow()), halve it.
+ * The size stays within [min, max]; storage is meant to be allocated for
+ * max up front.
+ */
+class BatchSizer
+{
+public:
+    BatchSizer(int min, int max) : min_(min), max_(max), limit_(min) {}
+
+    int limit() const { return limit_; }
+
+    /// One batch used `filled` of limit() slots.
+    void onBatch(int filled)
+    {
+        if (filled >= limit_)
+        {
+            limit_ = std::min(limit_ * 2, max_);
+            low_ = 0;
+        }
+        else if (filled * 4 > limit_)
+        {
+            low_ = 0;
+        }
+        else if (++low_ >= SHRINK_AFTER)
+        {
+            shrink();
+        }
+    }
+
+    /// The last batch took longer than the latency cap.
+    void tooSlow() { shrink(); }
+
+private:
+    static constexpr int SHRINK_AFTER = 8;
+
+    void shrink()
+    {
+        limit_ = std::max(limit_ / 2, min_);
+        low_ = 0;
+    }
+
+    int min_;
+    int max_;
+    int limit_;
+    int low_ = 0; ///< Consecutive mostly-empty batches
+};
+
+#endif // BATCHSIZER_H
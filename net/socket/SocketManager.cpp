@@ -1,5 +1,12 @@
 #include "SocketManager.h"
 #include "utils/logger.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // Linux 5.11, newer than some libc headers
+#endif
 
 int SocketManager::createUdpSocket(uint16_t port) 
 {
@@ -25,4 +32,35 @@ int SocketManager::createUdpSocket(uint16_t port)
     LOG(LOG_INFO, "UDP socket created and bound to port %d", port);
 
     return sock;
-}
\ No newline at end of file
+}
+
+ssize_t SocketManager::sendWithDf(int sock, const void *buf, size_t len, const sockaddr_in &dst)
+{
+    int saved = IP_PMTUDISC_WANT;
+    socklen_t saved_len = sizeof(saved);
+    getsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &saved, &saved_len);
+
+    int probe = IP_PMTUDISC_PROBE;
+    setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &probe, sizeof(probe));
+
+    ssize_t ret = sendto(sock, buf, len, 0, (const struct sockaddr *)&dst, sizeof(dst));
+    int err = errno;
+
+    setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &saved, sizeof(saved));
+    errno = err;
+    return ret;
+}
+
+bool SocketManager::enableBusyPoll(int sock, int usec)
+{
+    if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+    {
+        LOG(LOG_WARN, "SO_BUSY_POLL %d us: %s", usec, strerror(errno));
+        return false;
+    }
+    int one = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0)
+        LOG(LOG_WARN, "SO_PREFER_BUSY_POLL: %s", strerror(errno));
+    LOG(LOG_INFO, "Socket busy poll: %d us", usec);
+    return true;
+}
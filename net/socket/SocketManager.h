@@ -14,5 +14,26 @@ public:
         LOG(LOG_INFO, "[+] SocketManager instance destroyed\n");
     }
     static int createUdpSocket(uint16_t port) ;
+
+    /**
+     * @brief sendto() with the DF bit forced for this one datagram.
+     *
+     * Uses IP_PMTUDISC_PROBE so the kernel neither fragments the datagram
+     * nor rejects it based on its own cached PMTU, then restores the
+     * socket's previous setting. Meant for PMTU probes, not the data path.
+     */
+    static ssize_t sendWithDf(int sock, const void *buf, size_t len, const sockaddr_in &dst);
+
+    /**
+     * @brief Lets receives on `sock` busy poll the device queue.
+     *
+     * Sets SO_BUSY_POLL to `usec` and SO_PREFER_BUSY_POLL, which keeps the
+     * kernel from processing the queue in softirq while the application
+     * polls it (only effective with napi_defer_hard_irqs and
+     * gro_flush_timeout set on the device). Raising SO_BUSY_POLL above
+     * net.core.busy_read needs CAP_NET_ADMIN.
+     * @return false if SO_BUSY_POLL could not be set
+     */
+    static bool enableBusyPoll(int sock, int usec);
 };
 #endif // SOCKETMANAGER_H
\ No newline at end of file
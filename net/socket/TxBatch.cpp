@@ -0,0 +1,224 @@
+#include "TxBatch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <time.h>
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+#include "utils/PacketCapture.h"
+#include "utils/Trace.h"
+
+static long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+TxBatch::TxBatch(int sock, int min_batch, int max_batch, long latency_ns, int queue_len,
+                 PacketPool::Cache &cache)
+    : sock_(sock), max_batch_(max_batch), sizer_(min_batch, max_batch),
+      latency_ns_(latency_ns), cache_(cache), pool_(cache.pool()),
+      handles_(max_batch, PKT_NONE),
+      msgs_(max_batch), iovecs_(max_batch), addrs_(max_batch),
+      queue_(queue_len > 0 ? std::max(queue_len, 2 * max_batch) : 0),
+      q_msgs_(max_batch), q_iovecs_(max_batch)
+{
+    for (int i = 0; i < max_batch; i++)
+    {
+        handles_[i] = cache_.alloc();
+        if (handles_[i] == PKT_NONE)
+        {
+            for (int j = 0; j < i; j++)
+                cache_.free(handles_[j]);
+            throw std::runtime_error("TxBatch: packet pool exhausted");
+        }
+    }
+    memset(msgs_.data(), 0, sizeof(struct mmsghdr) * max_batch);
+    memset(q_msgs_.data(), 0, sizeof(struct mmsghdr) * max_batch);
+    for (int i = 0; i < max_batch; i++)
+    {
+        msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+        msgs_[i].msg_hdr.msg_name = &addrs_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+
+        q_msgs_[i].msg_hdr.msg_iov = &q_iovecs_[i];
+        q_msgs_[i].msg_hdr.msg_iovlen = 1;
+        q_msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+}
+
+TxBatch::~TxBatch()
+{
+    for (PktHandle h : handles_)
+        cache_.free(h);
+    for (int i = 0; i < q_len_; i++)
+        cache_.free(queue_[(q_head_ + i) % queue_.size()].h);
+}
+
+void TxBatch::commit(int len, const sockaddr_in &dst)
+{
+    iovecs_[count_].iov_base = slot();
+    iovecs_[count_].iov_len = len;
+    addrs_[count_] = dst;
+    added();
+}
+
+PktHandle TxBatch::commitBuffer(PktHandle h, unsigned char *start, int len,
+                                const sockaddr_in &dst)
+{
+    PktHandle spare = handles_[count_];
+    handles_[count_] = h;
+    iovecs_[count_].iov_base = start;
+    iovecs_[count_].iov_len = len;
+    addrs_[count_] = dst;
+    added();
+    return spare;
+}
+
+void TxBatch::added()
+{
+    count_++;
+
+    // ---- FLUSH CONDITIONS ----
+    if (count_ >= sizer_.limit())
+    {
+        flush();
+        return;
+    }
+    if (latency_ns_ > 0)
+    {
+        long now = nowNs();
+        if (count_ == 1)
+        {
+            first_ns_ = now;
+        }
+        else if (now - first_ns_ >= latency_ns_)
+        {
+            // Filling the batch takes too long; don't hold packets for it
+            STAT_ADD(udp_tx_latency_flushes, 1);
+            send();
+            sizer_.tooSlow();
+        }
+    }
+}
+
+void TxBatch::flush()
+{
+    if (count_ == 0)
+        return;
+    int n = count_;
+    send();
+    sizer_.onBatch(n);
+}
+
+void TxBatch::send()
+{
+    // Anything already queued goes first, or this batch would overtake it
+    int done = 0;
+    if (drainQueue())
+        done = sendAll(msgs_.data(), count_);
+
+    int dropped = 0;
+    for (int i = done; i < count_; i++)
+    {
+        if (!enqueue(i))
+            dropped++;
+    }
+    if (dropped)
+    {
+        LOG_RATELIMITED(LOG_WARN, "TX queue full, dropped %d packets", dropped);
+        STAT_ADD(udp_tx_drops, dropped);
+    }
+    count_ = 0;
+}
+
+bool TxBatch::drainQueue()
+{
+    while (q_len_ > 0)
+    {
+        int n = std::min(q_len_, max_batch_);
+        for (int i = 0; i < n; i++)
+        {
+            Queued &q = queue_[(q_head_ + i) % queue_.size()];
+            q_iovecs_[i].iov_base = pool_.buf(q.h) + q.off;
+            q_iovecs_[i].iov_len = q.len;
+            q_msgs_[i].msg_hdr.msg_name = &q.dst;
+        }
+        int done = sendAll(q_msgs_.data(), n);
+        for (int i = 0; i < done; i++)
+        {
+            cache_.free(queue_[q_head_].h);
+            q_head_ = (q_head_ + 1) % queue_.size();
+        }
+        q_len_ -= done;
+        if (done < n)
+            return false;
+    }
+    return true;
+}
+
+// Moves slot i's buffer to the back of the queue and gives the slot a
+// fresh one; false if there is no room for it
+bool TxBatch::enqueue(int i)
+{
+    if (q_len_ == (int)queue_.size())
+        return false;
+    PktHandle spare = cache_.alloc();
+    if (spare == PKT_NONE)
+        return false;
+
+    Queued &q = queue_[(q_head_ + q_len_) % queue_.size()];
+    q.h = handles_[i];
+    q.off = (uint16_t)((unsigned char *)iovecs_[i].iov_base - pool_.buf(q.h));
+    q.len = (uint16_t)iovecs_[i].iov_len;
+    q.dst = addrs_[i];
+    q_len_++;
+    handles_[i] = spare;
+    STAT_ADD(udp_tx_queued, 1);
+    return true;
+}
+
+// Sends msgs[0, n) until the socket buffer fills up. Datagrams the kernel
+// refuses for any other reason are dropped. Returns how many were used up
+// (sent or dropped); the rest are still to be sent.
+int TxBatch::sendAll(struct mmsghdr *msgs, int n)
+{
+    int done = 0;
+    while (done < n)
+    {
+        PROFILE_SCOPE_START(tx_syscall_t0);
+        TRACE_START(tx_syscall_tr);
+        int sent = sendmmsg(sock_, msgs + done, n - done, 0);
+        TRACE_END(tx_syscall_tr, TS_UDP_SEND, 0, sent > 0 ? sent : 0);
+        PROFILE_SCOPE_END(tx_syscall_t0, tx_syscall_cycles);
+        STAT_ADD(udp_tx_batches, 1);
+        STAT_ADD(udp_tx_batch_limit, sizer_.limit());
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                break; // Socket buffer full: retried from the queue
+            LOG_RATELIMITED(LOG_ERROR, "sendmmsg: %s", strerror(errno));
+            STAT_ADD(udp_tx_drops, 1);
+            done++;
+            continue;
+        }
+
+        STAT_ADD(udp_tx_pkts, sent);
+        for (int i = done; i < done + sent; i++)
+        {
+            const struct iovec &iov = *msgs[i].msg_hdr.msg_iov;
+            STAT_ADD(udp_tx_bytes, iov.iov_len);
+            CAPTURE_UDP(CAP_OUT, iov.iov_base, (int)iov.iov_len,
+                        *(const sockaddr_in *)msgs[i].msg_hdr.msg_name);
+        }
+        done += sent;
+    }
+    return done;
+}
@@ -0,0 +1,123 @@
+#ifndef TXBATCH_H
+#define TXBATCH_H
+
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "net/buffer/PacketPool.h"
+#include "net/socket/BatchSizer.h"
+
+/**
+ * @brief Outgoing UDP datagrams collected for a single sendmmsg() call.
+ *
+ * Usage on the hot path:
+ *
+ *     unsigned char *out = tx.slot();   // write datagram into out
+ *     tx.commit(len, dst_addr);         // flushes once the batch is full
+ *                                       // or its first datagram is too old
+ *     ...
+ *     tx.flush();                       // end of loop iteration
+ *
+ * or, for a datagram already built in a pool buffer,
+ *
+ *     h = tx.commitBuffer(h, start, len, dst_addr);
+ *
+ * which queues that buffer as it is and hands back the one the slot held,
+ * so nothing is copied and the caller still owns exactly one buffer.
+ *
+ * The batch size adapts between min_batch and max_batch (see BatchSizer):
+ * it grows while batches fill up and shrinks when they go out mostly
+ * empty or when the first datagram waited `latency_ns` for the rest.
+ *
+ * When the socket buffer is full, sendmmsg() sends only part of a batch.
+ * The rest is not dropped: those buffers move to a bounded FIFO queue
+ * (queue_len datagrams, at least two batches) and the slots get fresh
+ * ones from the pool. Until the queue is empty every later batch goes
+ * behind it. The owner retries with drainQueue() once the socket polls
+ * writable (EPOLLOUT), and stops producing while congested() is set.
+ * Datagrams are dropped only when the queue or the pool is full, or when
+ * the kernel rejects them for good.
+ *
+ * Every slot, up to max_batch, owns one PacketPool buffer, taken in the
+ * constructor. The destination address is copied into the batch, so a
+ * client may be removed between commit() and flush() without leaving a
+ * dangling msg_name.
+ */
+class TxBatch
+{
+public:
+    /// `latency_ns` 0 means no latency cap, `queue_len` 0 no queue (a
+    /// partial send drops the rest). Throws std::runtime_error if the pool
+    /// cannot fill max_batch slots.
+    TxBatch(int sock, int min_batch, int max_batch, long latency_ns, int queue_len,
+            PacketPool::Cache &cache);
+    ~TxBatch();
+
+    TxBatch(const TxBatch &) = delete;
+    TxBatch &operator=(const TxBatch &) = delete;
+
+    /// Buffer for the next datagram (bufSize() bytes, with pool headroom in front)
+    unsigned char *slot() { return pool_.data(handles_[count_]); }
+    int bufSize() const { return PacketPool::DATA_SIZE; }
+
+    /// Queue the datagram written into slot(); sends when the batch is full.
+    void commit(int len, const sockaddr_in &dst);
+
+    /// Queue `len` bytes at `start` inside pool buffer `h` without copying.
+    /// @return the buffer the caller gets in exchange for `h`
+    PktHandle commitBuffer(PktHandle h, unsigned char *start, int len, const sockaddr_in &dst);
+
+    /// Send everything queued so far.
+    void flush();
+
+    /// Retry the queued datagrams; true once the queue is empty.
+    bool drainQueue();
+
+    int pending() const { return count_; }
+    /// Datagrams waiting for socket buffer space
+    int queued() const { return q_len_; }
+    /// The queue cannot take another full batch
+    bool congested() const { return q_len_ > 0 && q_len_ + max_batch_ > (int)queue_.size(); }
+    /// Batch size currently in force
+    int limit() const { return sizer_.limit(); }
+
+private:
+    /// A partially sent datagram's buffer, waiting in the queue
+    struct Queued
+    {
+        PktHandle h;
+        uint16_t off; ///< Datagram start within pool_.buf(h)
+        uint16_t len;
+        sockaddr_in dst;
+    };
+
+    void added();
+    void send();
+    int sendAll(struct mmsghdr *msgs, int n);
+    bool enqueue(int i);
+
+    int sock_;
+    int max_batch_;
+    int count_ = 0;
+    BatchSizer sizer_;
+    long latency_ns_;
+    long first_ns_ = 0; ///< When the oldest queued datagram was committed
+
+    PacketPool::Cache &cache_;
+    PacketPool &pool_;
+
+    std::vector<PktHandle> handles_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct sockaddr_in> addrs_;
+
+    std::vector<Queued> queue_; ///< Ring: q_len_ entries from q_head_
+    int q_head_ = 0;
+    int q_len_ = 0;
+    std::vector<struct mmsghdr> q_msgs_;
+    std::vector<struct iovec> q_iovecs_;
+};
+
+#endif // TXBATCH_H
@@ -0,0 +1,144 @@
+#include "FakeTunDevice.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "utils/logger.h"
+
+static constexpr int SOCK_BUF_BYTES = 4 * 1024 * 1024; // absorbs bursts at line rate
+static constexpr int REFLECTOR_POLL_MS = 100;          // stop flag latency
+static constexpr size_t MAX_PACKET = 65535;
+
+FakeTunDevice::FakeTunDevice(const char *name)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        throw std::runtime_error("socketpair(SOCK_SEQPACKET) failed");
+    dev_fd_ = sv[0];
+    peer_fd_ = sv[1];
+    std::strncpy(name_, name, sizeof(name_) - 1);
+
+    int buf = SOCK_BUF_BYTES;
+    for (int fd : sv)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+    LOG(LOG_INFO, "Fake TUN device %s created with fd %d", name_, dev_fd_);
+}
+
+FakeTunDevice::~FakeTunDevice()
+{
+    stopReflector();
+    close(dev_fd_);
+    close(peer_fd_);
+}
+
+bool FakeTunDevice::inject(const void *pkt, size_t len)
+{
+    return send(peer_fd_, pkt, len, MSG_DONTWAIT) == (ssize_t)len;
+}
+
+ssize_t FakeTunDevice::capture(void *buf, size_t cap, int timeout_ms)
+{
+    while (true)
+    {
+        ssize_t n = recv(peer_fd_, buf, cap, MSG_DONTWAIT);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || timeout_ms <= 0)
+            return n;
+
+        struct pollfd pfd{peer_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+            return -1;
+        timeout_ms = 0; // readable now; one more non-blocking try
+    }
+}
+
+static inline uint16_t load16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void store16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void swapBytes(uint8_t *a, uint8_t *b, size_t n)
+{
+    uint8_t tmp[4];
+    memcpy(tmp, a, n);
+    memcpy(a, b, n);
+    memcpy(b, tmp, n);
+}
+
+void FakeTunDevice::reflect(uint8_t *pkt, size_t len)
+{
+    if (len < 20 || (pkt[0] >> 4) != 4)
+        return;
+    size_t ihl = (size_t)(pkt[0] & 0x0F) * 4;
+    if (ihl < 20 || ihl > len)
+        return;
+
+    // Swapping fields never changes a ones'-complement sum
+    swapBytes(pkt + 12, pkt + 16, 4);
+
+    uint8_t proto = pkt[9];
+    uint8_t *l4 = pkt + ihl;
+    size_t l4_len = len - ihl;
+    if ((proto == 6 || proto == 17) && l4_len >= 4)
+    {
+        swapBytes(l4, l4 + 2, 2);
+    }
+    else if (proto == 1 && l4_len >= 4 && l4[0] == 8)
+    {
+        // Echo request -> reply: type 8 -> 0, checksum += 0x0800 (RFC 1624)
+        l4[0] = 0;
+        uint32_t sum = (uint32_t)load16(l4 + 2) + 0x0800;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        store16(l4 + 2, (uint16_t)sum);
+    }
+}
+
+void FakeTunDevice::startReflector()
+{
+    if (reflector_.joinable())
+        return;
+    reflector_stop_.store(false, std::memory_order_relaxed);
+    reflector_ = std::thread(&FakeTunDevice::reflectorMain, this);
+}
+
+void FakeTunDevice::stopReflector()
+{
+    reflector_stop_.store(true, std::memory_order_relaxed);
+    if (reflector_.joinable())
+        reflector_.join();
+}
+
+void FakeTunDevice::reflectorMain()
+{
+    static thread_local uint8_t buf[MAX_PACKET];
+    struct pollfd pfd{peer_fd_, POLLIN, 0};
+    while (!reflector_stop_.load(std::memory_order_relaxed))
+    {
+        if (poll(&pfd, 1, REFLECTOR_POLL_MS) <= 0)
+            continue;
+        while (true)
+        {
+            ssize_t n = recv(peer_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n <= 0)
+                break;
+            reflect(buf, (size_t)n);
+            // A full buffer drops the answer, like a congested interface would
+            if (send(peer_fd_, buf, (size_t)n, MSG_DONTWAIT) == n)
+                reflected_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
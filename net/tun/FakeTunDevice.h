@@ -0,0 +1,68 @@
+#ifndef FAKETUNDEVICE_H
+#define FAKETUNDEVICE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <thread>
+
+#include "net/tun/PacketDevice.h"
+
+/**
+ * @brief Unprivileged stand-in for the TUN device.
+ *
+ * An AF_UNIX SOCK_SEQPACKET socketpair: the data plane gets one end as
+ * fd() and sees the same one-packet-per-read()/write() semantics as a
+ * TUN fd, the test or benchmark drives the other end. No root, no
+ * interface, no routing, so the whole vpn_server pipeline runs in an
+ * unprivileged container.
+ *
+ * Either capture() what the server writes, or let the reflector answer
+ * it: the reflector plays a host behind the TUN that sends every packet
+ * back with IPv4 addresses (and UDP/TCP ports) swapped and ICMP echo
+ * requests turned into replies, so a client sees its own traffic return.
+ * Use one or the other, not both at once.
+ */
+class FakeTunDevice : public PacketDevice
+{
+public:
+    /// Throws std::runtime_error if the socketpair cannot be created.
+    explicit FakeTunDevice(const char *name = "faketun0");
+    ~FakeTunDevice() override;
+
+    FakeTunDevice(const FakeTunDevice &) = delete;
+    FakeTunDevice &operator=(const FakeTunDevice &) = delete;
+
+    int fd() const override { return dev_fd_; }
+    const char *name() const override { return name_; }
+
+    /// Hands one packet to the data plane, as if the kernel routed it into the TUN.
+    /// @return false if the socket buffer is full or the packet is too large
+    bool inject(const void *pkt, size_t len);
+
+    /// Next packet the data plane wrote, waiting up to timeout_ms (0 = poll).
+    /// @return its length, or -1 if none arrived
+    ssize_t capture(void *buf, size_t cap, int timeout_ms = 0);
+
+    void startReflector();
+    void stopReflector(); ///< Joins the thread; safe to call twice
+
+    uint64_t reflected() const { return reflected_.load(std::memory_order_relaxed); }
+
+    /// Rewrites an IPv4 packet into the answer a peer would send (see above).
+    static void reflect(uint8_t *pkt, size_t len);
+
+private:
+    void reflectorMain();
+
+    int dev_fd_ = -1;  ///< Data plane end
+    int peer_fd_ = -1; ///< Test end
+    char name_[16] = {};
+
+    std::thread reflector_;
+    std::atomic<bool> reflector_stop_{false};
+    std::atomic<uint64_t> reflected_{0};
+};
+
+#endif // FAKETUNDEVICE_H
@@ -0,0 +1,26 @@
+#ifndef PACKETDEVICE_H
+#define PACKETDEVICE_H
+
+/**
+ * @brief The IP side of the data plane: where decrypted packets go and
+ * where outgoing ones come from.
+ *
+ * An implementation exposes one pollable, non-blocking fd on which every
+ * read() returns exactly one IPv4 packet and every write() takes exactly
+ * one, like a TUN device opened with IFF_NO_PI. The data plane keeps
+ * calling read()/write() on fd() itself, so the real device pays nothing
+ * for the abstraction and a fake exercises the same syscall pattern.
+ *
+ * Implementations: TunDevice (the kernel interface, needs CAP_NET_ADMIN)
+ * and FakeTunDevice (an unprivileged socketpair for benchmarks and tests).
+ */
+class PacketDevice
+{
+public:
+    virtual ~PacketDevice() = default;
+
+    virtual int fd() const = 0;
+    virtual const char *name() const = 0;
+};
+
+#endif // PACKETDEVICE_H
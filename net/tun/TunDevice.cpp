@@ -27,3 +27,16 @@ int TunDevice::create(const char* name)
     LOG(LOG_INFO, "TUN device %s created with fd %d", ifr.ifr_name, fd);
     return fd;
 }
+
+TunDevice::TunDevice(const char* name)
+    : fd_(create(name))
+{
+    std::strncpy(name_, name, sizeof(name_) - 1);
+    fcntl(fd_, F_SETFL, O_NONBLOCK);
+}
+
+TunDevice::~TunDevice()
+{
+    close(fd_);
+    LOG(LOG_INFO, "TUN device %s closed", name_);
+}
@@ -2,19 +2,27 @@
 #define TUNDEVICE_H
 
 #include <iostream>
+#include "net/tun/PacketDevice.h"
 #include "utils/logger.h"
 
-class TunDevice {
+class TunDevice : public PacketDevice {
 public:
     // Throws on failure or returns fd
     static int create(const char* name = "tun0");
-    // Constructor and Destructor with basic logging
-    TunDevice(){
-        LOG(LOG_INFO, "[+] TunDevice instance created\n");
-    }
-    ~TunDevice(){
-        LOG(LOG_INFO, "[+] TunDevice instance destroyed\n");
-    }
+
+    /// Opens the interface (non-blocking); throws like create()
+    explicit TunDevice(const char* name = "tun0");
+    ~TunDevice() override;
+
+    TunDevice(const TunDevice&) = delete;
+    TunDevice& operator=(const TunDevice&) = delete;
+
+    int fd() const override { return fd_; }
+    const char* name() const override { return name_; }
+
+private:
+    int fd_;
+    char name_[16] = {};
 };
 
-#endif // TUNDEVICE_H
\ No newline at end of file
+#endif // TUNDEVICE_H
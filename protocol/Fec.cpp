@@ -0,0 +1,188 @@
+#include "Fec.h"
+
+#include <cstring>
+#include <endian.h>
+#include <arpa/inet.h>
+
+// dst[0..len) ^= src[0..len), eight bytes at a time
+static inline void xorInto(uint8_t *dst, const uint8_t *src, int len)
+{
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+bool fecNegotiate(uint8_t &data, uint8_t &parity)
+{
+    if (data < 2 || parity < 1)
+        return false;
+    if (data > FEC_MAX_DATA)
+        data = FEC_MAX_DATA;
+    if (parity > FEC_MAX_PARITY)
+        parity = FEC_MAX_PARITY;
+    if (parity > data)
+        parity = data;
+    return true;
+}
+
+/* ---------- encoder ---------- */
+
+FecEncoder::FecEncoder(uint8_t data, uint8_t parity)
+    : data_(data), parity_(parity)
+{
+    memset(classes_, 0, sizeof(classes_));
+}
+
+bool FecEncoder::add(uint64_t seq, uint8_t type, const uint8_t *payload, int len)
+{
+    int covered = len > FEC_MAX_PAYLOAD ? FEC_MAX_PAYLOAD : len;
+
+    uint32_t idx = (seq - 1) % data_;
+    if (idx == 0)
+    {
+        base_seq_ = seq;
+        for (int j = 0; j < parity_; j++)
+        {
+            classes_[j].len_xor = 0;
+            classes_[j].max_len = 0;
+            classes_[j].type_xor = 0;
+        }
+    }
+
+    Parity &p = classes_[idx % parity_];
+    if (covered > p.max_len)
+    {
+        // Bytes past max_len still hold the previous group; zero-pad first
+        memset(p.bytes + p.max_len, 0, covered - p.max_len);
+        p.max_len = covered;
+    }
+    xorInto(p.bytes, payload, covered);
+    p.len_xor ^= (uint16_t)len;
+    p.type_xor ^= type;
+
+    return idx == (uint32_t)data_ - 1;
+}
+
+int FecEncoder::buildRepair(int j, uint32_t session_id_net, uint8_t *out) const
+{
+    const Parity &p = classes_[j];
+
+    FecRepairHeader hdr;
+    hdr.hdr.type = PKT_FEC_REPAIR;
+    hdr.hdr.session_id = session_id_net;
+    hdr.base_seq = htobe64(base_seq_);
+    hdr.data_count = data_;
+    hdr.parity_count = parity_;
+    hdr.parity_index = (uint8_t)j;
+    hdr.type_xor = p.type_xor;
+    hdr.len_xor = htons(p.len_xor);
+
+    memcpy(out, &hdr, sizeof(hdr));
+    memcpy(out + sizeof(hdr), p.bytes, p.max_len);
+    return sizeof(hdr) + p.max_len;
+}
+
+/* ---------- decoder ---------- */
+
+FecDecoder::FecDecoder(uint8_t data, uint8_t parity)
+    : data_(data), parity_(parity)
+{
+}
+
+void FecDecoder::startGroup(uint64_t base)
+{
+    base_seq_ = base;
+    received_ = 0;
+}
+
+void FecDecoder::onData(uint64_t seq, uint8_t type, const uint8_t *payload, int len)
+{
+    uint64_t base = groupBase(seq);
+    if (base < base_seq_)
+        return; // late packet of an older group, nothing to repair with it
+    if (base > base_seq_)
+        startGroup(base);
+
+    if (len > FEC_MAX_PAYLOAD)
+        return;
+
+    uint32_t idx = seq - base;
+    memcpy(slots_[idx], payload, len);
+    len_[idx] = (uint16_t)len;
+    type_[idx] = type;
+    received_ |= (1u << idx);
+}
+
+bool FecDecoder::onRepair(const uint8_t *pkt, int n, Recovered &out)
+{
+    if (n < (int)sizeof(FecRepairHeader))
+        return false;
+
+    FecRepairHeader hdr;
+    memcpy(&hdr, pkt, sizeof(hdr));
+    const uint8_t *parity = pkt + sizeof(hdr);
+    int parity_len = n - sizeof(hdr);
+
+    // Both ends negotiated the same n/k; anything else is garbage
+    if (hdr.data_count != data_ || hdr.parity_count != parity_ ||
+        hdr.parity_index >= parity_)
+        return false;
+
+    uint64_t base = be64toh(hdr.base_seq);
+    if (base == 0 || groupBase(base) != base || base < base_seq_)
+        return false;
+    if (base > base_seq_)
+        startGroup(base); // every data packet of this group was lost so far
+
+    // Find the single missing member of class j
+    int missing = -1;
+    for (int i = hdr.parity_index; i < data_; i += parity_)
+    {
+        if (received_ & (1u << i))
+            continue;
+        if (missing >= 0)
+            return false; // two or more lost in this class
+        missing = i;
+    }
+    if (missing < 0)
+        return false; // nothing to do
+
+    uint16_t len = ntohs(hdr.len_xor);
+    uint8_t type = hdr.type_xor;
+    uint8_t *dst = slots_[missing];
+
+    if (parity_len > FEC_MAX_PAYLOAD)
+        return false;
+    memcpy(dst, parity, parity_len);
+
+    for (int i = hdr.parity_index; i < data_; i += parity_)
+    {
+        if (i == missing)
+            continue;
+        int l = len_[i] < parity_len ? len_[i] : parity_len;
+        xorInto(dst, slots_[i], l);
+        len ^= len_[i];
+        type ^= type_[i];
+    }
+
+    if (len == 0 || len > parity_len)
+        return false;
+
+    len_[missing] = len;
+    type_[missing] = type;
+    received_ |= (1u << missing);
+
+    out.seq = base + missing;
+    out.type = type;
+    out.len = len;
+    out.payload = dst;
+    return true;
+}
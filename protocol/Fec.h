@@ -0,0 +1,140 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <cstdint>
+#include "protocol/Handshake.h"
+
+/*
+    Forward error correction with interleaved XOR parity.
+
+    Outgoing PKT_DATA packets of a session are grouped by sequence number:
+    group g covers seq [g*n + 1, g*n + n]. For each group the sender emits
+    k PKT_FEC_REPAIR packets; repair j is the XOR of the wire payloads of
+    the data packets whose index i in the group satisfies i % k == j.
+
+    The receiver can therefore rebuild one lost packet per parity class,
+    i.e. up to k losses per group when they are spread across classes
+    (a burst of k consecutive losses is always recoverable).
+
+    Parity is computed over the encrypted payload, so a recovered packet
+    goes through the normal replay check + decrypt path unchanged.
+*/
+
+constexpr int FEC_MAX_DATA = 16;
+constexpr int FEC_MAX_PARITY = 4;
+// Largest payload covered by parity; a repair (header + parity) must fit
+// one packet-pool buffer (PacketPool::DATA_SIZE, 1984 bytes)
+constexpr int FEC_MAX_PAYLOAD = 1960;
+
+/*
+    PKT_FEC_REPAIR layout. Followed by the parity bytes, whose length is
+    the longest payload in the class.
+*/
+#pragma pack(push, 1)
+struct FecRepairHeader
+{
+    PacketHeader hdr;
+    uint64_t base_seq;    // seq of the first data packet in the group (network order)
+    uint8_t data_count;   // n
+    uint8_t parity_count; // k
+    uint8_t parity_index; // j: this repair covers indices i with i % k == j
+    uint8_t type_xor;     // XOR of the PacketType of covered packets
+    uint16_t len_xor;     // XOR of the payload lengths (network order)
+};
+#pragma pack(pop)
+
+/**
+ * @brief Clamps a client's FEC request to what the server supports.
+ *
+ * @return true if FEC is enabled for the session (n and k updated in place)
+ */
+bool fecNegotiate(uint8_t &data, uint8_t &parity);
+
+/**
+ * @brief Sender side: accumulates parity for one session.
+ */
+class FecEncoder
+{
+public:
+    FecEncoder(uint8_t data, uint8_t parity);
+
+    /**
+     * @brief Adds an outgoing data packet to the current group.
+     *
+     * Only the first FEC_MAX_PAYLOAD bytes enter the parity. A longer
+     * packet keeps its real length in len_xor, so the receiver can't
+     * "recover" a truncated copy of it; its class is just not repairable.
+     *
+     * @return true when this packet completes the group; the caller then
+     *         emits parityCount() repair packets via buildRepair().
+     */
+    bool add(uint64_t seq, uint8_t type, const uint8_t *payload, int len);
+
+    int parityCount() const { return parity_; }
+
+    /**
+     * @brief Serializes repair packet j of the last completed group.
+     *
+     * @param out must hold sizeof(FecRepairHeader) + FEC_MAX_PAYLOAD bytes
+     * @return total packet length
+     */
+    int buildRepair(int j, uint32_t session_id_net, uint8_t *out) const;
+
+private:
+    struct Parity
+    {
+        uint16_t len_xor;
+        uint16_t max_len;
+        uint8_t type_xor;
+        uint8_t bytes[FEC_MAX_PAYLOAD];
+    };
+
+    uint8_t data_;
+    uint8_t parity_;
+    uint64_t base_seq_ = 0;
+    Parity classes_[FEC_MAX_PARITY];
+};
+
+/**
+ * @brief Receiver side: remembers the current group and rebuilds losses.
+ */
+class FecDecoder
+{
+public:
+    struct Recovered
+    {
+        uint64_t seq;
+        uint8_t type;
+        int len;
+        const uint8_t *payload; // valid until the next call into the decoder
+    };
+
+    FecDecoder(uint8_t data, uint8_t parity);
+
+    /**
+     * @brief Records a data packet that passed the replay check.
+     */
+    void onData(uint64_t seq, uint8_t type, const uint8_t *payload, int len);
+
+    /**
+     * @brief Processes a repair packet (n bytes including header).
+     *
+     * @return true if exactly one packet was missing from the class and
+     *         has been rebuilt into out.
+     */
+    bool onRepair(const uint8_t *pkt, int n, Recovered &out);
+
+private:
+    uint64_t groupBase(uint64_t seq) const { return ((seq - 1) / data_) * data_ + 1; }
+    void startGroup(uint64_t base);
+
+    uint8_t data_;
+    uint8_t parity_;
+    uint64_t base_seq_ = 0;
+    uint32_t received_ = 0; // bit i set = data packet i of the group is held
+    uint16_t len_[FEC_MAX_DATA];
+    uint8_t type_[FEC_MAX_DATA];
+    uint8_t slots_[FEC_MAX_DATA][FEC_MAX_PAYLOAD];
+};
+
+#endif // FEC_H
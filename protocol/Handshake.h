@@ -13,7 +13,21 @@ enum PacketType : uint8_t
     PKT_CLIENT_ACK = 3, // Client → Server (ack welcome)
     PKT_DATA = 4,       // Encrypted VPN data
     PKT_BYE = 5,        // Client → Server disconnect (best effort)
-    PKT_KEEPALIVE = 6   // Client → Server heartbeat (header only)
+    PKT_KEEPALIVE = 6,  // Client → Server heartbeat (header only)
+    PKT_FEC_REPAIR = 7, // Either direction, FEC repair for a group of PKT_DATA
+    PKT_DATA_LZ4 = 8,   // Like PKT_DATA, payload is an LZ4 block of the IPv4 packet
+    PKT_PMTU_PROBE = 9, // Server → Client, padded DF probe (see protocol/PathMtu.h)
+    PKT_PMTU_ACK = 10   // Client → Server, answers PKT_PMTU_PROBE
+};
+
+/*
+    Optional per-session features, negotiated with HandshakeExt.
+*/
+enum SessionCaps : uint8_t
+{
+    CAP_FEC = 0x01,     // XOR parity repair packets (see protocol/Fec.h)
+    CAP_COMPRESS = 0x02, // PKT_DATA_LZ4 may be sent in both directions
+    CAP_PMTU = 0x04      // Client answers PKT_PMTU_PROBE with PKT_PMTU_ACK
 };
 
 /*
@@ -55,6 +69,40 @@ struct WelcomePacket
 };
 #pragma pack(pop)
 
+/*
+    Optional trailer appended to HELLO (client request) and WELCOME
+    (server answer). Clients that send a plain HelloPacket get a plain
+    WelcomePacket back, so older clients keep working unchanged.
+
+    The server answers with the subset of caps it accepted and the
+    parameters clamped to its own limits.
+*/
+#pragma pack(push, 1)
+struct HandshakeExt
+{
+    uint8_t caps;       // SessionCaps bitmask
+    uint8_t fec_data;   // FEC: data packets per group (n)
+    uint8_t fec_parity; // FEC: repair packets per group (k)
+    uint8_t reserved;
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct HelloPacketExt
+{
+    HelloPacket hello;
+    HandshakeExt ext;
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct WelcomePacketExt
+{
+    WelcomePacket welcome;
+    HandshakeExt ext;
+};
+#pragma pack(pop)
+
 /*
  Client → Server
  Client sends this to acknowledge WELCOME packet, with its own chosen XOR key.
@@ -65,14 +113,31 @@ struct ClientAckPacket
     PacketHeader hdr;
 };
 #pragma pack(pop)
+/*
+    Header of every PKT_DATA / PKT_DATA_LZ4 packet.
+    seq is a per-session, per-direction counter (network byte order,
+    starts at 1) checked against the receiver's anti-replay window
+    BEFORE the payload is decrypted.
+*/
+#pragma pack(push, 1)
+struct DataHeader
+{
+    PacketHeader hdr;
+    uint64_t seq;
+};
+#pragma pack(pop)
+
 /*
     Encrypted VPN data packet.
-    Payload is XOR-encrypted IPv4 packet.
+    Payload is XOR-encrypted IPv4 packet (PKT_DATA), or the XOR-encrypted
+    LZ4 block of that packet (PKT_DATA_LZ4). Compression happens before
+    encryption; a sender only uses PKT_DATA_LZ4 when it made the packet
+    smaller.
 */
 #pragma pack(push, 1)
 struct DataPacket
 {
-    PacketHeader hdr;
+    DataHeader hdr;
     uint8_t payload[]; // encrypted data
 };
 #pragma pack(pop)
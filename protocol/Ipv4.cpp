@@ -0,0 +1,55 @@
+#include "Ipv4.h"
+
+#include <cstring>
+
+static inline uint16_t load16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void store16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+bool rewriteIpv4Address(uint8_t *pkt, int len, Ipv4AddrField field, uint32_t addr)
+{
+    if (len < 20 || (pkt[0] >> 4) != 4)
+        return false;
+    int ihl = (pkt[0] & 0x0F) * 4;
+    if (ihl < 20 || ihl > len)
+        return false;
+
+    uint8_t *a = pkt + field;
+    uint16_t old_hi = load16(a), old_lo = load16(a + 2);
+    memcpy(a, &addr, 4);
+    uint16_t new_hi = load16(a), new_lo = load16(a + 2);
+
+    uint16_t csum = load16(pkt + 10);
+    csum = csumReplace16(csumReplace16(csum, old_hi, new_hi), old_lo, new_lo);
+    store16(pkt + 10, csum);
+
+    // Later fragments carry no L4 header
+    if ((((pkt[6] & 0x1F) << 8) | pkt[7]) != 0)
+        return true;
+
+    uint8_t *l4 = pkt + ihl;
+    int l4_len = len - ihl;
+    int off;
+    if (pkt[9] == 6 && l4_len >= 20)
+        off = 16;
+    else if (pkt[9] == 17 && l4_len >= 8)
+        off = 6;
+    else
+        return true;
+
+    csum = load16(l4 + off);
+    if (pkt[9] == 17 && csum == 0)
+        return true; // sender did not checksum
+    csum = csumReplace16(csumReplace16(csum, old_hi, new_hi), old_lo, new_lo);
+    if (pkt[9] == 17 && csum == 0)
+        csum = 0xFFFF;
+    store16(l4 + off, csum);
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef IPV4_H
+#define IPV4_H
+
+#include <cstdint>
+
+/// RFC 1624 incremental checksum update: HC' = ~(~HC + ~m + m')
+static inline uint16_t csumReplace16(uint16_t csum, uint16_t old_w, uint16_t new_w)
+{
+    uint32_t sum = (uint16_t)~csum;
+    sum += (uint16_t)~old_w;
+    sum += new_w;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+enum Ipv4AddrField
+{
+    IPV4_SRC = 12,
+    IPV4_DST = 16
+};
+
+/**
+ * @brief Replaces the source or destination address of an IPv4 packet.
+ *
+ * The header checksum is patched incrementally, and so is the TCP / UDP
+ * checksum of a first fragment, since it covers the addresses through
+ * the pseudo header (a zero UDP checksum stays zero).
+ *
+ * @param addr network order
+ * @return false if `pkt` is not an IPv4 packet
+ */
+bool rewriteIpv4Address(uint8_t *pkt, int len, Ipv4AddrField field, uint32_t addr);
+
+#endif // IPV4_H
@@ -0,0 +1,192 @@
+#include "PathMtu.h"
+
+#include <cstring>
+#include <arpa/inet.h>
+#include "protocol/Fec.h"
+#include "protocol/Ipv4.h"
+
+static_assert(PMTU_TUNNEL_OVERHEAD == 20 + 8 + sizeof(FecRepairHeader),
+              "tunnel overhead must cover the largest per-packet header");
+
+/* ---------- discovery ---------- */
+
+PmtuDiscovery::PmtuDiscovery()
+{
+    setMtu(PMTU_DEFAULT);
+}
+
+void PmtuDiscovery::setMtu(uint16_t mtu)
+{
+    mtu_ = mtu;
+    mss_ = mtu - PMTU_TUNNEL_OVERHEAD - TCPIP_HEADERS;
+}
+
+void PmtuDiscovery::enable(time_t now)
+{
+    restart(PMTU_START);
+    next_search_at_ = now;
+    // Assume PMTU_START until its probe is answered or lost
+    setMtu(PMTU_START);
+}
+
+// Searches all of [PMTU_MIN, PMTU_MAX] again, starting with a probe of
+// `first`. Nothing above PMTU_MIN counts as known-good until acked.
+void PmtuDiscovery::restart(uint16_t first)
+{
+    state_ = SEARCHING;
+    lo_ = PMTU_MIN;
+    hi_ = PMTU_MAX;
+    first_ = first > PMTU_MIN ? first : 0;
+    probing_ = 0;
+    tries_ = 0;
+}
+
+int PmtuDiscovery::nextProbe(time_t now, uint16_t &probe_id)
+{
+    if (state_ == DONE && now >= next_search_at_)
+    {
+        // Periodic re-search: the path may have grown or shrunk, so
+        // revalidate the current size first and search from there
+        restart(mtu_);
+    }
+    if (state_ != SEARCHING)
+        return 0;
+
+    if (probing_)
+    {
+        if (now - sent_at_ < PROBE_TIMEOUT_SEC)
+            return 0;
+        // Outstanding probe timed out
+        if (!ever_acked_ && ++silent_ >= MAX_SILENT_PROBES)
+        {
+            state_ = IDLE; // client negotiated CAP_PMTU but never answers
+            probing_ = 0;
+            setMtu(PMTU_MIN);
+            return 0;
+        }
+        if (++tries_ >= PROBE_TRIES)
+            probeFailed(now);
+        if (state_ != SEARCHING)
+            return 0;
+    }
+
+    if (!probing_)
+    {
+        probing_ = first_ ? first_ : (uint16_t)((lo_ + hi_ + 1) / 2);
+        first_ = 0;
+        tries_ = 0;
+    }
+    sent_at_ = now;
+    probe_id = ++probe_id_;
+    return probing_ - 20 - 8; // UDP payload size
+}
+
+bool PmtuDiscovery::onAck(uint16_t probe_size, uint16_t probe_id, time_t now)
+{
+    if (state_ != SEARCHING || !probing_ || probe_id != probe_id_)
+        return false;
+    if (probe_size + 20 + 8 != probing_)
+        return false;
+
+    ever_acked_ = true;
+    lo_ = probing_;
+    probing_ = 0;
+    setMtu(lo_);
+    checkDone(now);
+    return state_ == DONE;
+}
+
+void PmtuDiscovery::onLocalTooBig(time_t now)
+{
+    if (state_ == SEARCHING && probing_)
+        probeFailed(now);
+}
+
+void PmtuDiscovery::probeFailed(time_t now)
+{
+    // Every probe is above lo_, so this never drops below it
+    hi_ = probing_ - 1;
+    probing_ = 0;
+    // The size in use is no longer known to fit: fall back to what is
+    if (mtu_ > hi_)
+        setMtu(lo_);
+    checkDone(now);
+}
+
+void PmtuDiscovery::checkDone(time_t now)
+{
+    // Stop once within 8 bytes; IP fragments are 8-byte aligned anyway
+    if (hi_ - lo_ < 8)
+    {
+        state_ = DONE;
+        next_search_at_ = now + RESEARCH_INTERVAL_SEC;
+    }
+}
+
+/* ---------- MSS clamping ---------- */
+
+bool clampTcpMss(uint8_t *pkt, int len, uint16_t max_mss)
+{
+    // IPv4, TCP, first fragment only
+    if (len < 20 || (pkt[0] >> 4) != 4 || pkt[9] != 6)
+        return false;
+    int ihl = (pkt[0] & 0x0F) * 4;
+    if (ihl < 20 || (((pkt[6] & 0x1F) << 8) | pkt[7]) != 0)
+        return false;
+
+    uint8_t *tcp = pkt + ihl;
+    int tcp_len = len - ihl;
+    if (tcp_len < 20 || !(tcp[13] & 0x02)) // SYN flag
+        return false;
+
+    int doff = (tcp[12] >> 4) * 4;
+    if (doff <= 20 || doff > tcp_len)
+        return false;
+
+    int i = 20;
+    while (i < doff)
+    {
+        uint8_t kind = tcp[i];
+        if (kind == 0) // end of options
+            break;
+        if (kind == 1) // NOP
+        {
+            i++;
+            continue;
+        }
+        if (i + 1 >= doff)
+            break;
+        uint8_t olen = tcp[i + 1];
+        if (olen < 2 || i + olen > doff)
+            break;
+
+        if (kind == 2 && olen == 4)
+        {
+            uint16_t mss = (tcp[i + 2] << 8) | tcp[i + 3];
+            if (mss <= max_mss)
+                return false;
+
+            // Checksum words are aligned to the TCP header; the option may not be
+            int first = (i + 2) & ~1;
+            int last = (i + 4 + 1) & ~1; // exclusive
+            uint16_t old_words[3];
+            for (int w = first, k = 0; w < last; w += 2, k++)
+                old_words[k] = (tcp[w] << 8) | (w + 1 < doff ? tcp[w + 1] : 0);
+
+            tcp[i + 2] = max_mss >> 8;
+            tcp[i + 3] = max_mss & 0xFF;
+
+            uint16_t csum = (tcp[16] << 8) | tcp[17];
+            for (int w = first, k = 0; w < last; w += 2, k++)
+            {
+                uint16_t new_w = (tcp[w] << 8) | (w + 1 < doff ? tcp[w + 1] : 0);
+                csum = csumReplace16(csum, old_words[k], new_w);
+            }
+            tcp[16] = csum >> 8;
+            tcp[17] = csum & 0xFF;
+            return true;
+        }
+        i += olen;
+    }
+    return false;
+}
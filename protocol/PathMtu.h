@@ -0,0 +1,131 @@
+#ifndef PATHMTU_H
+#define PATHMTU_H
+
+#include <cstdint>
+#include <ctime>
+#include "protocol/Handshake.h"
+
+/*
+    Path-MTU discovery over the UDP transport + inner TCP MSS clamping.
+
+    The server probes each client that negotiated CAP_PMTU with padded
+    PKT_PMTU_PROBE datagrams sent with DF set. The client answers every
+    probe it receives with PKT_PMTU_ACK. The first probe is PMTU_START;
+    from there a binary search between the last acknowledged size (or
+    PMTU_MIN) and the last failed one converges on the largest outer IP
+    MTU that reaches the client without fragmentation. A client that
+    never answers is treated as having a PMTU_MIN path.
+
+    The discovered MTU is turned into a TCP MSS, which is written into
+    SYN / SYN-ACK packets crossing the tunnel in both directions, so
+    inner TCP segments always fit in a single outer datagram.
+*/
+
+#pragma pack(push, 1)
+struct PmtuProbePacket
+{
+    PacketHeader hdr;
+    uint16_t probe_size; // total UDP payload size of this probe (network order)
+    uint16_t probe_id;   // echoed back so late acks can be told apart
+    // zero padding up to probe_size
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct PmtuAckPacket
+{
+    PacketHeader hdr;
+    uint16_t probe_size; // copied from the probe
+    uint16_t probe_id;   // copied from the probe
+};
+#pragma pack(pop)
+
+constexpr uint16_t PMTU_MIN = 576;      // IPv4 minimum, never probe below
+constexpr uint16_t PMTU_DEFAULT = 1500; // assumed for clients without CAP_PMTU
+constexpr uint16_t PMTU_START = 1280;   // first probe; assumed until it is answered
+constexpr uint16_t PMTU_MAX = 1500;     // no point probing past Ethernet
+
+// Outer IPv4 + UDP + our largest per-packet header (FEC repair > data)
+constexpr int PMTU_TUNNEL_OVERHEAD = 20 + 8 + 19;
+constexpr int TCPIP_HEADERS = 40;
+
+/**
+ * @brief Per-client PMTU search state machine.
+ *
+ * Driven from the once-per-second maintenance tick, never from the
+ * packet path: nextProbe() says what to send, onAck() feeds back results.
+ */
+class PmtuDiscovery
+{
+public:
+    static constexpr int PROBE_TIMEOUT_SEC = 1;
+    static constexpr int PROBE_TRIES = 2;          // lost probes before a size counts as too big
+    static constexpr int RESEARCH_INTERVAL_SEC = 600; // paths change: look again periodically
+    static constexpr int MAX_SILENT_PROBES = 8;    // client never answers: give up
+
+    PmtuDiscovery();
+
+    /// Start searching (only for clients that negotiated CAP_PMTU).
+    /// Called again when the client roams: the new path is unknown.
+    void enable(time_t now);
+
+    /// Best known outer IP MTU towards this client.
+    uint16_t pathMtu() const { return mtu_; }
+
+    /// MSS that keeps an inner TCP segment within one outer datagram.
+    uint16_t tcpMss() const { return mss_; }
+
+    /**
+     * @brief Returns the UDP payload size of the probe to send now, or 0.
+     *
+     * A probe that has been outstanding for PROBE_TIMEOUT_SEC counts as lost.
+     */
+    int nextProbe(time_t now, uint16_t &probe_id);
+
+    /**
+     * @brief Processes an ack. Returns true when the search just converged.
+     */
+    bool onAck(uint16_t probe_size, uint16_t probe_id, time_t now);
+
+    /// The probe could not even leave this host (EMSGSIZE).
+    void onLocalTooBig(time_t now);
+
+private:
+    enum State : uint8_t
+    {
+        IDLE,      ///< Not negotiated, or given up
+        SEARCHING, ///< Binary search in progress
+        DONE       ///< Converged, waiting for RESEARCH_INTERVAL_SEC
+    };
+
+    void setMtu(uint16_t mtu);
+    void restart(uint16_t first);
+    void probeFailed(time_t now);
+    void checkDone(time_t now);
+
+    State state_ = IDLE;
+    uint16_t mtu_;
+    uint16_t mss_;
+    uint16_t lo_ = 0;  ///< Largest size known to work (outer IP MTU)
+    uint16_t hi_ = 0;  ///< Largest size not yet known to fail
+    uint16_t probing_ = 0; ///< Outstanding probe, outer IP MTU (0 = none)
+    uint16_t first_ = 0;   ///< Size to probe before bisecting (0 = bisect)
+    uint16_t probe_id_ = 0;
+    uint8_t tries_ = 0;
+    uint8_t silent_ = 0; ///< Probes sent without ever seeing an ack
+    bool ever_acked_ = false;
+    time_t sent_at_ = 0;
+    time_t next_search_at_ = 0;
+};
+
+/**
+ * @brief Lowers the MSS option of an IPv4 TCP SYN to max_mss.
+ *
+ * Non-TCP, non-SYN and fragmented packets are left untouched. The TCP
+ * checksum is patched incrementally (RFC 1624).
+ *
+ * @return true if the packet was modified
+ */
+bool clampTcpMss(uint8_t *pkt, int len, uint16_t max_mss);
+
+#endif // PATHMTU_H
@@ -0,0 +1,87 @@
+#ifndef REPLAYWINDOW_H
+#define REPLAYWINDOW_H
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Sliding-window anti-replay filter for per-packet sequence numbers.
+ *
+ * Bitmap ring in the style of RFC 6479: the window is stored as WORDS
+ * 64-bit words indexed by (seq / 64) % WORDS. Advancing the window only
+ * clears the words that slid out, so moving forward costs at most one
+ * word store per 64 sequence numbers and never shifts the whole bitmap.
+ *
+ * One word is always "in flight" (partially above top), so the usable
+ * window is (WORDS - 1) * 64 sequence numbers behind the highest one seen.
+ *
+ * Sequence numbers start at 1; 0 is never valid.
+ */
+class ReplayWindow
+{
+public:
+    static constexpr uint32_t WORDS = 64;                 // 4096-bit ring
+    static constexpr uint64_t WINDOW_SIZE = (WORDS - 1) * 64; // 4032 usable
+
+    ReplayWindow() { reset(); }
+
+    void reset()
+    {
+        memset(bitmap_, 0, sizeof(bitmap_));
+        top_ = 0;
+    }
+
+    /**
+     * @brief Returns true if seq has not been seen and is inside the window.
+     *
+     * Does not modify state; pair with update() once the packet is accepted.
+     */
+    inline bool check(uint64_t seq) const
+    {
+        if (seq == 0)
+            return false;
+        if (seq > top_)
+            return true;
+        if (top_ - seq >= WINDOW_SIZE)
+            return false;
+        return !(bitmap_[(seq >> 6) & (WORDS - 1)] & (1ULL << (seq & 63)));
+    }
+
+    /**
+     * @brief Marks seq as received, sliding the window forward if needed.
+     */
+    inline void update(uint64_t seq)
+    {
+        if (seq > top_)
+        {
+            uint64_t cur_word = top_ >> 6;
+            uint64_t diff = (seq >> 6) - cur_word;
+            if (diff > WORDS)
+                diff = WORDS;
+            for (uint64_t i = 1; i <= diff; i++)
+                bitmap_[(cur_word + i) & (WORDS - 1)] = 0;
+            top_ = seq;
+        }
+        bitmap_[(seq >> 6) & (WORDS - 1)] |= (1ULL << (seq & 63));
+    }
+
+    /**
+     * @brief check() + update() in one call. Returns false for duplicates
+     *        and for packets that fell behind the window.
+     */
+    inline bool accept(uint64_t seq)
+    {
+        if (!check(seq))
+            return false;
+        update(seq);
+        return true;
+    }
+
+    uint64_t top() const { return top_; }
+
+private:
+    uint64_t bitmap_[WORDS];
+    uint64_t top_; ///< Highest sequence number accepted so far
+};
+
+#endif // REPLAYWINDOW_H
@@ -0,0 +1,997 @@
+#include "DataPlane.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "compress/Lz4Codec.h"
+#include "crypto/DiffieHellman.h"
+#include "net/socket/SocketManager.h"
+#include "protocol/Fec.h"
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+#include "utils/PacketCapture.h"
+#include "utils/profiling.h"
+#include "utils/Trace.h"
+
+// Accepts the optional features a client asked for in its HELLO trailer.
+static HandshakeExt negotiateFeatures(const HandshakeExt &req)
+{
+    HandshakeExt ext{};
+    if (req.caps & CAP_FEC)
+    {
+        uint8_t data = req.fec_data;
+        uint8_t parity = req.fec_parity;
+        if (fecNegotiate(data, parity))
+        {
+            ext.caps |= CAP_FEC;
+            ext.fec_data = data;
+            ext.fec_parity = parity;
+        }
+    }
+    if (req.caps & CAP_COMPRESS)
+        ext.caps |= CAP_COMPRESS;
+    if (req.caps & CAP_PMTU)
+        ext.caps |= CAP_PMTU;
+    return ext;
+}
+
+// Copies what the scrape endpoint shows about a client
+static ClientMetrics clientMetricsOf(const Client &c)
+{
+    ClientMetrics m{};
+    m.session_id = c.session_id;
+    m.vpn_ip = c.android_client_tun_ip;
+    m.udp_ip = c.client_udp_addr.sin_addr.s_addr;
+    m.udp_port = c.client_udp_addr.sin_port;
+    m.path_mtu = c.pmtu.pathMtu();
+    m.rx_pkts = c.traffic.rx_pkts;
+    m.rx_bytes = c.traffic.rx_bytes;
+    m.tx_pkts = c.traffic.tx_pkts;
+    m.tx_bytes = c.traffic.tx_bytes;
+    m.drops = c.traffic.drops;
+    m.rx_seq_top = c.rx_replay.top();
+    m.last_seen = c.last_seen;
+    m.last_roam = c.traffic.last_roam;
+    return m;
+}
+
+static int createUdpSocketOrThrow(uint16_t port)
+{
+    int sock = SocketManager::createUdpSocket(port);
+    if (sock < 0)
+        throw std::runtime_error("Failed to create UDP socket");
+    return sock;
+}
+
+// Repairs are built in TX slots
+static_assert(sizeof(FecRepairHeader) + FEC_MAX_PAYLOAD <= PacketPool::DATA_SIZE,
+              "FEC repair does not fit a packet buffer");
+
+static long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Pins the calling thread; returns the CPU or -1
+static int pinThread(int cpu)
+{
+    if (cpu < 0)
+        return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+    {
+        LOG(LOG_WARN, "Pinning data loop to CPU %d: %s", cpu, strerror(err));
+        return -1;
+    }
+    LOG(LOG_INFO, "Data loop pinned to CPU %d", cpu);
+    return cpu;
+}
+
+DataPlane::DataPlane(PacketDevice &dev, const DataPlaneConfig &cfg)
+    : cfg_(cfg),
+      tun_(dev.fd()),
+      sock_(createUdpSocketOrThrow(cfg.udp_port)),
+      cm_(cfg.max_clients, cfg.first_client_ip),
+      enc_(XorCipher::getInstance()),
+      cpu_(pinThread(cfg.cpu)),
+      pool_(cfg.pool_buffers),
+      cache_(pool_),
+      tx_(sock_, TX_BATCH_MIN, TX_BATCH_MAX, cfg.batch_latency_us * 1000L, cfg.tx_queue_len,
+          cache_),
+      rx_sizer_(RX_BATCH_MIN, RX_BATCH_MAX)
+{
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        close(sock_);
+        throw std::runtime_error("eventfd() failed");
+    }
+    fcntl(sock_, F_SETFL, O_NONBLOCK);
+    fcntl(tun_, F_SETFL, O_NONBLOCK);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+        close(wake_fd_);
+        close(sock_);
+        throw std::runtime_error("epoll_create1() failed");
+    }
+    for (int fd : {sock_, tun_, wake_fd_})
+    {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (cfg.so_busy_poll_us > 0)
+        SocketManager::enableBusyPoll(sock_, cfg.so_busy_poll_us);
+
+    // Buffers this loop holds on to; each swap hands one back, so the count never changes
+    for (int i = 0; i < RX_BATCH_MAX; i++)
+        rx_bufs_[i] = cache_.alloc();
+    tun_buf_ = cache_.alloc();
+    inflate_buf_ = cache_.alloc();
+    if (tun_buf_ == PKT_NONE || inflate_buf_ == PKT_NONE ||
+        std::find(rx_bufs_, rx_bufs_ + RX_BATCH_MAX, PKT_NONE) != rx_bufs_ + RX_BATCH_MAX)
+    {
+        close(epoll_fd_);
+        close(wake_fd_);
+        close(sock_);
+        throw std::runtime_error("Packet pool too small");
+    }
+
+    memset(probe_buf_, 0, sizeof(probe_buf_));
+    memset(rx_msgs_, 0, sizeof(rx_msgs_));
+    memset(rx_addrs_, 0, sizeof(rx_addrs_));
+    for (int i = 0; i < RX_BATCH_MAX; i++)
+    {
+        rx_iovecs_[i].iov_base = pool_.data(rx_bufs_[i]);
+        rx_iovecs_[i].iov_len = PacketPool::DATA_SIZE;
+
+        rx_msgs_[i].msg_hdr.msg_iov = &rx_iovecs_[i];
+        rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+        rx_msgs_[i].msg_hdr.msg_control = nullptr;
+        rx_msgs_[i].msg_hdr.msg_controllen = 0;
+
+        rx_msgs_[i].msg_hdr.msg_name = &rx_addrs_[i];
+        rx_msgs_[i].msg_hdr.msg_namelen = sizeof(rx_addrs_[i]);
+    }
+
+    LOG(LOG_INFO, "Server started, socket fd %d, %s fd %d", sock_, dev.name(), tun_);
+}
+
+DataPlane::~DataPlane()
+{
+    for (int i = 0; i < RX_BATCH_MAX; i++)
+        cache_.free(rx_bufs_[i]);
+    cache_.free(tun_buf_);
+    cache_.free(inflate_buf_);
+    for (int i = 0; i < ctrl_len_; i++)
+        cache_.free(ctrl_q_[(ctrl_head_ + i) % CTRL_QUEUE].h);
+    close(epoll_fd_);
+    close(wake_fd_);
+    close(sock_);
+}
+
+void DataPlane::stop()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t w = write(wake_fd_, &one, sizeof(one));
+    (void)w; // counter saturating is fine: run() is already waking up
+}
+
+// Encrypts one IPv4 packet for `target` and queues it on the TX batch,
+// followed by FEC repairs when it completes a group. Used by the TUN read
+// loop and by client-to-client hairpinning.
+// `pkt` lies in pool buffer `h` with at least sizeof(DataHeader) bytes in
+// front of it. Uncompressed packets are encrypted in place and `h` goes to
+// the TX batch as it is, in exchange for the slot's spare buffer.
+void DataPlane::sendToClient(Client *target, unsigned char *pkt, int n, PktHandle &h)
+{
+    // SYN / SYN-ACK towards the client: keep inner segments under the path MTU
+    if (clampTcpMss(pkt, n, target->pmtu.tcpMss()))
+        STAT_ADD(mss_clamped, 1);
+
+    DataHeader hdr;
+    hdr.hdr.type = PKT_DATA;
+    hdr.hdr.session_id = htonl(target->session_id); // Send the actual ID
+    hdr.seq = htobe64(++target->tx_seq);
+
+    // Optional compression, only when it actually shrinks the packet; the
+    // LZ4 block goes straight into the next TX slot
+    unsigned char *out = nullptr;
+    int payload_len = n;
+    if ((target->features.caps & CAP_COMPRESS) &&
+        Lz4Codec::looksCompressible(pkt, n))
+    {
+        unsigned char *slot = tx_.slot();
+        PROFILE_SCOPE_START(comp_t0);
+        TRACE_START(comp_tr);
+        int clen = Lz4Codec::compress(pkt, n, slot + sizeof(hdr), tx_.bufSize() - sizeof(hdr));
+        TRACE_END(comp_tr, TS_COMPRESS, target->session_id, n);
+        PROFILE_SCOPE_END(comp_t0, compress_cycles);
+        if (clen > 0)
+        {
+            STAT_ADD(compress_in_bytes, n);
+            STAT_ADD(compress_out_bytes, clen);
+            hdr.hdr.type = PKT_DATA_LZ4;
+            out = slot;
+            payload_len = clen;
+        }
+        else
+        {
+            STAT_ADD(compress_skipped, 1);
+        }
+    }
+    else if (target->features.caps & CAP_COMPRESS)
+    {
+        STAT_ADD(compress_skipped, 1);
+    }
+    bool in_place = out == nullptr;
+    if (in_place)
+        out = pkt - sizeof(hdr);
+
+    memcpy(out, &hdr, sizeof(hdr));
+    PROFILE_SCOPE_START(enc_t0);
+    TRACE_START(enc_tr);
+    enc_.crypt((char *)out + sizeof(hdr), payload_len, (char *)out + sizeof(hdr), target->xor_key);
+    TRACE_END(enc_tr, TS_ENCRYPT, target->session_id, payload_len);
+    PROFILE_SCOPE_END(enc_t0, enc_cycles);
+
+    bool fec_group_done = target->fec_tx &&
+        target->fec_tx->add(target->tx_seq, hdr.hdr.type, out + sizeof(hdr), payload_len);
+
+    // client addr ip+port
+    if (in_place)
+        h = tx_.commitBuffer(h, out, sizeof(hdr) + payload_len, target->client_udp_addr);
+    else
+        tx_.commit(sizeof(hdr) + payload_len, target->client_udp_addr);
+    target->traffic.tx_pkts++;
+    target->traffic.tx_bytes += sizeof(hdr) + payload_len;
+
+    if (fec_group_done)
+    {
+        for (int j = 0; j < target->fec_tx->parityCount(); j++)
+        {
+            unsigned char *rep = tx_.slot();
+            int rep_len = target->fec_tx->buildRepair(j, hdr.hdr.session_id, rep);
+            tx_.commit(rep_len, target->client_udp_addr);
+            STAT_ADD(fec_repair_tx, 1);
+        }
+    }
+}
+
+// Decrypts one data payload from `client` and writes the IP packet to TUN.
+// `type` is PKT_DATA or PKT_DATA_LZ4.
+// Packets addressed to another VPN client are re-encrypted and queued on
+// the TX batch directly instead of taking a round trip through the kernel.
+// The payload lies in pool buffer `h` behind its DataHeader and is
+// decrypted in place.
+void DataPlane::deliverToTun(Client *client, uint8_t type, char *enc_payload, int enc_len,
+                             PktHandle &h)
+{
+    // Decrypt payload
+    PROFILE_SCOPE_START(dec_t0);
+    TRACE_START(dec_tr);
+    enc_.crypt(enc_payload, enc_len, enc_payload, client->xor_key);
+    TRACE_END(dec_tr, TS_DECRYPT, client->session_id, enc_len);
+    PROFILE_SCOPE_END(dec_t0, dec_cycles);
+
+    char *pkt = enc_payload;
+    int pkt_len = enc_len;
+    PktHandle *owner = &h;
+    if (type == PKT_DATA_LZ4)
+    {
+        PROFILE_SCOPE_START(decomp_t0);
+        TRACE_START(decomp_tr);
+        pkt_len = Lz4Codec::decompress((uint8_t *)enc_payload, enc_len,
+                                       pool_.data(inflate_buf_), PacketPool::DATA_SIZE);
+        TRACE_END(decomp_tr, TS_DECOMPRESS, client->session_id, enc_len);
+        PROFILE_SCOPE_END(decomp_t0, decompress_cycles);
+        if (pkt_len < 0)
+        {
+            STAT_ADD(decompress_errors, 1);
+            client->traffic.drops++;
+            return;
+        }
+        STAT_ADD(decompress_pkts, 1);
+        pkt = (char *)pool_.data(inflate_buf_);
+        owner = &inflate_buf_;
+    }
+
+    // Client's SYN: make the remote end send segments that fit the path back
+    if (clampTcpMss((uint8_t *)pkt, pkt_len, client->pmtu.tcpMss()))
+        STAT_ADD(mss_clamped, 1);
+
+    // Basic sanity: ensure we have at least IPv4 header size in decrypted packet
+    if (pkt_len < 20)
+    {
+        LOG_RATELIMITED(LOG_WARN, "Decrypted packet too small (%d bytes) - skipping", pkt_len);
+        client->traffic.drops++;
+        return;
+    }
+
+    // Everything a client sent, whether it goes to TUN or another client
+    CAPTURE_TUN(CAP_IN, pkt, pkt_len);
+
+    // ---- Hairpin: client -> client ----
+    // Only packets that fit a TX buffer (as from drainTun) and the peer's
+    // path; anything bigger goes through the kernel, which fragments it
+    // or answers with ICMP
+    in_addr dst_a;
+    memcpy(&dst_a.s_addr, pkt + 16, 4);
+    uint32_t dst_host = ntohl(dst_a.s_addr);
+    if (pkt_len <= PacketPool::DATA_SIZE - TX_HEADROOM && cm_.isIpInStateActive(dst_host))
+    {
+        Client *peer = cm_.getClientByServerIp(dst_host);
+        if (peer && pkt_len + PMTU_TUNNEL_OVERHEAD <= peer->pmtu.pathMtu())
+        {
+            sendToClient(peer, (unsigned char *)pkt, pkt_len, *owner);
+            STAT_ADD(hairpin_pkts, 1);
+            return;
+        }
+    }
+    PROFILE_SCOPE_START(tun_wr_t0);
+    TRACE_START(tun_wr_tr);
+    ssize_t write_count = write(tun_, pkt, pkt_len);
+    TRACE_END(tun_wr_tr, TS_TUN_WRITE, client->session_id, pkt_len);
+    PROFILE_SCOPE_END(tun_wr_t0, tun_write_cycles);
+
+    if (write_count < 0)
+    {
+        LOG_RATELIMITED(LOG_ERROR, "Failed to write to TUN: %s", strerror(errno));
+        STAT_ADD(tun_rx_drops, 1);
+        client->traffic.drops++;
+        return;
+    }
+    STAT_ADD(tun_tx_pkts, 1);
+    STAT_ADD(tun_tx_bytes, write_count);
+    PROFILE_SCOPE_END(rx_batch_tsc_, udp_to_tun_cycles);
+}
+
+void DataPlane::handleUdpToTun(unsigned char *buf, int n, const sockaddr_in &client_addr,
+                               uint32_t session_id, PktHandle &h)
+{
+    Client *client;
+    bool roamed = false;
+    PROFILE_SCOPE_START(lookup_t0);
+    TRACE_START(lookup_tr);
+    client = cm_.getClientByUdp(client_addr);
+    TRACE_END(lookup_tr, TS_LOOKUP, client ? client->session_id : 0, n);
+    PROFILE_SCOPE_END(lookup_t0, lookup_cycles);
+    if (!client)
+    {
+        session_id = ntohl(session_id);
+        HOT_LOG(LOG_DEBUG, "Session ID in packet: %u", session_id);
+        // 1. Try Roaming: Lookup by the Session ID inside the packet
+        client = cm_.getClientBySessionId(session_id);
+
+        if (!client)
+        {
+            LOG_RATELIMITED(LOG_WARN, "Unauthorized packet from %s", inet_ntoa(client_addr.sin_addr));
+            return;
+        }
+        roamed = true;
+    }
+
+    // Anti-replay: reject duplicates and stale packets before any decrypt work.
+    // Must run before the roaming update so a replayed datagram from another
+    // address cannot steal the client's endpoint.
+    uint64_t seq = be64toh(((DataHeader *)buf)->seq);
+    if (!client->rx_replay.accept(seq))
+    {
+        STAT_ADD(replay_drops, 1);
+        client->traffic.drops++;
+        return;
+    }
+    client->traffic.rx_pkts++;
+    client->traffic.rx_bytes += n;
+
+    if (roamed)
+    {
+        // 2. Found them! Update the port/IP for future packets
+        cm_.updateClientEndpoint(client->session_id, client_addr);
+    }
+    // Touch last_seen so the client doesn't get swept
+    client->last_seen = time(nullptr);
+
+    // Encrypted payload starts AFTER header
+    int enc_len = n - sizeof(DataHeader);
+    char *enc_payload = (char *)(buf + sizeof(DataHeader));
+
+    uint8_t type = ((PacketHeader *)buf)->type;
+
+    // Keep a copy for the FEC group before the payload is consumed
+    if (client->fec_rx)
+        client->fec_rx->onData(seq, type, (uint8_t *)enc_payload, enc_len);
+
+    deliverToTun(client, type, enc_payload, enc_len, h);
+}
+
+void DataPlane::handleFecRepair(unsigned char *buf, int n, const sockaddr_in &client_addr,
+                                PktHandle &h)
+{
+    PacketHeader *hdr = (PacketHeader *)buf;
+    TRACE_START(fec_tr);
+
+    // Repairs never move a client's endpoint; only data packets roam.
+    Client *client = cm_.getClientByUdp(client_addr);
+    if (!client)
+        client = cm_.getClientBySessionId(ntohl(hdr->session_id));
+    if (!client || !client->fec_rx)
+    {
+        STAT_ADD(udp_rx_drops, 1);
+        return;
+    }
+    STAT_ADD(fec_repair_rx, 1);
+
+    FecDecoder::Recovered rec;
+    bool recovered = client->fec_rx->onRepair(buf, n, rec);
+    TRACE_END(fec_tr, TS_FEC_REPAIR, client->session_id, n);
+    if (!recovered)
+        return;
+    if (rec.type != PKT_DATA && rec.type != PKT_DATA_LZ4)
+        return;
+    // The original may still show up later; the replay window then drops it
+    if (!client->rx_replay.accept(rec.seq))
+        return;
+
+    if (rec.len > PacketPool::DATA_SIZE - (int)sizeof(DataHeader))
+        return;
+
+    STAT_ADD(fec_recovered, 1);
+    client->traffic.rx_pkts++;
+    client->traffic.rx_bytes += sizeof(DataHeader) + rec.len;
+    client->last_seen = time(nullptr);
+    // The repair datagram is consumed; its buffer takes the recovered
+    // payload where a data packet's would be (the decoder's copy is const)
+    char *payload = (char *)pool_.data(h) + sizeof(DataHeader);
+    memcpy(payload, rec.payload, rec.len);
+    deliverToTun(client, rec.type, payload, rec.len, h);
+}
+
+// Sends the next PMTU probe for `client`, if its search wants one now.
+void DataPlane::sendPmtuProbe(Client &client, time_t now)
+{
+    uint16_t probe_id;
+    int size = client.pmtu.nextProbe(now, probe_id);
+    if (size <= 0)
+        return;
+
+    PmtuProbePacket probe{};
+    probe.hdr.type = PKT_PMTU_PROBE;
+    probe.hdr.session_id = htonl(client.session_id);
+    probe.probe_size = htons((uint16_t)size);
+    probe.probe_id = htons(probe_id);
+    memcpy(probe_buf_, &probe, sizeof(probe)); // rest stays zero padding
+
+    if (SocketManager::sendWithDf(sock_, probe_buf_, size, client.client_udp_addr) < 0)
+    {
+        if (errno == EMSGSIZE)
+            client.pmtu.onLocalTooBig(now); // our own interface MTU is smaller
+        return;
+    }
+    CAPTURE_UDP(CAP_OUT, probe_buf_, size, client.client_udp_addr);
+    STAT_ADD(pmtu_probes_tx, 1);
+}
+
+void DataPlane::handleHandshake(PacketHeader *hdr, int n, unsigned char *buf,
+                                const sockaddr_in &client_addr)
+{
+    // Placeholder for handshake handling logic
+    if (hdr->type == PKT_HELLO)
+    {
+        if (n < (int)sizeof(HelloPacket))
+        {
+            LOG_RATELIMITED(LOG_WARN, "Short HelloPacket packet");
+            return;
+        }
+
+        HelloPacket *hello = (HelloPacket *)buf;
+        // Older clients send no trailer and get a plain WELCOME back
+        bool has_ext = n >= (int)sizeof(HelloPacketExt);
+        HandshakeExt ext{};
+        if (has_ext)
+            ext = negotiateFeatures(((HelloPacketExt *)buf)->ext);
+
+        uint32_t nextAvailableIp = cm_.getNextAvailableIp();
+        uint32_t session_id=cm_.generateSessionId();
+        if (nextAvailableIp == 0)
+        {
+            LOG_RATELIMITED(LOG_ERROR, "No available IPs to assign to new client");
+            return;
+        }
+
+        uint32_t assigned_ip = nextAvailableIp;
+
+        WelcomePacket welcome{};
+        welcome.hdr.type = PKT_WELCOME;
+        welcome.hdr.session_id = htonl(session_id); // Add this!;
+        welcome.assigned_tun_ip = htonl(assigned_ip);
+        long long random_b = randomNumGen(1000, 5000);
+        welcome.ys = htonl(modexp(G, random_b, P)); // server's public value
+        // Create SessionState for this client
+        sessions_.addSession(
+            client_addr,
+            hello->client_magic,
+            assigned_ip,
+            ntohl(hello->yc),
+            random_b,session_id, ext);
+
+        WelcomePacketExt welcome_ext{};
+        welcome_ext.welcome = welcome;
+        welcome_ext.ext = ext;
+        int welcome_len = has_ext ? sizeof(welcome_ext) : sizeof(welcome);
+        sendto(sock_,
+               (char *)&welcome_ext,
+               welcome_len,
+               0,
+               (struct sockaddr *)&client_addr,
+               sizeof(client_addr));
+        CAPTURE_UDP(CAP_OUT, &welcome_ext, welcome_len, client_addr);
+        char client_ip_str[INET_ADDRSTRLEN];
+        char assigned_ip_str[INET_ADDRSTRLEN];
+
+        // Use inet_ntop to avoid the static buffer overlap bug of inet_ntoa
+        struct in_addr net_addr;
+        net_addr.s_addr = welcome.assigned_tun_ip;
+
+        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip_str, INET_ADDRSTRLEN);
+        inet_ntop(AF_INET, &net_addr, assigned_ip_str, INET_ADDRSTRLEN);
+
+        LOG_RATELIMITED(LOG_INFO, "Handshake: Client %s -> Assigned Virtual IP %s , Session ID %u, caps 0x%02x",
+            client_ip_str,
+            assigned_ip_str, session_id, ext.caps);
+    }
+    else if (hdr->type == PKT_CLIENT_ACK)
+    {
+        if (n < (int)sizeof(ClientAckPacket))
+        {
+            LOG_RATELIMITED(LOG_WARN, "Short ClientAckPacket packet");
+            STAT_ADD(handshake_failures, 1);
+            return;
+        }
+
+        // check if session exists, etc.
+        SessionState *session = sessions_.getSession(client_addr);
+        if (session == nullptr)
+        {
+            LOG_RATELIMITED(LOG_WARN, "No session found for Client ACK from %s",
+                inet_ntoa(client_addr.sin_addr));
+            STAT_ADD(handshake_failures, 1);
+            return;
+        }
+        uint32_t shared_secret = modexp(session->yc, session->b, P);
+        uint8_t xor_key = calculateXORKey(shared_secret);
+
+        // Add client to ClientManager
+        cm_.addClient(client_addr, session->assigned_tun_ip, xor_key, session->session_id,
+                      session->ext);
+        // Delete session state as handshake is complete
+        sessions_.eraseSession(client_addr);
+    }
+
+    else if (hdr->type == PKT_BYE)
+    {
+        if (n < (int)sizeof(PacketHeader))
+        {
+            LOG_RATELIMITED(LOG_WARN, "Short BYE packet");
+            return;
+        }
+
+        uint32_t session_id = ntohl(hdr->session_id);
+        if (cm_.removeClientBySessionId(session_id))
+        {
+            LOG_RATELIMITED(LOG_INFO, "[BYE] Received disconnect from %s for session %u",
+                inet_ntoa(client_addr.sin_addr), session_id);
+        }
+    }
+    else if (hdr->type == PKT_PMTU_ACK)
+    {
+        if (n < (int)sizeof(PmtuAckPacket))
+            return;
+
+        PmtuAckPacket *ack = (PmtuAckPacket *)buf;
+        Client *client = cm_.getClientBySessionId(ntohl(hdr->session_id));
+        if (!client)
+            return;
+
+        STAT_ADD(pmtu_acks_rx, 1);
+        if (client->pmtu.onAck(ntohs(ack->probe_size), ntohs(ack->probe_id), time(nullptr)))
+        {
+            LOG(LOG_INFO, "[PMTU] Session %u: path MTU %u, inner TCP MSS %u",
+                client->session_id, client->pmtu.pathMtu(), client->pmtu.tcpMss());
+        }
+    }
+    else if (hdr->type == PKT_KEEPALIVE)
+    {
+        if (n < (int)sizeof(PacketHeader))
+            return;
+
+        uint32_t session_id = ntohl(hdr->session_id);
+        cm_.touchClient(session_id);
+        // No response needed — just updates last_seen
+    }
+    else
+    {
+        LOG_RATELIMITED(LOG_WARN, "Unknown packet type: %d", hdr->type);
+        STAT_ADD(handshake_failures, 1);
+        return;
+    }
+}
+
+// Once-a-second housekeeping: expiry, sweeps, PMTU probes, client metrics
+void DataPlane::tick(time_t now)
+{
+    sessions_.eraseExpiredSessions(cfg_.handshake_timeout_s);
+
+    // Sweep clients that haven't sent data/keepalive
+    int swept = cm_.sweepDeadClients(cfg_.client_dead_timeout_s);
+    if (swept > 0)
+    {
+        LOG(LOG_INFO, "[SWEEP] Removed %d dead client(s)", swept);
+    }
+
+    cm_.forEachClient([&](Client &c) { sendPmtuProbe(c, now); });
+
+    client_rows_.clear();
+    top_talkers_.reset();
+    cm_.forEachClient([&](Client &c) {
+        if (board_)
+            client_rows_.push_back(clientMetricsOf(c));
+
+        TopTalkers::Entry e{};
+        c.traffic.takeInterval(e.pkts, e.bytes);
+        e.session_id = c.session_id;
+        e.vpn_ip = c.android_client_tun_ip;
+        top_talkers_.offer(e);
+    });
+    if (board_)
+        board_->tryPublish(client_rows_);
+    top_talkers_.log(now - last_top_);
+    last_top_ = now;
+}
+
+int DataPlane::drainUdp(int budget, int &data_pkts)
+{
+    const long cap_ns = cfg_.batch_latency_us * 1000L;
+    int total = 0;
+    int ctrl = 0;
+    while (total < budget)
+    {
+        // Hairpinned and deferred packets may have swapped buffers
+        int want = std::min(rx_sizer_.limit(), budget - total);
+        for (int i = 0; i < want; i++)
+            rx_iovecs_[i].iov_base = pool_.data(rx_bufs_[i]);
+
+        PROFILE_SCOPE_START(rx_syscall_t0);
+        TRACE_START(rx_syscall_tr);
+        int rcvd = recvmmsg(sock_, rx_msgs_, want, 0, nullptr);
+        TRACE_END(rx_syscall_tr, TS_UDP_RECV, 0, rcvd > 0 ? rcvd : 0);
+        PROFILE_SCOPE_END(rx_syscall_t0, rx_syscall_cycles);
+
+        if (rcvd > 0)
+        {
+            total += rcvd;
+            STAT_ADD(udp_rx_batches, 1);
+            STAT_ADD(udp_rx_batch_limit, want);
+            long batch_t0 = cap_ns ? nowNs() : 0;
+            PROFILE_SCOPE_START(rx_batch_t0);
+#if ENABLE_PROFILING
+            rx_batch_tsc_ = rx_batch_t0;
+#endif
+            for (int i = 0; i < rcvd; i++)
+            {
+                TRACE_START(pkt_tr);
+                int n = rx_msgs_[i].msg_len;
+                STAT_ADD(udp_rx_pkts, 1);
+                unsigned char *buf = pool_.data(rx_bufs_[i]);
+                const sockaddr_in &client_addr = rx_addrs_[i];
+                CAPTURE_UDP(CAP_IN, buf, n, client_addr);
+                if (n < (int)sizeof(PacketHeader))
+                {
+                    STAT_ADD(udp_rx_drops, 1);
+                    LOG_RATELIMITED(LOG_WARN, "Received too short packet (%d bytes) from %s",
+                        n, inet_ntoa(client_addr.sin_addr));
+                    continue;
+                }
+
+                PacketHeader *hdr = (PacketHeader *)buf;
+                if (hdr->type == PKT_FEC_REPAIR)
+                {
+                    handleFecRepair(buf, n, client_addr, rx_bufs_[i]);
+                    STAT_ADD(udp_rx_bytes, n);
+                }
+                else if (hdr->type == PKT_DATA || hdr->type == PKT_DATA_LZ4)
+                {
+                    if (n < (int)sizeof(DataHeader))
+                    {
+                        STAT_ADD(udp_rx_drops, 1);
+                        continue;
+                    }
+                    handleUdpToTun(buf, n, client_addr, hdr->session_id, rx_bufs_[i]);
+                    STAT_ADD(udp_rx_bytes, n);
+                }
+                else if (hdr->type == PKT_HELLO)
+                {
+                    // New sessions (IP + DH state) wait until after the
+                    // data, within their own budget
+                    deferControl(i, n);
+                    ctrl++;
+                }
+                else
+                {
+                    // CLIENT_ACK, BYE, keepalives and PMTU acks stay in
+                    // order with the data from the same client
+                    TRACE_START(hs_tr);
+                    handleHandshake(hdr, n, buf, client_addr);
+                    TRACE_END(hs_tr, TS_HANDSHAKE, ntohl(hdr->session_id), n);
+                    STAT_ADD(handshake_pkts, 1);
+                }
+                TRACE_END(pkt_tr, TS_UDP_PKT, ntohl(hdr->session_id), n);
+            }
+            PROFILE_SCOPE_END(rx_batch_t0, rx_userspace_cycles);
+            // Hairpinned client-to-client packets
+            tx_.flush();
+
+            // A batch that kept the loop busy past the cap holds up the
+            // TUN side and hairpinned packets: ask for fewer next time.
+            // Batches cut short by the budget say nothing about the load.
+            if (cap_ns && nowNs() - batch_t0 > cap_ns)
+                rx_sizer_.tooSlow();
+            else if (want == rx_sizer_.limit())
+                rx_sizer_.onBatch(rcvd);
+        }
+        else
+        {
+            STAT_ADD(udp_recv_eagain, 1);
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+            {
+                break; // No more data to read
+            }
+            LOG_RATELIMITED(LOG_ERROR, "recvmmsg: %s", strerror(errno));
+            break;
+        }
+        // If kernel returned fewer than batch, socket is drained
+        if (rcvd < want)
+            break;
+    }
+    data_pkts = total - ctrl;
+    return total;
+}
+
+int DataPlane::drainTun(int budget)
+{
+    int total = 0;
+    while (total < budget)
+    {
+        // The socket can't keep up: leave packets in the device queue
+        if (tx_.congested())
+        {
+            STAT_ADD(tun_rx_throttled, 1);
+            break;
+        }
+
+        // Headroom in front takes the DataHeader; see sendToClient()
+        unsigned char *pkt = pool_.data(tun_buf_);
+        PROFILE_SCOPE_START(tun_rd_t0);
+        TRACE_START(tun_rd_tr);
+        int n = read(tun_, pkt, PacketPool::DATA_SIZE - TX_HEADROOM);
+        TRACE_END(tun_rd_tr, TS_TUN_READ, 0, n > 0 ? n : 0);
+        PROFILE_SCOPE_END(tun_rd_t0, tun_read_cycles);
+        if (n < 0)
+        {
+            STAT_ADD(tun_read_eagain, 1);
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            LOG_RATELIMITED(LOG_ERROR, "read tun: %s", strerror(errno));
+            break;
+        }
+
+        if (n == 0)
+            break;
+        total++;
+        STAT_ADD(tun_rx_pkts, 1);
+        STAT_ADD(tun_rx_bytes, n);
+        CAPTURE_TUN(CAP_OUT, pkt, n);
+
+        TRACE_START(tun_pkt_tr);
+        in_addr dst_a;
+        memcpy(&dst_a.s_addr, pkt + 16, 4);
+        uint32_t dst_host = ntohl(dst_a.s_addr);
+
+        Client *target = cm_.getClientByServerIp(dst_host);
+        if (!target)
+            continue;
+
+        sendToClient(target, pkt, n, tun_buf_);
+        TRACE_END(tun_pkt_tr, TS_TUN_PKT, target->session_id, n);
+    }
+    tx_.flush();
+    return total;
+}
+
+// Moves HELLO i of the current receive batch to the control queue; its
+// receive slot gets a fresh buffer
+void DataPlane::deferControl(int i, int n)
+{
+    PktHandle spare = ctrl_len_ < CTRL_QUEUE ? cache_.alloc() : PKT_NONE;
+    if (spare == PKT_NONE)
+    {
+        LOG_RATELIMITED(LOG_WARN, "Control queue full, dropping HELLO from %s",
+            inet_ntoa(rx_addrs_[i].sin_addr));
+        STAT_ADD(ctrl_drops, 1);
+        return;
+    }
+    CtrlPkt &c = ctrl_q_[(ctrl_head_ + ctrl_len_) % CTRL_QUEUE];
+    c.h = rx_bufs_[i];
+    c.len = n;
+    c.addr = rx_addrs_[i];
+    ctrl_len_++;
+    rx_bufs_[i] = spare;
+}
+
+// Handles up to `budget` queued HELLOs, oldest first
+int DataPlane::runControl(int budget)
+{
+    int done = 0;
+    while (ctrl_len_ > 0 && done < budget)
+    {
+        CtrlPkt &c = ctrl_q_[ctrl_head_];
+        unsigned char *buf = pool_.data(c.h);
+        PacketHeader *hdr = (PacketHeader *)buf;
+
+        TRACE_START(hs_tr);
+        handleHandshake(hdr, c.len, buf, c.addr);
+        TRACE_END(hs_tr, TS_HANDSHAKE, ntohl(hdr->session_id), c.len);
+        STAT_ADD(handshake_pkts, 1);
+
+        cache_.free(c.h);
+        ctrl_head_ = (ctrl_head_ + 1) % CTRL_QUEUE;
+        ctrl_len_--;
+        done++;
+    }
+    return done;
+}
+
+// Asks for EPOLLOUT while datagrams wait for socket buffer space and
+// takes the device out of the epoll set while the TX queue is congested
+void DataPlane::watchTxQueue()
+{
+    bool want_out = tx_.queued() > 0;
+    if (want_out != sock_out_)
+    {
+        struct epoll_event ev{};
+        ev.events = want_out ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.fd = sock_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, sock_, &ev);
+        sock_out_ = want_out;
+    }
+
+    bool pause = tx_.congested();
+    if (pause != tun_paused_)
+    {
+        struct epoll_event ev{};
+        ev.events = pause ? 0u : (uint32_t)EPOLLIN;
+        ev.data.fd = tun_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, tun_, &ev);
+        tun_paused_ = pause;
+    }
+}
+
+void DataPlane::run()
+{
+    const long spin_ns = cfg_.spin_idle_us * 1000L;
+    last_tick_ = time(nullptr);
+    last_top_ = last_tick_;
+    long t = nowNs();
+    long last_pkt = t;
+    bool more = false; ///< Last turn ran out of budget somewhere
+    while (!stop_.load(std::memory_order_relaxed))
+    {
+        // Periodically erase expired sessions
+        time_t now = time(nullptr);
+        if (now != last_tick_)
+        {
+            last_tick_ = now;
+            tick(now);
+            long t1 = nowNs();
+            STAT_ADD(loop_work_ns, t1 - t);
+            t = t1;
+        }
+
+        if (spin_ns > 0 && t - last_pkt < spin_ns)
+        {
+            // Busy poll: no wakeup between a packet arriving and being read
+            if (tx_.queued() > 0)
+                tx_.drainQueue();
+            int data = 0;
+            int n = drainUdp(cfg_.udp_budget, data);
+            int tun = drainTun(cfg_.tun_budget);
+            n += tun + runControl(data + tun > 0 ? cfg_.ctrl_budget : CTRL_QUEUE);
+            long t1 = nowNs();
+            if (n > 0)
+            {
+                STAT_ADD(loop_work_ns, t1 - t);
+                last_pkt = t1;
+            }
+            else
+            {
+                STAT_ADD(loop_poll_ns, t1 - t);
+            }
+            t = t1;
+            continue;
+        }
+
+        // Wake up at least once a second so sweeps and PMTU probes run when
+        // idle, and don't sleep at all while a budget left work behind
+        watchTxQueue();
+        struct epoll_event evs[3];
+        int ret = epoll_wait(epoll_fd_, evs, 3, more ? 0 : 1000);
+        long t1 = nowNs();
+        STAT_ADD(loop_wait_ns, t1 - t);
+        t = t1;
+        if (ret < 0)
+        {
+            if (errno != EINTR)
+                perror("epoll_wait");
+            continue;
+        }
+        if (ret == 0 && ctrl_len_ == 0)
+        {
+            more = false;
+            continue;
+        }
+
+        bool udp_ready = false, udp_writable = false, tun_ready = false;
+        for (int i = 0; i < ret; i++)
+        {
+            if (evs[i].data.fd == sock_)
+            {
+                udp_ready = evs[i].events & EPOLLIN;
+                udp_writable = evs[i].events & EPOLLOUT;
+            }
+            tun_ready |= evs[i].data.fd == tun_;
+        }
+        if (udp_writable)
+            tx_.drainQueue();
+
+        // One turn: each direction up to its budget, then queued HELLOs
+        // (all of them when there was no data to compete with)
+        more = false;
+        int data = 0;
+        if (udp_ready)
+            more |= drainUdp(cfg_.udp_budget, data) >= cfg_.udp_budget;
+        if (tun_ready)
+        {
+            int tun = drainTun(cfg_.tun_budget);
+            more |= tun >= cfg_.tun_budget;
+            data += tun;
+        }
+        runControl(data > 0 ? cfg_.ctrl_budget : CTRL_QUEUE);
+        more |= ctrl_len_ > 0;
+
+        t1 = nowNs();
+        STAT_ADD(loop_work_ns, t1 - t);
+        t = t1;
+        last_pkt = t;
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef DATAPLANE_H
+#define DATAPLANE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include "crypto/XorCipher.h"
+#include "net/buffer/PacketPool.h"
+#include "net/socket/BatchSizer.h"
+#include "net/socket/TxBatch.h"
+#include "net/tun/PacketDevice.h"
+#include "protocol/Handshake.h"
+#include "protocol/PathMtu.h"
+#include "sessions/client/Client_Manager.h"
+#include "sessions/client/TopTalkers.h"
+#include "sessions/session/ClientSession.h"
+#include "utils/MetricsHttp.h"
+#include "utils/profiling.h"
+
+struct DataPlaneConfig
+{
+    uint16_t udp_port = 5555;
+    int max_clients = 100;
+    const char *first_client_ip = "10.8.0.2";
+    int handshake_timeout_s = 10;   ///< Unfinished handshakes are dropped after this
+    int client_dead_timeout_s = 60; ///< Clients with no data/keepalive are swept after this
+    uint32_t pool_buffers = 1024;   ///< Packet buffers; 1024 x 2 KB is one 2 MB huge page
+    int batch_latency_us = 50;      ///< Cap on holding packets to fill a batch; 0 = none
+    int spin_idle_us = 0;           ///< Busy poll until this long without packets; 0 = always block
+    int so_busy_poll_us = 0;        ///< SO_BUSY_POLL on the UDP socket; 0 = off
+    int cpu = -1;                   ///< Pin the loop (and the pool's memory) to this CPU; -1 = don't
+    int tx_queue_len = 256;         ///< Datagrams held while the socket buffer is full; 0 = drop
+    int udp_budget = 256;           ///< UDP->TUN packets per loop turn
+    int tun_budget = 256;           ///< TUN->UDP packets per loop turn
+    int ctrl_budget = 16;           ///< HELLOs (new handshakes) handled per loop turn
+};
+
+/**
+ * @brief The server's packet loop: UDP socket <-> PacketDevice.
+ *
+ * Owns the UDP socket, the handshake and client tables and the packet
+ * buffer pool; the device is borrowed. run() loops on the calling
+ * thread until stop(), so main() runs it over the real TUN and the
+ * benchmarks run it in-process over a FakeTunDevice. Construct it on
+ * that thread too: the pool is placed on the constructing thread's NUMA
+ * node.
+ *
+ * Packets stay in the pool buffer they were received into: datagrams are
+ * decrypted in place and written to the TUN from there, TUN reads are
+ * encrypted in place with the DataHeader prepended in the headroom, and
+ * the buffer itself is queued on the TX batch (see TxBatch::commitBuffer).
+ *
+ * RX and TX batch sizes adapt to load (see BatchSizer) between
+ * *_BATCH_MIN and *_BATCH_MAX, with storage for the maximum allocated up
+ * front. batch_latency_us bounds what batching costs light traffic: a
+ * TX batch is sent once its first datagram has waited that long, and an
+ * RX batch whose processing took longer shrinks the next one.
+ *
+ * By default run() blocks in epoll_wait() until the socket or device is
+ * readable. With spin_idle_us set it busy polls instead: non-blocking
+ * recvmmsg() and device reads back to back, dropping to epoll_wait()
+ * only after spin_idle_us without a packet, so an arriving packet does
+ * not pay for a wakeup. That costs a whole core; pin it with `cpu`.
+ * loop_work_ns / loop_poll_ns / loop_wait_ns split the loop's time into
+ * handling packets, polling empty queues and blocking.
+ *
+ * Datagrams that don't fit in the socket's send buffer wait in the TX
+ * batch's queue (tx_queue_len) and go out when the socket polls
+ * writable. While that queue cannot take another batch the device is
+ * not read, so the backlog stays in its queue and the senders behind the
+ * tunnel slow down instead of losing packets to us.
+ *
+ * Each loop turn serves both directions in turn, each up to its budget
+ * (udp_budget / tun_budget packets), so a heavy upload cannot starve the
+ * download or the other way round. HELLOs, which allocate an address
+ * and DH state, are set aside from each receive batch into a bounded
+ * queue and handled after the data, at most ctrl_budget per turn while
+ * data is flowing (all of them on turns without data): a handshake burst
+ * delays other handshakes, not data, and when the queue is full further
+ * HELLOs are dropped for their senders to retry. Other control packets
+ * (CLIENT_ACK, BYE, keepalives, PMTU acks) are handled inline, so they
+ * keep their order with the same client's data. The loop does not block
+ * while any of this has work left.
+ */
+class DataPlane
+{
+public:
+    /// Binds the UDP port; throws std::runtime_error on failure.
+    explicit DataPlane(PacketDevice &dev, const DataPlaneConfig &cfg = DataPlaneConfig());
+    ~DataPlane();
+
+    DataPlane(const DataPlane &) = delete;
+    DataPlane &operator=(const DataPlane &) = delete;
+
+    /// Per-client rows for the scrape endpoint, published once a second.
+    void setMetricsBoard(ClientMetricsBoard *board) { board_ = board; }
+
+    /// Forwards packets until stop() is called.
+    void run();
+
+    /// Makes run() return. Async-signal-safe and callable from any thread.
+    void stop();
+
+    int udpSocket() const { return sock_; }
+
+private:
+    static constexpr int RX_BATCH_MIN = 8;
+    static constexpr int RX_BATCH_MAX = 64;
+    static constexpr int TX_BATCH_MIN = 4;
+    static constexpr int TX_BATCH_MAX = 64;
+    static constexpr int CTRL_QUEUE = 256;
+    // Room left in each TX buffer for our own headers (DataHeader / FecRepairHeader)
+    static constexpr int TX_HEADROOM = 64;
+
+    void tick(time_t now);
+    /// Both read at most `budget` packets and return how many they read;
+    /// `data_pkts` is the part that was not a deferred HELLO
+    int drainUdp(int budget, int &data_pkts);
+    int drainTun(int budget);
+    void deferControl(int i, int n);
+    int runControl(int budget);
+    void watchTxQueue();
+
+    // `h` is the pool buffer holding the packet; these may swap it for another
+    void sendToClient(Client *target, unsigned char *pkt, int n, PktHandle &h);
+    void deliverToTun(Client *client, uint8_t type, char *enc_payload, int enc_len,
+                      PktHandle &h);
+    void handleUdpToTun(unsigned char *buf, int n, const sockaddr_in &client_addr,
+                        uint32_t session_id, PktHandle &h);
+    void handleFecRepair(unsigned char *buf, int n, const sockaddr_in &client_addr,
+                         PktHandle &h);
+    void handleHandshake(PacketHeader *hdr, int n, unsigned char *buf,
+                         const sockaddr_in &client_addr);
+    void sendPmtuProbe(Client &client, time_t now);
+
+    DataPlaneConfig cfg_;
+    int tun_;
+    int sock_ = -1;
+    int wake_fd_ = -1; ///< eventfd written by stop()
+    int epoll_fd_ = -1;
+    bool sock_out_ = false;   ///< EPOLLOUT requested on sock_
+    bool tun_paused_ = false; ///< tun_ taken out of the epoll set
+    std::atomic<bool> stop_{false};
+
+    ClientSession sessions_;
+    ClientManager cm_;
+    XorCipher &enc_;
+    int cpu_; ///< Pinned CPU or -1; set before the pool is placed
+    PacketPool pool_;
+    PacketPool::Cache cache_;
+    TxBatch tx_;
+    BatchSizer rx_sizer_;
+
+    ClientMetricsBoard *board_ = nullptr;
+    std::vector<ClientMetrics> client_rows_;
+    TopTalkers top_talkers_;
+    time_t last_tick_ = 0;
+    time_t last_top_ = 0;
+
+#if ENABLE_PROFILING
+    // When the current recvmmsg() batch returned; start of udp_to_tun_cycles
+    uint64_t rx_batch_tsc_ = 0;
+#endif
+
+    // Per-batch storage
+    struct mmsghdr rx_msgs_[RX_BATCH_MAX];
+    struct iovec rx_iovecs_[RX_BATCH_MAX];
+    struct sockaddr_in rx_addrs_[RX_BATCH_MAX];
+    PktHandle rx_bufs_[RX_BATCH_MAX];
+
+    /// A HELLO waiting for runControl(), in its receive buffer
+    struct CtrlPkt
+    {
+        PktHandle h;
+        int len;
+        sockaddr_in addr;
+    };
+    CtrlPkt ctrl_q_[CTRL_QUEUE]; ///< Ring: ctrl_len_ entries from ctrl_head_
+    int ctrl_head_ = 0;
+    int ctrl_len_ = 0;
+
+    PktHandle tun_buf_ = PKT_NONE;
+    PktHandle inflate_buf_ = PKT_NONE; ///< LZ4 output
+    unsigned char probe_buf_[PMTU_MAX];
+};
+
+#endif // DATAPLANE_H
@@ -18,7 +18,8 @@ ClientManager::~ClientManager()
     LOG(LOG_INFO, "[+] ClientManager destroyed, cleaning up %zu clients", vpn_to_client.size());
 }
 
-Client *ClientManager::addClient(const sockaddr_in &clientUdpAddr, uint32_t androidTunIp, uint8_t &xor_key, uint32_t session_id)
+Client *ClientManager::addClient(const sockaddr_in &clientUdpAddr, uint32_t androidTunIp, uint8_t &xor_key, uint32_t session_id,
+                                 const HandshakeExt &features)
 {
 
     bool ipisActive = isIpInStateActive(androidTunIp);
@@ -34,9 +35,17 @@ Client *ClientManager::addClient(const sockaddr_in &clientUdpAddr, uint32_t andr
     newClient.xor_key = xor_key;
     newClient.session_id = session_id;
     newClient.last_seen = time(nullptr);
+    newClient.features = features;
+    if (features.caps & CAP_FEC)
+    {
+        newClient.fec_tx = std::make_unique<FecEncoder>(features.fec_data, features.fec_parity);
+        newClient.fec_rx = std::make_unique<FecDecoder>(features.fec_data, features.fec_parity);
+    }
+    if (features.caps & CAP_PMTU)
+        newClient.pmtu.enable(newClient.last_seen);
 
     makeIpInUse(androidTunIp); // ← THIS is where IP becomes ACTIVE
-    auto [it, inserted] = vpn_to_client.emplace(androidTunIp, newClient);
+    auto [it, inserted] = vpn_to_client.emplace(androidTunIp, std::move(newClient));
 
     if (!inserted)
     {
@@ -44,7 +53,7 @@ Client *ClientManager::addClient(const sockaddr_in &clientUdpAddr, uint32_t andr
         freeIp(androidTunIp); // Rollback IP usage
         return nullptr;
     }
-    session_to_vpn_ip[newClient.session_id] = androidTunIp;
+    session_to_vpn_ip[session_id] = androidTunIp;
     uint64_t packedAddr = packAddr(clientUdpAddr);
     udp_to_vpn_ip[packedAddr] = androidTunIp;
     return &it->second;
@@ -180,6 +189,10 @@ void ClientManager::updateClientEndpoint(uint32_t session_id, const sockaddr_in
             newIp, ntohs(newAddr.sin_port));
 
         client->client_udp_addr = newAddr;
+        client->traffic.last_roam = time(nullptr);
+        // A new network means a new path; what was learned about the old one no longer holds
+        if (client->features.caps & CAP_PMTU)
+            client->pmtu.enable(client->traffic.last_roam);
         // Update the UDP address mapping
         udp_to_vpn_ip.erase(oldPackedAddr);
         uint64_t newPackedAddr = packAddr(newAddr);
@@ -188,13 +201,13 @@ void ClientManager::updateClientEndpoint(uint32_t session_id, const sockaddr_in
     }
 }
 
-void ClientManager::removeClientBySessionId(uint32_t session_id)
+bool ClientManager::removeClientBySessionId(uint32_t session_id)
 {
     auto it = session_to_vpn_ip.find(session_id);
     if (it == session_to_vpn_ip.end())
     {
-        LOG(LOG_WARN, "[BYE] No client found for session %u", session_id);
-        return;
+        LOG_RATELIMITED(LOG_WARN, "[BYE] No client found for session %u", session_id);
+        return false;
     }
 
     uint32_t vpn_ip = it->second;
@@ -208,6 +221,7 @@ void ClientManager::removeClientBySessionId(uint32_t session_id)
 
     // freeIp handles all map cleanup (vpn_to_client, udp_to_vpn_ip, session_to_vpn_ip, ipPool)
     freeIp(vpn_ip);
+    return true;
 }
 
 void ClientManager::touchClient(uint32_t session_id)
@@ -5,6 +5,42 @@
 #include <vector>
 #include <ctime>
 #include <arpa/inet.h>
+#include <memory>
+#include "protocol/ReplayWindow.h"
+#include "protocol/Fec.h"
+#include "protocol/PathMtu.h"
+
+/**
+ * @brief Per-client traffic accounting.
+ *
+ * Written only by the data thread, read by it once per tick. Kept on
+ * its own cache line so per-packet updates touch one line and nothing
+ * else in Client. Byte counts are UDP payload bytes on the wire.
+ */
+struct alignas(64) ClientTraffic
+{
+    uint64_t rx_pkts = 0;  ///< Data packets accepted from the client
+    uint64_t rx_bytes = 0;
+    uint64_t tx_pkts = 0;  ///< Data packets queued towards the client
+    uint64_t tx_bytes = 0;
+    uint64_t drops = 0;    ///< Replays, bad payloads, failed TUN writes
+    time_t last_roam = 0;  ///< Last endpoint change (0 = never)
+
+    // Totals at the previous takeInterval() call
+    uint64_t mark_pkts = 0;
+    uint64_t mark_bytes = 0;
+
+    /// RX + TX since the previous call.
+    void takeInterval(uint64_t &pkts, uint64_t &bytes)
+    {
+        uint64_t p = rx_pkts + tx_pkts;
+        uint64_t b = rx_bytes + tx_bytes;
+        pkts = p - mark_pkts;
+        bytes = b - mark_bytes;
+        mark_pkts = p;
+        mark_bytes = b;
+    }
+};
 
 /**
  * @brief Represents a connected VPN client.
@@ -24,6 +60,13 @@ struct Client
     uint8_t xor_key;                ///< Simple XOR key for this client
     uint32_t session_id;            ///< Persistent ID for roaming support
     time_t last_seen;               ///< Last time we got any packet from this client
+    uint64_t tx_seq = 0;            ///< Last sequence number sent to this client
+    ReplayWindow rx_replay;         ///< Sequence numbers already received from this client
+    HandshakeExt features{};        ///< Optional features negotiated in the handshake
+    std::unique_ptr<FecEncoder> fec_tx; ///< Set when CAP_FEC was negotiated
+    std::unique_ptr<FecDecoder> fec_rx; ///< Set when CAP_FEC was negotiated
+    PmtuDiscovery pmtu;             ///< Path MTU towards client_udp_addr, MSS clamp value
+    ClientTraffic traffic;          ///< Packet / byte counters
 };
 
 enum IpState
@@ -125,6 +168,7 @@ public:
      * @param androidTunIp      Client’s TUN IP (fixed - ex: 10.8.0.2)
      * @param xor_key           XOR key for encrypting/decrypting this client
      * @param session_id        Persistent session ID for roaming support
+     * @param features          Optional features accepted in the handshake
      * Steps:
      *   1. Finds free IP from ipPool
      *   2. Creates Client struct
@@ -135,7 +179,8 @@ public:
      * @return uint32_t The server-assigned VPN IP
      *                   (0 if pool exhausted)
      */
-    Client *addClient(const sockaddr_in &clientUdpAddr, uint32_t androidTunIp, uint8_t &xor_key, uint32_t session_id);
+    Client *addClient(const sockaddr_in &clientUdpAddr, uint32_t androidTunIp, uint8_t &xor_key, uint32_t session_id,
+                      const HandshakeExt &features = HandshakeExt{});
     /**
      * @brief Removes a client using its server-assigned VPN IP.
      *
@@ -178,10 +223,22 @@ public:
     uint32_t generateSessionId();
 
     // Disconnect & Heartbeat
-    void removeClientBySessionId(uint32_t session_id);
+    bool removeClientBySessionId(uint32_t session_id);  // false if no such client
     void touchClient(uint32_t session_id);              // update last_seen
     int  sweepDeadClients(time_t timeout_sec);           // returns count removed
 
+    /**
+     * @brief Calls fn(Client &) for every connected client.
+     *
+     * For periodic maintenance only; fn must not add or remove clients.
+     */
+    template <typename Fn>
+    void forEachClient(Fn &&fn)
+    {
+        for (auto &[vpn_ip, client] : vpn_to_client)
+            fn(client);
+    }
+
     // helper function to pack sockaddr_in to uint64_t for map key
     inline uint64_t packAddr(const sockaddr_in &addr)
     {
@@ -0,0 +1,53 @@
+#include "TopTalkers.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include "utils/logger.h"
+
+static bool busier(const TopTalkers::Entry &a, const TopTalkers::Entry &b)
+{
+    return a.bytes > b.bytes;
+}
+
+void TopTalkers::offer(const Entry &e)
+{
+    if (e.bytes == 0)
+        return;
+
+    if (n_ < K)
+    {
+        heap_[n_++] = e;
+        std::push_heap(heap_.begin(), heap_.begin() + n_, busier);
+        return;
+    }
+    // heap_[0] is the smallest of the current top K
+    if (e.bytes <= heap_[0].bytes)
+        return;
+    std::pop_heap(heap_.begin(), heap_.begin() + n_, busier);
+    heap_[n_ - 1] = e;
+    std::push_heap(heap_.begin(), heap_.begin() + n_, busier);
+}
+
+void TopTalkers::log(long seconds)
+{
+    if (n_ == 0)
+        return;
+    if (seconds <= 0)
+        seconds = 1;
+
+    // Sorting a min-heap with a "greater" comparator yields busiest first
+    std::sort_heap(heap_.begin(), heap_.begin() + n_, busier);
+
+    LOG(LOG_INFO, "---- Top talkers (last %ld sec) ----", seconds);
+    for (int i = 0; i < n_; i++)
+    {
+        const Entry &e = heap_[i];
+        in_addr a{htonl(e.vpn_ip)};
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &a, ip, sizeof(ip));
+        LOG(LOG_INFO, "#%d session %u (%s): %.2f Mbps, %lu pkts",
+            i + 1, e.session_id, ip,
+            (double)e.bytes * 8.0 / ((double)seconds * 1000000.0), e.pkts);
+    }
+    n_ = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef TOPTALKERS_H
+#define TOPTALKERS_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Picks the K busiest clients of one stats interval.
+ *
+ * Each tick the data thread offers every client's exact byte delta
+ * (ClientTraffic::takeInterval). A fixed K-entry min-heap keeps the
+ * largest ones, so a pass is O(clients * log K) with no allocation.
+ *
+ * Exact counts are used rather than a space-saving / count-min sketch:
+ * the client table is bounded by the IP pool and already holds a counter
+ * per client, so there is nothing to approximate.
+ */
+class TopTalkers
+{
+public:
+    static constexpr int K = 5;
+
+    struct Entry
+    {
+        uint64_t bytes;
+        uint64_t pkts;
+        uint32_t session_id;
+        uint32_t vpn_ip; ///< Host order
+    };
+
+    /// Starts a new interval.
+    void reset() { n_ = 0; }
+
+    /// Considers one client; entries with no traffic are ignored.
+    void offer(const Entry &e);
+
+    /// Logs the current top entries, busiest first. Silent when idle.
+    void log(long seconds);
+
+private:
+    std::array<Entry, K> heap_; ///< Min-heap on bytes, first n_ valid
+    int n_ = 0;
+};
+
+#endif // TOPTALKERS_H
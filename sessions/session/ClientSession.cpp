@@ -14,7 +14,8 @@ void ClientSession::addSession(const sockaddr_in& addr,
                                uint32_t client_magic,
                                uint32_t assigned_tun_ip,
                                uint32_t yc,
-                               uint32_t b,uint32_t session_id) {
+                               uint32_t b,uint32_t session_id,
+                               const HandshakeExt& ext) {
     SessionState s{};
     s.client_udp_addr = addr;
     s.client_magic = client_magic;
@@ -23,6 +24,7 @@ void ClientSession::addSession(const sockaddr_in& addr,
     s.session_id = session_id;
     s.yc = yc;
     s.b = b;
+    s.ext = ext;
     sessions_.push_back(s);
 }
 
@@ -4,6 +4,7 @@
 #include <vector>
 #include <netinet/in.h>
 #include <ctime>
+#include "protocol/Handshake.h"
 
 
 /*
@@ -19,6 +20,7 @@ struct SessionState
     uint32_t yc;        // client's public value for Diffie-Hellman
     uint32_t b;      // server private key ✅
     uint32_t session_id; // Persistent session ID for roaming support
+    HandshakeExt ext;    // Features accepted for this session (zero = none)
 };
 #pragma pack(pop)
 
@@ -32,7 +34,8 @@ public:
                     uint32_t assigned_tun_ip,
                     uint32_t yc,
                     uint32_t b,
-                    uint32_t session_id);
+                    uint32_t session_id,
+                    const HandshakeExt &ext);
 
     void eraseSession(const sockaddr_in& addr);
     void eraseExpiredSessions(time_t timeout_sec);
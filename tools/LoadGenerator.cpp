@@ -0,0 +1,746 @@
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "compress/Lz4Codec.h"
+#include "crypto/DiffieHellman.h"
+#include "crypto/XorCipher.h"
+#include "protocol/Ipv4.h"
+#include "protocol/Handshake.h"
+#include "protocol/PathMtu.h"
+
+static constexpr int SOCK_BUF_BYTES = 4 * 1024 * 1024;
+static constexpr int MIN_PKT = 40;   // IPv4 + ICMP + our echo stamp
+static constexpr int MAX_PKT = 1400;
+static constexpr uint32_t ECHO_MAGIC = 0x4C47454E; // "LGEN"
+static constexpr uint64_t CATCHUP_NS = 100000000;  // a stall longer than this skips sends
+static constexpr int TXQ_WAIT_MS = 10;              // one wait for socket space before dropping
+
+#pragma pack(push, 1)
+struct EchoStamp
+{
+    uint32_t magic;
+    uint32_t client;
+    uint64_t tx_ns;
+};
+#pragma pack(pop)
+
+LoadGenConfig::LoadGenConfig()
+{
+    server.sin_family = AF_INET;
+    server.sin_port = htons(5555);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+LoadGenStats LoadGenStats::operator-(const LoadGenStats &e) const
+{
+    LoadGenStats d;
+    d.hello_tx = hello_tx - e.hello_tx;
+    d.handshakes = handshakes - e.handshakes;
+    d.handshake_timeouts = handshake_timeouts - e.handshake_timeouts;
+    d.handshake_failures = handshake_failures - e.handshake_failures;
+    d.data_tx = data_tx - e.data_tx;
+    d.data_tx_bytes = data_tx_bytes - e.data_tx_bytes;
+    d.raw_tx = raw_tx - e.raw_tx;
+    d.raw_tx_bytes = raw_tx_bytes - e.raw_tx_bytes;
+    d.tx_drops = tx_drops - e.tx_drops;
+    d.echo_rx = echo_rx - e.echo_rx;
+    d.rx_bytes = rx_bytes - e.rx_bytes;
+    d.rx_other = rx_other - e.rx_other;
+    d.rx_bad = rx_bad - e.rx_bad;
+    d.keepalive_tx = keepalive_tx - e.keepalive_tx;
+    d.pmtu_acks = pmtu_acks - e.pmtu_acks;
+    d.roams = roams - e.roams;
+    d.rtt_ns = rtt_ns - e.rtt_ns;
+    d.handshake_ns = handshake_ns - e.handshake_ns;
+    return d;
+}
+
+static uint16_t inetChecksum(const uint8_t *p, int len)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i + 1 < len; i += 2)
+        sum += (uint32_t)((p[i] << 8) | p[i + 1]);
+    if (len & 1)
+        sum += (uint32_t)(p[len - 1] << 8);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+uint64_t LoadGenerator::nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+LoadGenerator::LoadGenerator(const LoadGenConfig &cfg)
+    : cfg_(cfg), rng_(cfg.seed)
+{
+    if (cfg_.clients <= 0 || cfg_.sockets <= 0 || cfg_.sockets > 255)
+        throw std::runtime_error("loadgen: need clients > 0 and 1..255 sockets");
+    if ((uint64_t)cfg_.src_base + (uint64_t)cfg_.clients > 0xFFFFFFFFULL)
+        throw std::runtime_error("loadgen: source address range overflows");
+    if (cfg_.sizes.empty() || cfg_.rates.empty())
+        throw std::runtime_error("loadgen: empty size or rate mix");
+
+    for (LoadSizeClass &s : cfg_.sizes)
+    {
+        s.size = std::min(std::max(s.size, MIN_PKT), MAX_PKT);
+        size_weight_total_ += std::max(s.weight, 0);
+    }
+    int rate_weight_total = 0;
+    for (const LoadRateClass &r : cfg_.rates)
+        rate_weight_total += std::max(r.weight, 0);
+    if (size_weight_total_ <= 0 || rate_weight_total <= 0)
+        throw std::runtime_error("loadgen: mix weights must be positive");
+
+    for (int i = 0; i < cfg_.sockets; i++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("loadgen: socket: ") + strerror(errno));
+        socks_.push_back(fd);
+
+        int one = 1;
+        int buf = SOCK_BUF_BYTES;
+        setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+
+        sockaddr_in any{};
+        any.sin_family = AF_INET;
+        any.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, (sockaddr *)&any, sizeof(any)) < 0)
+            throw std::runtime_error(std::string("loadgen: bind: ") + strerror(errno));
+    }
+
+    // Fixed per-slot wiring; only lengths and source addresses change per packet
+    txq_.resize(socks_.size());
+    for (TxQueue &q : txq_)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            q.iov[i].iov_base = q.bufs[i];
+            msghdr &h = q.msgs[i].msg_hdr;
+            memset(&h, 0, sizeof(h));
+            h.msg_name = &cfg_.server;
+            h.msg_namelen = sizeof(cfg_.server);
+            h.msg_iov = &q.iov[i];
+            h.msg_iovlen = 1;
+            h.msg_control = q.ctrl[i];
+            h.msg_controllen = sizeof(q.ctrl[i]);
+            cmsghdr *cm = CMSG_FIRSTHDR(&h);
+            cm->cmsg_level = IPPROTO_IP;
+            cm->cmsg_type = IP_PKTINFO;
+            cm->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+        }
+    }
+    for (int i = 0; i < BATCH; i++)
+    {
+        rx_iov_[i].iov_base = rx_bufs_[i];
+        rx_iov_[i].iov_len = BUF_SIZE;
+        msghdr &h = rx_msgs_[i].msg_hdr;
+        memset(&h, 0, sizeof(h));
+        h.msg_iov = &rx_iov_[i];
+        h.msg_iovlen = 1;
+    }
+
+    // Rate classes are per client, drawn once
+    std::uniform_int_distribution<int> pick_rate(0, rate_weight_total - 1);
+    std::uniform_int_distribution<int> pick_sock(0, cfg_.sockets - 1);
+    clients_.resize(cfg_.clients);
+    pending_hello_.reserve(cfg_.clients);
+    for (int i = 0; i < cfg_.clients; i++)
+    {
+        Client &c = clients_[i];
+        c.src_ip = htonl(cfg_.src_base + (uint32_t)i);
+        c.sock = (uint8_t)pick_sock(rng_);
+        int w = pick_rate(rng_);
+        for (const LoadRateClass &r : cfg_.rates)
+        {
+            w -= std::max(r.weight, 0);
+            if (w < 0)
+            {
+                c.interval_ns = r.pps > 0 ? (uint64_t)(1e9 / r.pps) : 0;
+                break;
+            }
+        }
+        pending_hello_.push_back((uint32_t)i);
+    }
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for (int fd : socks_)
+        close(fd);
+}
+
+uint64_t LoadGenerator::lost() const
+{
+    return stats_.data_tx > stats_.echo_rx ? stats_.data_tx - stats_.echo_rx : 0;
+}
+
+void LoadGenerator::runFor(uint64_t ns)
+{
+    step(nowNs() + ns, true);
+}
+
+void LoadGenerator::drain(uint64_t ns)
+{
+    step(nowNs() + ns, false);
+}
+
+void LoadGenerator::disconnect()
+{
+    for (Client &c : clients_)
+    {
+        if (c.state != UP)
+            continue;
+        sendHeader(c, PKT_BYE);
+        c.state = IDLE;
+        c.due_ns = UINT64_MAX;
+    }
+    flushAll();
+    connected_ = 0;
+}
+
+void LoadGenerator::step(uint64_t until_ns, bool sending)
+{
+    std::vector<pollfd> pfds(socks_.size());
+    for (size_t i = 0; i < socks_.size(); i++)
+        pfds[i] = pollfd{socks_[i], POLLIN, 0};
+
+    while (true)
+    {
+        uint64_t now = nowNs();
+        if (now >= until_ns)
+            break;
+
+        uint64_t wake = until_ns;
+        if (sending)
+        {
+            startHandshakes(now);
+            while (!timers_.empty() && timers_.top().first <= now)
+            {
+                Timer t = timers_.top();
+                timers_.pop();
+                if (clients_[t.second].due_ns == t.first)
+                    service(t.second, now);
+            }
+            flushAll();
+
+            if (!timers_.empty())
+                wake = std::min(wake, timers_.top().first);
+            if (hello_head_ < pending_hello_.size() && cfg_.handshake_rate > 0)
+                wake = std::min(wake, now + (uint64_t)(1e9 / cfg_.handshake_rate));
+        }
+
+        now = nowNs();
+        uint64_t wait_ns = wake > now ? wake - now : 0;
+        struct timespec ts{(time_t)(wait_ns / 1000000000ULL), (long)(wait_ns % 1000000000ULL)};
+        int ready = ppoll(pfds.data(), pfds.size(), &ts, nullptr);
+        if (ready <= 0)
+            continue;
+        for (size_t i = 0; i < pfds.size(); i++)
+            if (pfds[i].revents & POLLIN)
+                receive(socks_[i]);
+        // CLIENT_ACKs and PMTU acks queued by the receive path
+        flushAll();
+    }
+}
+
+void LoadGenerator::startHandshakes(uint64_t now)
+{
+    if (hello_head_ >= pending_hello_.size())
+    {
+        hello_last_ns_ = now;
+        return;
+    }
+    // Token bucket with ~10 ms of burst, so HELLOs still leave in batches
+    double burst = std::max(1.0, cfg_.handshake_rate / 100.0);
+    if (hello_last_ns_ == 0)
+        hello_tokens_ = burst;
+    else
+        hello_tokens_ += (double)(now - hello_last_ns_) * cfg_.handshake_rate / 1e9;
+    hello_tokens_ = std::min(hello_tokens_, burst);
+    hello_last_ns_ = now;
+
+    while (hello_tokens_ >= 1.0 && hello_head_ < pending_hello_.size())
+    {
+        sendHello(pending_hello_[hello_head_++], now);
+        hello_tokens_ -= 1.0;
+    }
+    if (hello_head_ == pending_hello_.size())
+    {
+        pending_hello_.clear();
+        hello_head_ = 0;
+    }
+}
+
+uint64_t LoadGenerator::nextDue(const Client &c) const
+{
+    if (c.state == HELLO_SENT)
+        return c.hello_ns + (uint64_t)cfg_.handshake_timeout_ms * 1000000ULL;
+    if (c.state != UP)
+        return UINT64_MAX;
+    uint64_t due = UINT64_MAX;
+    if (c.interval_ns)
+        due = std::min(due, c.next_data_ns);
+    if (cfg_.keepalive_s > 0)
+        due = std::min(due, c.next_keepalive_ns);
+    if (cfg_.roam_s > 0)
+        due = std::min(due, c.next_roam_ns);
+    return due;
+}
+
+void LoadGenerator::schedule(uint32_t idx)
+{
+    Client &c = clients_[idx];
+    c.due_ns = nextDue(c);
+    if (c.due_ns != UINT64_MAX)
+        timers_.push(Timer(c.due_ns, idx));
+}
+
+void LoadGenerator::service(uint32_t idx, uint64_t now)
+{
+    Client &c = clients_[idx];
+    if (c.state == HELLO_SENT)
+    {
+        stats_.handshake_timeouts++;
+        if (c.tries <= cfg_.handshake_retries)
+        {
+            c.state = IDLE;
+            pending_hello_.push_back(idx);
+        }
+        else
+        {
+            c.state = FAILED;
+            stats_.handshake_failures++;
+        }
+        c.due_ns = UINT64_MAX;
+        return;
+    }
+    if (c.state != UP)
+        return;
+
+    if (c.interval_ns && c.next_data_ns <= now)
+    {
+        if (now - c.next_data_ns > CATCHUP_NS)
+            c.next_data_ns = now;
+        while (c.next_data_ns <= now)
+        {
+            sendEcho(idx, now);
+            c.next_data_ns += c.interval_ns;
+        }
+    }
+    if (cfg_.keepalive_s > 0 && c.next_keepalive_ns <= now)
+    {
+        sendHeader(c, PKT_KEEPALIVE);
+        c.next_keepalive_ns = now + (uint64_t)(cfg_.keepalive_s * 1e9);
+    }
+    if (cfg_.roam_s > 0 && c.next_roam_ns <= now)
+    {
+        // The server learns the new port from the next data packet
+        c.sock = (uint8_t)((c.sock + 1) % socks_.size());
+        stats_.roams++;
+        std::exponential_distribution<double> gap(1.0 / cfg_.roam_s);
+        c.next_roam_ns = now + (uint64_t)(gap(rng_) * 1e9) + 1;
+    }
+    schedule(idx);
+}
+
+unsigned char *LoadGenerator::slot(const Client &c)
+{
+    TxQueue &q = txq_[c.sock];
+    return q.bufs[q.n];
+}
+
+void LoadGenerator::commit(const Client &c, int len, TxKind kind)
+{
+    TxQueue &q = txq_[c.sock];
+    q.iov[q.n].iov_len = (size_t)len;
+    q.kind[q.n] = kind;
+    // ctrl[] starts with the IP_PKTINFO cmsg set up in the constructor
+    in_pktinfo pi{};
+    pi.ipi_spec_dst.s_addr = c.src_ip;
+    memcpy(CMSG_DATA((cmsghdr *)q.ctrl[q.n]), &pi, sizeof(pi));
+    if (++q.n == BATCH)
+        flush(c.sock);
+}
+
+void LoadGenerator::flush(int sock)
+{
+    TxQueue &q = txq_[sock];
+    int off = 0;
+    bool waited = false;
+    while (off < q.n)
+    {
+        int sent = sendmmsg(socks_[sock], q.msgs + off, (unsigned)(q.n - off), 0);
+        if (sent < 0)
+        {
+            if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == EINTR) && !waited)
+            {
+                pollfd pfd{socks_[sock], POLLOUT, 0};
+                ::poll(&pfd, 1, TXQ_WAIT_MS);
+                waited = true;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == EINTR)
+            {
+                stats_.tx_drops += (uint64_t)(q.n - off);
+                break;
+            }
+            // Anything else is about the first datagram; skip just that one
+            stats_.tx_drops++;
+            off++;
+            continue;
+        }
+        for (int i = off; i < off + sent; i++)
+        {
+            switch (q.kind[i])
+            {
+            case TX_HELLO:
+                stats_.hello_tx++;
+                break;
+            case TX_ECHO:
+                stats_.data_tx++;
+                stats_.data_tx_bytes += q.msgs[i].msg_len;
+                break;
+            case TX_KEEPALIVE:
+                stats_.keepalive_tx++;
+                break;
+            case TX_RAW:
+                stats_.raw_tx++;
+                stats_.raw_tx_bytes += q.msgs[i].msg_len;
+                break;
+            default:
+                break;
+            }
+        }
+        off += sent;
+        waited = false;
+    }
+    q.n = 0;
+}
+
+void LoadGenerator::flushAll()
+{
+    for (size_t i = 0; i < txq_.size(); i++)
+        if (txq_[i].n)
+            flush((int)i);
+}
+
+void LoadGenerator::sendHello(uint32_t idx, uint64_t now)
+{
+    Client &c = clients_[idx];
+    std::uniform_int_distribution<uint32_t> pick_a(1000, 5000);
+    c.a = pick_a(rng_);
+
+    HelloPacketExt hello{};
+    hello.hello.hdr.type = PKT_HELLO;
+    hello.hello.hdr.session_id = 0;
+    hello.hello.client_magic = rng_();
+    hello.hello.yc = htonl((uint32_t)modexp(G, c.a, P));
+    hello.ext.caps = cfg_.caps;
+    hello.ext.fec_data = cfg_.fec_data;
+    hello.ext.fec_parity = cfg_.fec_parity;
+    // No caps: the plain HELLO older clients send
+    int len = cfg_.caps ? (int)sizeof(hello) : (int)sizeof(HelloPacket);
+
+    memcpy(slot(c), &hello, len);
+    commit(c, len, TX_HELLO);
+    c.state = HELLO_SENT;
+    c.hello_ns = now;
+    c.tries++;
+    schedule(idx);
+}
+
+void LoadGenerator::sendHeader(const Client &c, uint8_t type)
+{
+    PacketHeader hdr{};
+    hdr.type = type;
+    hdr.session_id = c.session_id;
+    memcpy(slot(c), &hdr, sizeof(hdr));
+    commit(c, sizeof(hdr), type == PKT_KEEPALIVE ? TX_KEEPALIVE : TX_CONTROL);
+}
+
+int LoadGenerator::pickSize()
+{
+    if (cfg_.sizes.size() == 1)
+        return cfg_.sizes[0].size;
+    std::uniform_int_distribution<int> pick(0, size_weight_total_ - 1);
+    int w = pick(rng_);
+    for (const LoadSizeClass &s : cfg_.sizes)
+    {
+        w -= std::max(s.weight, 0);
+        if (w < 0)
+            return s.size;
+    }
+    return cfg_.sizes.back().size;
+}
+
+void LoadGenerator::sendEcho(uint32_t idx, uint64_t now)
+{
+    Client &c = clients_[idx];
+    int len = pickSize();
+
+    // IPv4 + ICMP echo request; the kernel behind the TUN checks both sums
+    uint8_t *ip = (uint8_t *)plain_;
+    memset(ip, 0, (size_t)len);
+    ip[0] = 0x45;
+    ip[2] = (uint8_t)(len >> 8);
+    ip[3] = (uint8_t)len;
+    ip[4] = (uint8_t)(c.icmp_seq >> 8);
+    ip[5] = (uint8_t)c.icmp_seq;
+    ip[8] = 64;
+    ip[9] = 1;
+    memcpy(ip + 12, &c.vpn_ip, 4);
+    uint32_t dst = htonl(cfg_.target_ip);
+    memcpy(ip + 16, &dst, 4);
+    uint16_t sum = inetChecksum(ip, 20);
+    ip[10] = (uint8_t)(sum >> 8);
+    ip[11] = (uint8_t)sum;
+
+    uint8_t *icmp = ip + 20;
+    icmp[0] = 8;
+    icmp[4] = (uint8_t)(idx >> 8);
+    icmp[5] = (uint8_t)idx;
+    icmp[6] = (uint8_t)(c.icmp_seq >> 8);
+    icmp[7] = (uint8_t)c.icmp_seq;
+    EchoStamp stamp{ECHO_MAGIC, idx, now};
+    memcpy(icmp + 8, &stamp, sizeof(stamp));
+    sum = inetChecksum(icmp, len - 20);
+    icmp[2] = (uint8_t)(sum >> 8);
+    icmp[3] = (uint8_t)sum;
+    c.icmp_seq++;
+
+    sendPlain(c, len, TX_ECHO);
+}
+
+bool LoadGenerator::sendPacket(int idx, const uint8_t *pkt, int len)
+{
+    if (idx < 0 || idx >= (int)clients_.size() || len < 20 ||
+        len > BUF_SIZE - (int)sizeof(DataHeader))
+        return false;
+    Client &c = clients_[idx];
+    if (c.state != UP)
+        return false;
+    memcpy(plain_, pkt, (size_t)len);
+    if (!rewriteIpv4Address((uint8_t *)plain_, len, IPV4_SRC, c.vpn_ip))
+        return false;
+    sendPlain(c, len, TX_RAW);
+    return true;
+}
+
+uint32_t LoadGenerator::vpnAddress(int idx) const
+{
+    if (idx < 0 || idx >= (int)clients_.size() || clients_[idx].state != UP)
+        return 0;
+    return clients_[idx].vpn_ip;
+}
+
+void LoadGenerator::poll()
+{
+    flushAll();
+    for (int fd : socks_)
+        receive(fd);
+    flushAll();
+}
+
+// Compresses (if negotiated), encrypts and queues the IPv4 packet in plain_
+void LoadGenerator::sendPlain(Client &c, int len, TxKind kind)
+{
+    DataHeader hdr;
+    hdr.hdr.type = PKT_DATA;
+    hdr.hdr.session_id = c.session_id;
+    hdr.seq = htobe64(++c.tx_seq);
+
+    const char *payload = plain_;
+    int payload_len = len;
+    if ((cfg_.caps & CAP_COMPRESS) &&
+        Lz4Codec::looksCompressible((uint8_t *)plain_, len))
+    {
+        int clen = Lz4Codec::compress((uint8_t *)plain_, len, inflate_, sizeof(inflate_));
+        if (clen > 0)
+        {
+            hdr.hdr.type = PKT_DATA_LZ4;
+            payload = (const char *)inflate_;
+            payload_len = clen;
+        }
+    }
+
+    unsigned char *out = slot(c);
+    memcpy(out, &hdr, sizeof(hdr));
+    XorCipher::getInstance().crypt(payload, payload_len, (char *)out + sizeof(hdr), c.key);
+    commit(c, (int)sizeof(hdr) + payload_len, kind);
+}
+
+void LoadGenerator::receive(int sock)
+{
+    while (true)
+    {
+        for (int i = 0; i < BATCH; i++)
+        {
+            rx_msgs_[i].msg_hdr.msg_control = rx_ctrl_[i];
+            rx_msgs_[i].msg_hdr.msg_controllen = sizeof(rx_ctrl_[i]);
+        }
+        int got = recvmmsg(sock, rx_msgs_, BATCH, MSG_DONTWAIT, nullptr);
+        if (got <= 0)
+            return;
+        uint64_t now = nowNs();
+        for (int i = 0; i < got; i++)
+        {
+            int n = (int)rx_msgs_[i].msg_len;
+            stats_.rx_bytes += (uint64_t)n;
+
+            // The reply's destination address is the client's own source address
+            uint32_t dst = 0;
+            msghdr &h = rx_msgs_[i].msg_hdr;
+            for (cmsghdr *cm = CMSG_FIRSTHDR(&h); cm; cm = CMSG_NXTHDR(&h, cm))
+                if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_PKTINFO)
+                    dst = ntohl(((in_pktinfo *)CMSG_DATA(cm))->ipi_addr.s_addr);
+            uint32_t idx = dst - cfg_.src_base;
+            if (dst == 0 || idx >= clients_.size() || n < (int)sizeof(PacketHeader))
+            {
+                stats_.rx_bad++;
+                continue;
+            }
+            onDatagram(idx, rx_bufs_[i], n, now);
+        }
+        if (got < BATCH)
+            return;
+    }
+}
+
+void LoadGenerator::onDatagram(uint32_t idx, unsigned char *buf, int n, uint64_t now)
+{
+    Client &c = clients_[idx];
+    switch (((PacketHeader *)buf)->type)
+    {
+    case PKT_WELCOME:
+        onWelcome(idx, buf, n, now);
+        break;
+    case PKT_DATA:
+    case PKT_DATA_LZ4:
+        if (c.state != UP || n < (int)sizeof(DataHeader))
+        {
+            stats_.rx_bad++;
+            break;
+        }
+        onData(c, idx, buf, n, now);
+        break;
+    case PKT_PMTU_PROBE:
+    {
+        if (c.state != UP || n < (int)sizeof(PmtuProbePacket))
+        {
+            stats_.rx_bad++;
+            break;
+        }
+        PmtuProbePacket *probe = (PmtuProbePacket *)buf;
+        PmtuAckPacket ack{};
+        ack.hdr.type = PKT_PMTU_ACK;
+        ack.hdr.session_id = c.session_id;
+        ack.probe_size = probe->probe_size;
+        ack.probe_id = probe->probe_id;
+        memcpy(slot(c), &ack, sizeof(ack));
+        commit(c, sizeof(ack), TX_CONTROL);
+        stats_.pmtu_acks++;
+        break;
+    }
+    default:
+        stats_.rx_other++;
+        break;
+    }
+}
+
+void LoadGenerator::onWelcome(uint32_t idx, unsigned char *buf, int n, uint64_t now)
+{
+    Client &c = clients_[idx];
+    if (c.state != HELLO_SENT || n < (int)sizeof(WelcomePacket))
+    {
+        stats_.rx_other++;
+        return;
+    }
+    WelcomePacket *welcome = (WelcomePacket *)buf;
+    c.session_id = welcome->hdr.session_id;
+    c.vpn_ip = welcome->assigned_tun_ip;
+    uint32_t secret = (uint32_t)modexp(ntohl(welcome->ys), c.a, P);
+    c.key = calculateXORKey(secret);
+    c.tx_seq = 0;
+    stats_.handshake_ns.counts[hist_index(now - c.hello_ns)]++;
+
+    ClientAckPacket ack{};
+    ack.hdr.type = PKT_CLIENT_ACK;
+    ack.hdr.session_id = c.session_id;
+    memcpy(slot(c), &ack, sizeof(ack));
+    commit(c, sizeof(ack), TX_CONTROL);
+
+    c.state = UP;
+    c.tries = 0;
+    connected_++;
+    stats_.handshakes++;
+
+    // Random phase, so clients that came up together do not send together
+    if (c.interval_ns)
+    {
+        std::uniform_int_distribution<uint64_t> phase(0, c.interval_ns);
+        c.next_data_ns = now + phase(rng_);
+    }
+    c.next_keepalive_ns = now + (uint64_t)(cfg_.keepalive_s * 1e9);
+    if (cfg_.roam_s > 0)
+    {
+        std::exponential_distribution<double> gap(1.0 / cfg_.roam_s);
+        c.next_roam_ns = now + (uint64_t)(gap(rng_) * 1e9) + 1;
+    }
+    schedule(idx);
+}
+
+void LoadGenerator::onData(Client &c, uint32_t idx, unsigned char *buf, int n, uint64_t now)
+{
+    int len = n - (int)sizeof(DataHeader);
+    XorCipher::getInstance().crypt((char *)buf + sizeof(DataHeader), len, plain_, c.key);
+
+    const uint8_t *pkt = (const uint8_t *)plain_;
+    if (((PacketHeader *)buf)->type == PKT_DATA_LZ4)
+    {
+        len = Lz4Codec::decompress((const uint8_t *)plain_, len, inflate_, sizeof(inflate_));
+        if (len < 0)
+        {
+            stats_.rx_bad++;
+            return;
+        }
+        pkt = inflate_;
+    }
+
+    // Echo reply carrying our stamp, for this client
+    EchoStamp stamp;
+    if (len < MIN_PKT || (pkt[0] >> 4) != 4 || pkt[9] != 1)
+    {
+        stats_.rx_other++;
+        return;
+    }
+    int ihl = (pkt[0] & 0x0F) * 4;
+    if (len < ihl + 8 + (int)sizeof(stamp) || pkt[ihl] != 0)
+    {
+        stats_.rx_other++;
+        return;
+    }
+    memcpy(&stamp, pkt + ihl + 8, sizeof(stamp));
+    if (stamp.magic != ECHO_MAGIC || stamp.client != idx || stamp.tx_ns > now)
+    {
+        stats_.rx_other++;
+        return;
+    }
+    stats_.echo_rx++;
+    stats_.rtt_ns.counts[hist_index(now - stamp.tx_ns)]++;
+}
@@ -0,0 +1,229 @@
+#ifndef TOOLS_LOADGENERATOR_H
+#define TOOLS_LOADGENERATOR_H
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <queue>
+#include <random>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+#include "utils/Histogram.h"
+
+/*
+    Simulated VPN clients for load tests.
+
+    Every client does the real HELLO / WELCOME / CLIENT_ACK exchange from
+    protocol/Handshake.h, then sends XOR-encrypted ICMP echo requests from
+    its assigned VPN address to `target_ip` and times the echo replies the
+    server sends back. Against vpn_server the kernel behind tun0 answers
+    (target 10.8.0.1); in-process the FakeTunDevice reflector does.
+
+    Thousands of clients share a handful of UDP sockets: each client has
+    its own loopback source address (src_base + index, 127.0.0.0/8 is all
+    local), set per datagram with IP_PKTINFO, and the IP_PKTINFO of a
+    reply says which client it is for. The sockets differ only in their
+    port, so roaming a client means moving it to another socket.
+
+    Single-threaded and non-blocking; nothing is allocated per packet.
+*/
+
+struct LoadSizeClass
+{
+    int size;   ///< IPv4 packet size before encryption, 40..1400
+    int weight; ///< relative share of packets
+};
+
+struct LoadRateClass
+{
+    double pps; ///< echo requests per second per client
+    int weight; ///< relative share of clients
+};
+
+struct LoadGenConfig
+{
+    sockaddr_in server{};                   ///< Default 127.0.0.1:5555
+    uint32_t src_base = 0x7F010000;         ///< 127.1.0.0; client i sends from src_base + i (host order)
+    uint32_t target_ip = 0x0A080001;        ///< 10.8.0.1; where the echo requests go (host order)
+    int clients = 100;
+    int sockets = 4;                        ///< Source ports clients roam between
+    std::vector<LoadSizeClass> sizes{{64, 1}};
+    std::vector<LoadRateClass> rates{{10.0, 1}};
+    double handshake_rate = 2000;           ///< HELLOs per second (storms: set it high)
+    int handshake_timeout_ms = 1000;
+    int handshake_retries = 3;
+    double keepalive_s = 10;                ///< 0 = never
+    double roam_s = 0;                      ///< Mean seconds between roams per client; 0 = never
+    uint8_t caps = 0;                       ///< SessionCaps requested in the HELLO trailer
+    uint8_t fec_data = 4;
+    uint8_t fec_parity = 1;
+    uint32_t seed = 1;
+
+    LoadGenConfig();
+};
+
+/// Cumulative counters; subtract two copies for an interval.
+struct LoadGenStats
+{
+    uint64_t hello_tx = 0;
+    uint64_t handshakes = 0;         ///< WELCOMEs answered with CLIENT_ACK
+    uint64_t handshake_timeouts = 0; ///< HELLOs that went unanswered
+    uint64_t handshake_failures = 0; ///< Clients that ran out of retries
+    uint64_t data_tx = 0;            ///< Echo requests handed to the kernel
+    uint64_t data_tx_bytes = 0;      ///< UDP payload bytes of those
+    uint64_t raw_tx = 0;             ///< Packets from sendPacket() handed to the kernel
+    uint64_t raw_tx_bytes = 0;       ///< UDP payload bytes of those
+    uint64_t tx_drops = 0;           ///< Datagrams sendmmsg() did not take
+    uint64_t echo_rx = 0;            ///< Echo replies matched to a request
+    uint64_t rx_bytes = 0;           ///< UDP payload bytes received (all types)
+    uint64_t rx_other = 0;           ///< FEC repairs, unexpected types, stray replies
+    uint64_t rx_bad = 0;             ///< Undecodable / unknown-client datagrams
+    uint64_t keepalive_tx = 0;
+    uint64_t pmtu_acks = 0;
+    uint64_t roams = 0;
+    HistogramSnapshot rtt_ns;        ///< Echo round trip
+    HistogramSnapshot handshake_ns;  ///< HELLO sent -> WELCOME received
+
+    LoadGenStats operator-(const LoadGenStats &earlier) const;
+};
+
+class LoadGenerator
+{
+public:
+    /// Opens the sockets; throws std::runtime_error on failure.
+    explicit LoadGenerator(const LoadGenConfig &cfg);
+    ~LoadGenerator();
+
+    LoadGenerator(const LoadGenerator &) = delete;
+    LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+    /// Handshakes, sends and receives until `ns` nanoseconds have passed.
+    void runFor(uint64_t ns);
+
+    /// Stops sending echo requests and keepalives, then only receives for
+    /// `ns` so in-flight replies are counted instead of reported lost.
+    void drain(uint64_t ns);
+
+    /// Says BYE for every connected client.
+    void disconnect();
+
+    /// Sends an arbitrary IPv4 packet through client `idx`'s tunnel, with
+    /// the source address rewritten to the client's VPN address. Queued
+    /// like everything else; runFor() or poll() sends it.
+    /// @return false if the client is not connected or the size is out of range
+    bool sendPacket(int idx, const uint8_t *pkt, int len);
+
+    /// Sends what is queued and handles what has arrived, without waiting.
+    void poll();
+
+    /// Address the server assigned to client `idx` (network order), 0 if not connected.
+    uint32_t vpnAddress(int idx) const;
+
+    const LoadGenStats &stats() const { return stats_; }
+    int connected() const { return connected_; }
+    /// Echo requests neither answered nor dropped by our own send path.
+    uint64_t lost() const;
+
+    static uint64_t nowNs();
+
+private:
+    enum State : uint8_t
+    {
+        IDLE,
+        HELLO_SENT,
+        UP,
+        FAILED
+    };
+
+    struct Client
+    {
+        uint32_t src_ip;     ///< Network order
+        uint8_t sock = 0;
+        uint8_t state = IDLE;
+        uint8_t key = 0;
+        uint8_t tries = 0;
+        uint32_t session_id = 0; ///< Network order, as received
+        uint32_t vpn_ip = 0;     ///< Network order
+        uint32_t a = 0;          ///< DH private value
+        uint16_t icmp_seq = 0;
+        uint64_t tx_seq = 0;
+        uint64_t hello_ns = 0;
+        uint64_t interval_ns = 0; ///< Between echo requests; 0 = keepalives only
+        uint64_t next_data_ns = 0;
+        uint64_t next_keepalive_ns = 0;
+        uint64_t next_roam_ns = 0;
+        uint64_t due_ns = UINT64_MAX; ///< Matches the live timer; older heap entries are stale
+    };
+
+    static constexpr int BATCH = 64;
+    static constexpr int BUF_SIZE = 2048;
+
+    /// What a queued datagram is, so it is counted once the kernel took it
+    enum TxKind : uint8_t
+    {
+        TX_HELLO,
+        TX_ECHO,
+        TX_KEEPALIVE,
+        TX_RAW,
+        TX_CONTROL
+    };
+
+    struct TxQueue
+    {
+        int n = 0;
+        uint8_t kind[BATCH];
+        mmsghdr msgs[BATCH];
+        iovec iov[BATCH];
+        alignas(cmsghdr) char ctrl[BATCH][CMSG_SPACE(sizeof(in_pktinfo))];
+        unsigned char bufs[BATCH][BUF_SIZE];
+    };
+
+    using Timer = std::pair<uint64_t, uint32_t>; // due ns, client index
+
+    void step(uint64_t until_ns, bool sending);
+    void startHandshakes(uint64_t now);
+    void service(uint32_t idx, uint64_t now);
+    uint64_t nextDue(const Client &c) const;
+    void schedule(uint32_t idx);
+
+    unsigned char *slot(const Client &c);
+    void commit(const Client &c, int len, TxKind kind);
+    void flush(int sock);
+    void flushAll();
+
+    void sendHello(uint32_t idx, uint64_t now);
+    void sendHeader(const Client &c, uint8_t type);
+    void sendEcho(uint32_t idx, uint64_t now);
+    void sendPlain(Client &c, int len, TxKind kind);
+    int pickSize();
+
+    void receive(int sock);
+    void onDatagram(uint32_t idx, unsigned char *buf, int n, uint64_t now);
+    void onWelcome(uint32_t idx, unsigned char *buf, int n, uint64_t now);
+    void onData(Client &c, uint32_t idx, unsigned char *buf, int n, uint64_t now);
+
+    LoadGenConfig cfg_;
+    std::vector<int> socks_;
+    std::vector<TxQueue> txq_;
+    std::vector<Client> clients_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::vector<uint32_t> pending_hello_; ///< Clients waiting for a handshake token
+    size_t hello_head_ = 0;
+    double hello_tokens_ = 0;
+    uint64_t hello_last_ns_ = 0;
+    int size_weight_total_ = 0;
+    int connected_ = 0;
+    std::mt19937 rng_;
+    LoadGenStats stats_;
+
+    // Receive side
+    mmsghdr rx_msgs_[BATCH];
+    iovec rx_iov_[BATCH];
+    alignas(cmsghdr) char rx_ctrl_[BATCH][CMSG_SPACE(sizeof(in_pktinfo))];
+    unsigned char rx_bufs_[BATCH][BUF_SIZE];
+    char plain_[BUF_SIZE];
+    unsigned char inflate_[BUF_SIZE];
+};
+
+#endif // TOOLS_LOADGENERATOR_H
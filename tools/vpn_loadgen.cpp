@@ -0,0 +1,290 @@
+/*
+    vpn_loadgen: simulated clients against a running vpn_server.
+
+    Usage:
+        vpn_loadgen [-s host:port] [-n clients] [-t seconds] [-r pps[:weight],...]
+                    [-z size[:weight],...] [-H hellos_per_s] [-k keepalive_s]
+                    [-m roam_s] [-p sockets] [-d target_ip] [-b src_base]
+                    [-C caps] [-i interval_ms] [-w drain_ms]
+
+    Each client handshakes, then sends ICMP echo requests through the
+    tunnel to -d (default 10.8.0.1, the server's own tun0 address, so the
+    kernel answers) and times the replies. -r gives per-client rate
+    classes and -z the packet size mix, e.g.
+
+        vpn_loadgen -n 2000 -r 50:9,500:1 -z 64:6,576:3,1400:1 -m 5 -t 30
+
+    starts 2000 clients, one in ten sending 500 echo/s and the rest 50,
+    with every client moving to another source port about every 5 s.
+
+    Prints achieved rates, loss and RTT percentiles per interval, then the
+    totals and the RTT / handshake latency distributions. Percentiles are
+    bucket upper bounds (within ~6%).
+
+    The server hands out max_clients addresses from 10.8.0.2 upwards
+    (VPN_MAX_CLIENTS, default 100): for more than ~250 clients give tun0 a
+    prefix that covers them, e.g. 10.8.0.1/16, so the kernel's replies
+    route back into the tunnel.
+*/
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "tools/LoadGenerator.h"
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-s host:port] [-n clients] [-t seconds] [-r pps[:weight],...]\n"
+            "          [-z size[:weight],...] [-H hellos_per_s] [-k keepalive_s] [-m roam_s]\n"
+            "          [-p sockets] [-d target_ip] [-b src_base] [-C caps] [-i interval_ms]\n"
+            "          [-w drain_ms]\n",
+            argv0);
+}
+
+// "a[:w],b[:w],..." -> (value, weight) pairs; weight defaults to 1
+static bool parseMix(const char *arg, std::vector<std::pair<double, int>> &out)
+{
+    out.clear();
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        if (item.empty())
+            return false;
+        char *rest;
+        double v = strtod(item.c_str(), &rest);
+        int w = 1;
+        if (*rest == ':')
+            w = atoi(rest + 1);
+        else if (*rest)
+            return false;
+        if (w <= 0)
+            return false;
+        out.emplace_back(v, w);
+        pos = end + 1;
+    }
+    return !out.empty();
+}
+
+static bool parseIp(const char *arg, uint32_t &host_order)
+{
+    in_addr a;
+    if (inet_pton(AF_INET, arg, &a) != 1)
+        return false;
+    host_order = ntohl(a.s_addr);
+    return true;
+}
+
+static double pct(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static void printDistribution(const char *name, const HistogramSnapshot &h)
+{
+    uint64_t n = h.total();
+    printf("%s (us): n %lu p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n", name,
+           (unsigned long)n, h.percentile(50) / 1e3, h.percentile(90) / 1e3,
+           h.percentile(99) / 1e3, h.percentile(99.9) / 1e3, h.max() / 1e3);
+    if (!n)
+        return;
+
+    // Power-of-two rows are enough to see the shape and the tail
+    uint64_t rows[64] = {};
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if (h.counts[i])
+            rows[63 - __builtin_clzll(hist_bucket_upper(i) | 1)] += h.counts[i];
+    uint64_t cum = 0;
+    for (int r = 0; r < 64; r++)
+    {
+        if (!rows[r])
+            continue;
+        cum += rows[r];
+        printf("  < %9.1f us %10lu %6.2f%% %7.3f%% ", (double)(2ULL << r) / 1e3,
+               (unsigned long)rows[r], pct(rows[r], n), pct(cum, n));
+        int bar = (int)(40.0 * (double)rows[r] / (double)n + 0.5);
+        for (int b = 0; b < bar; b++)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv)
+{
+    LoadGenConfig cfg;
+    double seconds = 10;
+    int interval_ms = 1000;
+    int drain_ms = 500;
+    std::vector<std::pair<double, int>> mix;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:t:r:z:H:k:m:p:d:b:C:i:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+        {
+            std::string hp(optarg);
+            size_t colon = hp.rfind(':');
+            uint32_t ip;
+            if (colon == std::string::npos || !parseIp(hp.substr(0, colon).c_str(), ip))
+            {
+                fprintf(stderr, "bad -s %s (want ip:port)\n", optarg);
+                return 2;
+            }
+            cfg.server.sin_addr.s_addr = htonl(ip);
+            cfg.server.sin_port = htons((uint16_t)atoi(hp.c_str() + colon + 1));
+            break;
+        }
+        case 'n':
+            cfg.clients = atoi(optarg);
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'r':
+            if (!parseMix(optarg, mix))
+            {
+                fprintf(stderr, "bad -r %s\n", optarg);
+                return 2;
+            }
+            cfg.rates.clear();
+            for (auto &m : mix)
+                cfg.rates.push_back(LoadRateClass{m.first, m.second});
+            break;
+        case 'z':
+            if (!parseMix(optarg, mix))
+            {
+                fprintf(stderr, "bad -z %s\n", optarg);
+                return 2;
+            }
+            cfg.sizes.clear();
+            for (auto &m : mix)
+                cfg.sizes.push_back(LoadSizeClass{(int)m.first, m.second});
+            break;
+        case 'H':
+            cfg.handshake_rate = atof(optarg);
+            break;
+        case 'k':
+            cfg.keepalive_s = atof(optarg);
+            break;
+        case 'm':
+            cfg.roam_s = atof(optarg);
+            break;
+        case 'p':
+            cfg.sockets = atoi(optarg);
+            break;
+        case 'd':
+            if (!parseIp(optarg, cfg.target_ip))
+            {
+                fprintf(stderr, "bad -d %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'b':
+            if (!parseIp(optarg, cfg.src_base))
+            {
+                fprintf(stderr, "bad -b %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'C':
+            cfg.caps = (uint8_t)strtoul(optarg, nullptr, 0);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'w':
+            drain_ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (interval_ms <= 0)
+        interval_ms = 1000;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    try
+    {
+        LoadGenerator gen(cfg);
+        printf("%d clients -> %s:%u, %d source ports, %.0f hello/s\n", cfg.clients,
+               inet_ntoa(cfg.server.sin_addr), ntohs(cfg.server.sin_port), cfg.sockets,
+               cfg.handshake_rate);
+
+        uint64_t start = LoadGenerator::nowNs();
+        uint64_t end = start + (uint64_t)(seconds * 1e9);
+        LoadGenStats prev = gen.stats();
+        uint64_t prev_ns = start;
+        while (!g_stop)
+        {
+            uint64_t now = LoadGenerator::nowNs();
+            if (now >= end)
+                break;
+            gen.runFor(std::min<uint64_t>((uint64_t)interval_ms * 1000000ULL, end - now));
+
+            now = LoadGenerator::nowNs();
+            LoadGenStats cur = gen.stats();
+            LoadGenStats d = cur - prev;
+            double dt = (double)(now - prev_ns) / 1e9;
+            // Replies still in flight show up as loss here, not in the totals
+            printf("%7.1fs up %d hs %lu tx %.0f pps %.1f Mbit/s rx %.0f pps loss %.2f%%"
+                   " rtt us p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+                   (double)(now - start) / 1e9, gen.connected(), (unsigned long)d.handshakes,
+                   d.data_tx / dt, d.data_tx_bytes * 8 / dt / 1e6, d.echo_rx / dt,
+                   d.data_tx > d.echo_rx ? pct(d.data_tx - d.echo_rx, d.data_tx) : 0.0,
+                   d.rtt_ns.percentile(50) / 1e3, d.rtt_ns.percentile(99) / 1e3,
+                   d.rtt_ns.percentile(99.9) / 1e3, d.rtt_ns.max() / 1e3);
+            fflush(stdout);
+            prev = cur;
+            prev_ns = now;
+        }
+        double elapsed = (double)(LoadGenerator::nowNs() - start) / 1e9;
+
+        gen.drain((uint64_t)drain_ms * 1000000ULL);
+        gen.disconnect();
+
+        const LoadGenStats &s = gen.stats();
+        printf("---- %.1f s ----\n", elapsed);
+        printf("handshakes %lu/%d hello %lu timeouts %lu failed %lu\n",
+               (unsigned long)s.handshakes, cfg.clients, (unsigned long)s.hello_tx,
+               (unsigned long)s.handshake_timeouts, (unsigned long)s.handshake_failures);
+        printf("echo tx %lu (%.0f pps) rx %lu (%.0f pps) lost %lu (%.3f%%) tx drops %lu\n",
+               (unsigned long)s.data_tx, s.data_tx / elapsed, (unsigned long)s.echo_rx,
+               s.echo_rx / elapsed, (unsigned long)gen.lost(), pct(gen.lost(), s.data_tx),
+               (unsigned long)s.tx_drops);
+        printf("keepalives %lu roams %lu pmtu acks %lu rx other %lu bad %lu\n",
+               (unsigned long)s.keepalive_tx, (unsigned long)s.roams, (unsigned long)s.pmtu_acks,
+               (unsigned long)s.rx_other, (unsigned long)s.rx_bad);
+        printDistribution("rtt", s.rtt_ns);
+        printDistribution("handshake", s.handshake_ns);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "[ERROR] %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+    vpn_logdecode: converts a binary log (VPN_LOG_FORMAT=binary) to text or CSV.
+
+    Usage:
+        vpn_logdecode [-f text|csv] [-g substring] [-l] file
+
+    -f text   same lines the text logger writes (default)
+    -f csv    one row per record: time_ns,level,fmt_id,message,arg0,arg1,...
+              (newlines in the message are written as \n)
+              Arguments are raw values, so records of one format (select
+              them with -g, e.g. -g "---- Stats") load as uniform columns.
+    -g s      only records whose format string contains s
+    -l        list the format dictionary of each session instead
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/LogFormat.h"
+
+using logdetail::Record;
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-f text|csv] [-g substring] [-l] file\n", argv0);
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        out.insert(out.end(), chunk, chunk + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static void csvQuoted(const char *s, size_t n)
+{
+    putchar('"');
+    for (size_t i = 0; i < n; i++)
+    {
+        if (s[i] == '\n')
+        {
+            fputs("\\n", stdout); // keep one record per line
+            continue;
+        }
+        if (s[i] == '"')
+            putchar('"');
+        putchar(s[i]);
+    }
+    putchar('"');
+}
+
+static void printCsv(const Record &r, uint32_t id, const char *msg, size_t msg_len)
+{
+    printf("%ld,%d,%u,", (long)r.time, r.lvl, id);
+    csvQuoted(msg, msg_len);
+    for (int i = 0; i < r.nargs; i++)
+    {
+        uint64_t v = r.vals[i];
+        putchar(',');
+        switch (r.types[i])
+        {
+        case logdetail::ARG_INT:
+            printf("%ld", (long)(int64_t)v);
+            break;
+        case logdetail::ARG_DBL:
+        {
+            double d;
+            memcpy(&d, &v, sizeof(d));
+            printf("%.17g", d);
+            break;
+        }
+        case logdetail::ARG_PTR:
+            printf("0x%lx", (unsigned long)v);
+            break;
+        case logdetail::ARG_STR:
+            csvQuoted(r.strs + (v >> 16), v & 0xFFFF);
+            break;
+        }
+    }
+    putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    bool list = false;
+    const char *grep = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:g:lh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0)
+                csv = true;
+            else if (strcmp(optarg, "text") != 0)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'g':
+            grep = optarg;
+            break;
+        case 'l':
+            list = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> data;
+    if (!readFile(argv[optind], data))
+    {
+        fprintf(stderr, "cannot read %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (data.size() < sizeof(logfmt::BLOG_MAGIC) ||
+        memcmp(data.data(), logfmt::BLOG_MAGIC, sizeof(logfmt::BLOG_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s is not a binary VPN log\n", argv[optind]);
+        return 1;
+    }
+
+    if (csv && !list)
+        printf("time_ns,level,fmt_id,message,args...\n");
+
+    logfmt::BlogDecoder dec;
+    static Record r;
+    static char msg[16384];
+    uint32_t id;
+    size_t listed = 0; // dictionary entries already printed in this session
+    uint32_t session = 0;
+    const uint8_t *p = data.data();
+    const uint8_t *end = p + data.size();
+
+    while (true)
+    {
+        logfmt::BlogDecoder::Result res = dec.next(p, end, r, id);
+        if (list)
+        {
+            if (dec.session() != session)
+            {
+                session = dec.session();
+                listed = 0;
+                printf("# session %u\n", session);
+            }
+            for (; listed < dec.formatCount(); listed++)
+            {
+                printf("%zu\t", listed);
+                for (const char *c = dec.format((uint32_t)listed); *c; c++)
+                {
+                    if (*c == '\n')
+                        fputs("\\n", stdout);
+                    else
+                        putchar(*c);
+                }
+                putchar('\n');
+            }
+        }
+        if (res == logfmt::BlogDecoder::END)
+            break;
+        if (res == logfmt::BlogDecoder::CORRUPT)
+        {
+            // A crash can leave a partial record at the end of the file
+            fprintf(stderr, "stopping at corrupt or truncated record, offset %zu\n",
+                    (size_t)(p - data.data()));
+            return end - p > (long)logfmt::BLOG_MAX_RECORD ? 1 : 0;
+        }
+        if (list || (grep && !strstr(r.fmt, grep)))
+            continue;
+
+        if (csv)
+        {
+            size_t n = logfmt::formatMessage(r, msg, sizeof(msg));
+            printCsv(r, id, msg, n);
+        }
+        else
+        {
+            size_t n = logfmt::formatLine(r, msg, sizeof(msg));
+            fwrite(msg, 1, n, stdout);
+            putchar('\n');
+        }
+    }
+    return 0;
+}
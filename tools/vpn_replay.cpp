@@ -0,0 +1,905 @@
+/*
+    vpn_replay: feeds a packet capture back into a server.
+
+    Usage:
+        vpn_replay [-m udp|tun] [-s host:port] [-p port] [-x speed] [-n loops]
+                   [-S auto|tun|udp] [-P server_port] [-N net/prefix] [-d ip]
+                   [-H hellos_per_s] [-C caps] [-i interval_ms] [-L log_file]
+                   capture.pcapng
+
+    Captured tunnel traffic cannot be resent as it is: keys and session
+    ids are negotiated per handshake. Instead every client in the capture
+    becomes a simulated client (tools/LoadGenerator.h) that does a fresh
+    handshake, and its inner packets are re-encrypted and sent at their
+    captured times, scaled by -x (2 = twice as fast, 0 = as fast as
+    possible), -n times over.
+
+    Input is a VPN_CAPTURE_FILE capture (pcapng or pcap) or any capture of
+    IPv4 packets (raw, Ethernet, Linux cooked). Which packets are replayed
+    (-S):
+
+        tun   inner packets. From a client: sent through its tunnel with
+              the source rewritten to its new VPN address (and the
+              destination to -d, if given). To a client: written into the
+              fake TUN with the destination rewritten (-m tun only).
+              Direction comes from the pcapng flags, or else from the
+              client pool -N (default 10.8.0.0/16; its first host is the
+              server): source in the pool = from a client.
+        udp   outer datagrams to -P (default 5555), when only those were
+              captured: each PKT_DATA becomes a filler UDP packet of the
+              same inner size to -d (default 10.8.0.1), client identity
+              by address and port.
+        auto  (default) tun if the capture has inner packets, else udp
+
+    -m udp (default) sends to the running server at -s (default
+    127.0.0.1:5555); its kernel routes the packets, so use -d to keep
+    them local. -m tun runs the data plane in-process over a
+    FakeTunDevice on port -p (default 5602), no root needed, and also
+    reports what reached the TUN and the data plane's CPU time per packet.
+*/
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "net/tun/FakeTunDevice.h"
+#include "protocol/Handshake.h"
+#include "protocol/Ipv4.h"
+#include "server/DataPlane.h"
+#include "tools/LoadGenerator.h"
+#include "utils/PacketCapture.h"
+#include "utils/PcapFormat.h"
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+
+using namespace pcapfmt;
+
+static constexpr uint64_t NS = 1000000000ULL;
+static constexpr int MAX_INNER = 1500;
+static constexpr int POLL_EVERY = 64;           // packets between receive passes at full speed
+static constexpr uint64_t CONNECT_TIMEOUT_NS = 30 * NS;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+/* ---------- capture reading ---------- */
+
+/// One IPv4 packet from the file
+struct RawPacket
+{
+    uint64_t ts_ns;
+    uint32_t off;     ///< IPv4 header in the file buffer
+    uint32_t caplen;
+    uint32_t origlen;
+    int8_t point;     ///< CAP_UDP / CAP_TUN for our own captures, else 0
+    uint8_t dir;      ///< CAP_IN / CAP_OUT from epb_flags, else 0
+};
+
+struct Interface
+{
+    uint16_t linktype = LINKTYPE_RAW;
+    uint8_t tsresol = 6;
+    int8_t point = 0;
+};
+
+static uint32_t swap32(uint32_t v, bool swap)
+{
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t swap16(uint16_t v, bool swap)
+{
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t rd32(const uint8_t *p, bool swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap32(v, swap);
+}
+
+static uint16_t rd16(const uint8_t *p, bool swap)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap16(v, swap);
+}
+
+static uint64_t toNs(uint64_t ts, uint8_t tsresol)
+{
+    int exp = tsresol & 0x7F;
+    if (tsresol & 0x80)
+        return (uint64_t)((long double)ts * 1e9L / (long double)(1ULL << std::min(exp, 63)));
+    uint64_t ns = ts;
+    for (int e = exp; e < 9; e++)
+        ns *= 10;
+    for (int e = 9; e < exp; e++)
+        ns /= 10;
+    return ns;
+}
+
+// Offset of the IPv4 header behind the link-layer header, or -1
+static int linkOffset(uint16_t linktype, const uint8_t *p, uint32_t len)
+{
+    switch (linktype)
+    {
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+        return 0;
+    case LINKTYPE_NULL:
+        return len >= 4 && (p[0] == 2 || p[3] == 2) ? 4 : -1; // AF_INET, either byte order
+    case LINKTYPE_ETHERNET:
+    {
+        int off = 12;
+        while (len >= (uint32_t)off + 2 && p[off] == 0x81 && p[off + 1] == 0x00)
+            off += 4; // 802.1Q tags
+        if (len < (uint32_t)off + 2 || p[off] != 0x08 || p[off + 1] != 0x00)
+            return -1;
+        return off + 2;
+    }
+    case LINKTYPE_LINUX_SLL:
+        return len >= 16 && p[14] == 0x08 && p[15] == 0x00 ? 16 : -1;
+    default:
+        return -1;
+    }
+}
+
+static void addPacket(std::vector<RawPacket> &out, const uint8_t *file, const uint8_t *data,
+                      uint32_t caplen, uint32_t origlen, uint64_t ts_ns, const Interface &itf,
+                      uint8_t dir)
+{
+    int off = linkOffset(itf.linktype, data, caplen);
+    if (off < 0 || caplen < (uint32_t)off + 20 || (data[off] >> 4) != 4)
+        return;
+    RawPacket r;
+    r.ts_ns = ts_ns;
+    r.off = (uint32_t)(data + off - file);
+    r.caplen = caplen - (uint32_t)off;
+    r.origlen = origlen - (uint32_t)off;
+    r.point = itf.point;
+    r.dir = dir;
+    out.push_back(r);
+}
+
+static bool readPcap(const std::vector<uint8_t> &f, std::vector<RawPacket> &out)
+{
+    uint32_t magic;
+    memcpy(&magic, f.data(), 4);
+    bool swap = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    bool nanos = swap32(magic, swap) == PCAP_MAGIC_NS;
+    if (f.size() < sizeof(PcapFileHeader))
+        return false;
+    Interface itf;
+    itf.linktype = (uint16_t)rd32(f.data() + 20, swap);
+
+    size_t pos = sizeof(PcapFileHeader);
+    while (pos + sizeof(PcapRecordHeader) <= f.size())
+    {
+        const uint8_t *h = f.data() + pos;
+        uint64_t sec = rd32(h, swap);
+        uint64_t frac = rd32(h + 4, swap);
+        uint32_t caplen = rd32(h + 8, swap);
+        uint32_t origlen = rd32(h + 12, swap);
+        pos += sizeof(PcapRecordHeader);
+        if (caplen > f.size() - pos)
+            break; // truncated file
+        addPacket(out, f.data(), f.data() + pos, caplen, origlen,
+                  sec * NS + (nanos ? frac : frac * 1000), itf, 0);
+        pos += caplen;
+    }
+    return true;
+}
+
+static bool readPcapng(const std::vector<uint8_t> &f, std::vector<RawPacket> &out)
+{
+    std::vector<Interface> ifs;
+    bool swap = false;
+    size_t pos = 0;
+    while (pos + 12 <= f.size())
+    {
+        const uint8_t *b = f.data() + pos;
+        uint32_t type;
+        memcpy(&type, b, 4); // SHB's type reads the same in both byte orders
+        if (type == BLOCK_SHB)
+        {
+            uint32_t bom;
+            memcpy(&bom, b + 8, 4);
+            swap = bom != BYTE_ORDER_MAGIC;
+            ifs.clear();
+        }
+        type = swap32(type, swap);
+        uint32_t len = rd32(b + 4, swap);
+        if (len < 12 || len > f.size() - pos)
+            break;
+        const uint8_t *end = b + len - 4;
+
+        if (type == BLOCK_IDB && len >= 20)
+        {
+            Interface itf;
+            itf.linktype = rd16(b + 8, swap);
+            for (const uint8_t *o = b + 16; o + 4 <= end;)
+            {
+                uint16_t code = rd16(o, swap), olen = rd16(o + 2, swap);
+                if (code == OPT_ENDOFOPT || o + 4 + olen > end)
+                    break;
+                if (code == OPT_IF_TSRESOL && olen >= 1)
+                    itf.tsresol = o[4];
+                if (code == OPT_IF_NAME)
+                {
+                    std::string name((const char *)o + 4, strnlen((const char *)o + 4, olen));
+                    if (name == "udp")
+                        itf.point = CAP_UDP;
+                    else if (name == "tun")
+                        itf.point = CAP_TUN;
+                }
+                o += 4 + pad4(olen);
+            }
+            ifs.push_back(itf);
+        }
+        else if (type == BLOCK_EPB && len >= 32)
+        {
+            uint32_t id = rd32(b + 8, swap);
+            uint64_t ts = ((uint64_t)rd32(b + 12, swap) << 32) | rd32(b + 16, swap);
+            uint32_t caplen = rd32(b + 20, swap);
+            uint32_t origlen = rd32(b + 24, swap);
+            const uint8_t *data = b + 28;
+            if (id < ifs.size() && data + caplen <= end)
+            {
+                uint8_t dir = 0;
+                for (const uint8_t *o = data + pad4(caplen); o + 4 <= end;)
+                {
+                    uint16_t code = rd16(o, swap), olen = rd16(o + 2, swap);
+                    if (code == OPT_ENDOFOPT || o + 4 + olen > end)
+                        break;
+                    if (code == OPT_EPB_FLAGS && olen == 4)
+                    {
+                        uint32_t flags = rd32(o + 4, swap) & 3;
+                        dir = flags == EPB_INBOUND ? CAP_IN : flags == EPB_OUTBOUND ? CAP_OUT : 0;
+                    }
+                    o += 4 + pad4(olen);
+                }
+                addPacket(out, f.data(), data, caplen, origlen, toNs(ts, ifs[id].tsresol),
+                          ifs[id], dir);
+            }
+        }
+        pos += len;
+    }
+    return true;
+}
+
+static bool readCapture(const char *path, std::vector<uint8_t> &file, std::vector<RawPacket> &out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        file.insert(file.end(), chunk, chunk + n);
+    fclose(fp);
+
+    if (file.size() < 24)
+    {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        return false;
+    }
+    uint32_t magic;
+    memcpy(&magic, file.data(), 4);
+    if (magic == BLOCK_SHB)
+        return readPcapng(file, out);
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+        magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS))
+        return readPcap(file, out);
+    fprintf(stderr, "%s: not a pcap or pcapng file\n", path);
+    return false;
+}
+
+/* ---------- replay plan ---------- */
+
+enum ItemKind : uint8_t
+{
+    FROM_CLIENT, ///< Inner packet into the client's tunnel
+    TO_CLIENT,   ///< Inner packet into the TUN, for the client
+    FILLER       ///< Outer datagram: only its inner size is known
+};
+
+struct Item
+{
+    uint64_t ts_ns;
+    uint32_t client;
+    uint32_t off; ///< FROM_CLIENT / TO_CLIENT: packet in the file buffer
+    uint16_t len;
+    uint8_t kind;
+};
+
+struct Plan
+{
+    std::vector<Item> items;
+    uint32_t clients = 0;
+    uint64_t first_ns = 0;
+    uint64_t span_ns = 0;
+    uint64_t bytes = 0;
+    uint64_t per_kind[3] = {};
+    uint64_t skipped = 0;   ///< Control datagrams, other traffic
+    uint64_t truncated = 0; ///< Inner packets cut by the snap length
+};
+
+struct PlanOptions
+{
+    char source = 'a';            ///< 'a'uto, 't'un, 'u'dp
+    uint16_t server_port = 5555;
+    uint32_t pool_net = 0x0A080000; ///< Host order
+    uint32_t pool_mask = 0xFFFF0000;
+};
+
+static Plan makePlan(const std::vector<uint8_t> &file, const std::vector<RawPacket> &pkts,
+                     const PlanOptions &opt)
+{
+    std::vector<Item> inner, outer;
+    std::unordered_map<uint64_t, uint32_t> ids_inner, ids_outer;
+    Plan plan;
+    auto clientOf = [](std::unordered_map<uint64_t, uint32_t> &ids, uint64_t key) {
+        auto it = ids.emplace(key, (uint32_t)ids.size()).first;
+        return it->second;
+    };
+    auto inPool = [&](uint32_t ip) {
+        return (ip & opt.pool_mask) == opt.pool_net && ip != opt.pool_net + 1;
+    };
+
+    for (const RawPacket &r : pkts)
+    {
+        const uint8_t *p = file.data() + r.off;
+        int ihl = (p[0] & 0x0F) * 4;
+        uint32_t src = ntohl(*(const uint32_t *)(p + 12));
+        uint32_t dst = ntohl(*(const uint32_t *)(p + 16));
+        bool udp = p[9] == 17 && r.caplen >= (uint32_t)ihl + 8;
+        uint16_t sport = udp ? (uint16_t)((p[ihl] << 8) | p[ihl + 1]) : 0;
+        uint16_t dport = udp ? (uint16_t)((p[ihl + 2] << 8) | p[ihl + 3]) : 0;
+        bool is_outer = r.point == CAP_UDP ||
+            (r.point == 0 && udp && (sport == opt.server_port || dport == opt.server_port));
+
+        if (is_outer)
+        {
+            // Client -> server data; handshakes and keepalives are redone live
+            uint32_t payload = r.origlen > (uint32_t)ihl + 8 ? r.origlen - ihl - 8 : 0;
+            uint8_t type = r.caplen > (uint32_t)ihl + 8 ? p[ihl + 8] : 0;
+            if (!udp || dport != opt.server_port || payload < sizeof(DataHeader) + 20 ||
+                (type != PKT_DATA && type != PKT_DATA_LZ4))
+            {
+                plan.skipped++;
+                continue;
+            }
+            uint64_t key = ((uint64_t)src << 16) | sport;
+            outer.push_back(Item{r.ts_ns, clientOf(ids_outer, key), 0,
+                                 (uint16_t)std::min<uint32_t>(payload - sizeof(DataHeader), MAX_INNER),
+                                 FILLER});
+            continue;
+        }
+
+        if (r.caplen < r.origlen || r.origlen > MAX_INNER)
+        {
+            plan.truncated++;
+            continue;
+        }
+        bool from = false, to = false;
+        if (r.dir)
+        {
+            from = r.dir == CAP_IN;
+            to = r.dir == CAP_OUT;
+        }
+        else if (inPool(src))
+            from = true;
+        else if (inPool(dst))
+            to = true;
+        if (!from && !to)
+        {
+            plan.skipped++;
+            continue;
+        }
+        uint32_t id = clientOf(ids_inner, from ? src : dst);
+        inner.push_back(Item{r.ts_ns, id, r.off, (uint16_t)r.origlen,
+                             (uint8_t)(from ? FROM_CLIENT : TO_CLIENT)});
+    }
+
+    bool use_inner = opt.source == 't' || (opt.source == 'a' && !inner.empty());
+    if (use_inner)
+    {
+        plan.items.swap(inner);
+        plan.clients = (uint32_t)ids_inner.size();
+        plan.skipped += outer.size();
+    }
+    else
+    {
+        plan.items.swap(outer);
+        plan.clients = (uint32_t)ids_outer.size();
+        plan.skipped += inner.size();
+    }
+
+    std::stable_sort(plan.items.begin(), plan.items.end(),
+                     [](const Item &a, const Item &b) { return a.ts_ns < b.ts_ns; });
+    if (!plan.items.empty())
+    {
+        plan.first_ns = plan.items.front().ts_ns;
+        plan.span_ns = plan.items.back().ts_ns - plan.first_ns;
+    }
+    for (const Item &it : plan.items)
+    {
+        plan.per_kind[it.kind]++;
+        plan.bytes += it.len;
+    }
+    return plan;
+}
+
+/* ---------- replay ---------- */
+
+struct ReplayOptions
+{
+    double speed = 1.0; ///< 0 = as fast as possible
+    int loops = 1;
+    uint32_t dst_override = 0; ///< Network order, 0 = keep
+    uint32_t filler_dst = htonl(0x0A080001);
+    int interval_ms = 1000;
+};
+
+struct ReplayResult
+{
+    uint64_t sent[3] = {};
+    uint64_t sent_bytes = 0;
+    uint64_t not_connected = 0;
+    uint64_t inject_drops = 0;
+    uint64_t max_lag_ns = 0;
+    double seconds = 0;
+};
+
+// IPv4/UDP packet of `len` bytes to port 9 (discard); the source is set by sendPacket()
+static int buildFiller(uint8_t *p, int len, uint32_t dst)
+{
+    len = std::max(len, 28);
+    memset(p, 0, (size_t)len);
+    p[0] = 0x45;
+    p[2] = (uint8_t)(len >> 8);
+    p[3] = (uint8_t)len;
+    p[8] = 64;
+    p[9] = 17;
+    memcpy(p + 16, &dst, 4);
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2)
+        sum += (uint32_t)((p[i] << 8) | p[i + 1]);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    p[10] = (uint8_t)(~sum >> 8);
+    p[11] = (uint8_t)~sum;
+    p[20] = 0x9C; // source port 40000
+    p[21] = 0x40;
+    p[23] = 9;
+    p[24] = (uint8_t)((len - 20) >> 8);
+    p[25] = (uint8_t)(len - 20);
+    return len;
+}
+
+static bool connectAll(LoadGenerator &gen, uint32_t clients)
+{
+    uint64_t deadline = LoadGenerator::nowNs() + CONNECT_TIMEOUT_NS;
+    while (!g_stop && gen.connected() < (int)clients && LoadGenerator::nowNs() < deadline)
+        gen.runFor(100000000);
+    return gen.connected() == (int)clients;
+}
+
+static ReplayResult replay(LoadGenerator &gen, FakeTunDevice *dev, const Plan &plan,
+                           const std::vector<uint8_t> &file, const ReplayOptions &opt)
+{
+    ReplayResult res;
+    uint8_t buf[2048];
+    uint64_t start = LoadGenerator::nowNs();
+    uint64_t next_report = start + (uint64_t)opt.interval_ms * 1000000ULL;
+    uint64_t last_report = start, last_sent = 0, last_bytes = 0, interval_lag = 0;
+    int since_poll = 0;
+
+    for (int loop = 0; loop < opt.loops && !g_stop; loop++)
+    {
+        for (const Item &it : plan.items)
+        {
+            if (g_stop)
+                break;
+            uint64_t now = LoadGenerator::nowNs();
+            if (opt.speed > 0)
+            {
+                double offset = ((double)loop * (double)(plan.span_ns + 1) +
+                                 (double)(it.ts_ns - plan.first_ns)) / opt.speed;
+                uint64_t due = start + (uint64_t)offset;
+                if (due > now)
+                {
+                    // Waiting is when replies and keepalives get handled
+                    gen.runFor(due - now);
+                    since_poll = 0;
+                }
+                else
+                {
+                    interval_lag = std::max(interval_lag, now - due);
+                }
+            }
+            if (++since_poll >= POLL_EVERY)
+            {
+                gen.poll();
+                since_poll = 0;
+            }
+
+            bool ok;
+            int len = it.len;
+            if (it.kind == FILLER)
+            {
+                len = buildFiller(buf, len, opt.filler_dst);
+                ok = gen.sendPacket((int)it.client, buf, len);
+            }
+            else if (it.kind == FROM_CLIENT)
+            {
+                memcpy(buf, file.data() + it.off, it.len);
+                if (opt.dst_override)
+                    rewriteIpv4Address(buf, len, IPV4_DST, opt.dst_override);
+                ok = gen.sendPacket((int)it.client, buf, len);
+            }
+            else
+            {
+                uint32_t vpn_ip = gen.vpnAddress((int)it.client);
+                ok = vpn_ip && dev;
+                if (ok)
+                {
+                    memcpy(buf, file.data() + it.off, it.len);
+                    rewriteIpv4Address(buf, len, IPV4_DST, vpn_ip);
+                    if (!dev->inject(buf, (size_t)len))
+                    {
+                        res.inject_drops++;
+                        continue;
+                    }
+                }
+            }
+            if (!ok)
+            {
+                res.not_connected++;
+                continue;
+            }
+            res.sent[it.kind]++;
+            res.sent_bytes += (uint64_t)len;
+
+            if (now >= next_report)
+            {
+                uint64_t total = res.sent[0] + res.sent[1] + res.sent[2];
+                double dt = (double)(now - last_report) / 1e9;
+                printf("%7.1fs sent %lu %.0f pps %.1f Mbit/s max lag %.1f ms\n",
+                       (double)(now - start) / 1e9, (unsigned long)total,
+                       (total - last_sent) / dt, (res.sent_bytes - last_bytes) * 8 / dt / 1e6,
+                       interval_lag / 1e6);
+                fflush(stdout);
+                res.max_lag_ns = std::max(res.max_lag_ns, interval_lag);
+                interval_lag = 0;
+                last_report = now;
+                last_sent = total;
+                last_bytes = res.sent_bytes;
+                next_report = now + (uint64_t)opt.interval_ms * 1000000ULL;
+            }
+        }
+    }
+    gen.poll();
+    res.max_lag_ns = std::max(res.max_lag_ns, interval_lag);
+    res.seconds = (double)(LoadGenerator::nowNs() - start) / 1e9;
+    return res;
+}
+
+static void printResult(const Plan &plan, const ReplayOptions &opt, const ReplayResult &r,
+                        const LoadGenStats &g)
+{
+    uint64_t total = r.sent[0] + r.sent[1] + r.sent[2];
+    double span = (double)plan.span_ns / 1e9;
+    printf("---- replayed %lu packet(s) in %.2f s ----\n", (unsigned long)total, r.seconds);
+    printf("from clients %lu, to clients %lu, filler %lu; not connected %lu, inject drops %lu\n",
+           (unsigned long)r.sent[FROM_CLIENT], (unsigned long)r.sent[TO_CLIENT],
+           (unsigned long)r.sent[FILLER], (unsigned long)r.not_connected,
+           (unsigned long)r.inject_drops);
+    if (r.seconds > 0)
+        printf("%.0f pps, %.1f Mbit/s (capture: %.0f pps x %d loop(s)); max lag %.2f ms\n",
+               total / r.seconds, r.sent_bytes * 8 / r.seconds / 1e6,
+               span > 0 ? plan.items.size() / span : 0.0, opt.loops, r.max_lag_ns / 1e6);
+    printf("clients: tunnel tx %lu (%lu bytes), tx drops %lu, rx %lu (%lu bytes), bad %lu\n",
+           (unsigned long)g.raw_tx, (unsigned long)g.raw_tx_bytes, (unsigned long)g.tx_drops,
+           (unsigned long)(g.rx_other + g.echo_rx), (unsigned long)g.rx_bytes,
+           (unsigned long)g.rx_bad);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-m udp|tun] [-s host:port] [-p port] [-x speed] [-n loops]\n"
+            "          [-S auto|tun|udp] [-P server_port] [-N net/prefix] [-d ip]\n"
+            "          [-H hellos_per_s] [-C caps] [-i interval_ms] [-L log_file]\n"
+            "          capture.pcapng\n",
+            argv0);
+}
+
+static bool parseIp(const char *arg, uint32_t &net_order)
+{
+    in_addr a;
+    if (inet_pton(AF_INET, arg, &a) != 1)
+        return false;
+    net_order = a.s_addr;
+    return true;
+}
+
+static uint64_t cpuNs(clockid_t clk)
+{
+    timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * NS + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    bool tun_mode = false;
+    uint16_t local_port = 5602;
+    const char *log_path = "vpn_replay.log";
+    PlanOptions popt;
+    ReplayOptions ropt;
+    LoadGenConfig cfg;
+    cfg.rates = {{0, 1}}; // no echo traffic of its own, only keepalives
+    cfg.keepalive_s = 5;
+    cfg.handshake_rate = 5000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:p:x:n:S:P:N:d:H:C:i:L:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            if (strcmp(optarg, "tun") != 0 && strcmp(optarg, "udp") != 0)
+            {
+                fprintf(stderr, "bad -m %s (want udp or tun)\n", optarg);
+                return 2;
+            }
+            tun_mode = strcmp(optarg, "tun") == 0;
+            break;
+        case 's':
+        {
+            std::string hp(optarg);
+            size_t colon = hp.rfind(':');
+            uint32_t ip;
+            if (colon == std::string::npos || !parseIp(hp.substr(0, colon).c_str(), ip))
+            {
+                fprintf(stderr, "bad -s %s (want ip:port)\n", optarg);
+                return 2;
+            }
+            cfg.server.sin_addr.s_addr = ip;
+            cfg.server.sin_port = htons((uint16_t)atoi(hp.c_str() + colon + 1));
+            break;
+        }
+        case 'p':
+            local_port = (uint16_t)atoi(optarg);
+            break;
+        case 'x':
+            ropt.speed = atof(optarg);
+            break;
+        case 'n':
+            ropt.loops = std::max(1, atoi(optarg));
+            break;
+        case 'S':
+            if (strcmp(optarg, "auto") != 0 && strcmp(optarg, "tun") != 0 &&
+                strcmp(optarg, "udp") != 0)
+            {
+                fprintf(stderr, "bad -S %s\n", optarg);
+                return 2;
+            }
+            popt.source = optarg[0];
+            break;
+        case 'P':
+            popt.server_port = (uint16_t)atoi(optarg);
+            break;
+        case 'N':
+        {
+            std::string np(optarg);
+            size_t slash = np.find('/');
+            int prefix = slash == std::string::npos ? 32 : atoi(np.c_str() + slash + 1);
+            uint32_t net;
+            if (!parseIp(np.substr(0, slash).c_str(), net) || prefix < 1 || prefix > 32)
+            {
+                fprintf(stderr, "bad -N %s (want net/prefix)\n", optarg);
+                return 2;
+            }
+            popt.pool_mask = prefix == 32 ? 0xFFFFFFFFu : ~(0xFFFFFFFFu >> prefix);
+            popt.pool_net = ntohl(net) & popt.pool_mask;
+            break;
+        }
+        case 'd':
+            if (!parseIp(optarg, ropt.dst_override))
+            {
+                fprintf(stderr, "bad -d %s\n", optarg);
+                return 2;
+            }
+            ropt.filler_dst = ropt.dst_override;
+            break;
+        case 'H':
+            cfg.handshake_rate = atof(optarg);
+            break;
+        case 'C':
+            cfg.caps = (uint8_t)strtoul(optarg, nullptr, 0);
+            break;
+        case 'i':
+            ropt.interval_ms = std::max(1, atoi(optarg));
+            break;
+        case 'L':
+            log_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> file;
+    std::vector<RawPacket> pkts;
+    if (!readCapture(argv[optind], file, pkts))
+        return 1;
+    Plan plan = makePlan(file, pkts, popt);
+    printf("%s: %zu IPv4 packet(s), %.2f s, %u client(s): from clients %lu, to clients %lu,"
+           " filler %lu, skipped %lu, truncated %lu\n",
+           argv[optind], pkts.size(), plan.span_ns / 1e9, plan.clients,
+           (unsigned long)plan.per_kind[FROM_CLIENT], (unsigned long)plan.per_kind[TO_CLIENT],
+           (unsigned long)plan.per_kind[FILLER], (unsigned long)plan.skipped,
+           (unsigned long)plan.truncated);
+    if (plan.items.empty())
+    {
+        fprintf(stderr, "nothing to replay\n");
+        return 1;
+    }
+    if (!tun_mode && plan.per_kind[TO_CLIENT])
+    {
+        printf("note: %lu packet(s) to clients need the TUN side (-m tun), skipped\n",
+               (unsigned long)plan.per_kind[TO_CLIENT]);
+        plan.items.erase(std::remove_if(plan.items.begin(), plan.items.end(),
+                                        [](const Item &it) { return it.kind == TO_CLIENT; }),
+                         plan.items.end());
+        plan.per_kind[TO_CLIENT] = 0;
+        if (plan.items.empty())
+            return 1;
+    }
+
+    cfg.clients = (int)plan.clients;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    if (!tun_mode)
+    {
+        try
+        {
+            LoadGenerator gen(cfg);
+            if (!connectAll(gen, plan.clients))
+                printf("only %d of %u client(s) connected\n", gen.connected(), plan.clients);
+            LoadGenStats g0 = gen.stats();
+            ReplayResult r = replay(gen, nullptr, plan, file, ropt);
+            gen.drain(500000000);
+            LoadGenStats g = gen.stats() - g0;
+            gen.disconnect();
+            printResult(plan, ropt, r, g);
+        }
+        catch (const std::exception &e)
+        {
+            fprintf(stderr, "[ERROR] %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    // In-process server: the data plane runs here, the clients on a driver thread
+    log_init_file(log_path);
+    int rc = 0;
+    try
+    {
+        FakeTunDevice dev;
+        DataPlaneConfig pc;
+        pc.udp_port = local_port;
+        pc.max_clients = (int)plan.clients + (int)plan.clients / 8 + 16;
+        DataPlane plane(dev, pc);
+        capture_start(local_port);
+
+        clockid_t plane_clk;
+        pthread_getcpuclockid(pthread_self(), &plane_clk);
+        cfg.server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        cfg.server.sin_port = htons(local_port);
+
+        // What the server writes into the TUN
+        std::atomic<bool> sink_stop{false};
+        std::atomic<uint64_t> sink_pkts{0}, sink_bytes{0};
+        std::thread sink([&] {
+            uint8_t buf[2048];
+            while (!sink_stop.load(std::memory_order_relaxed))
+            {
+                ssize_t n = dev.capture(buf, sizeof(buf), 50);
+                if (n > 0)
+                {
+                    sink_pkts.fetch_add(1, std::memory_order_relaxed);
+                    sink_bytes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+                }
+            }
+        });
+
+        std::string error;
+        std::thread driver([&] {
+            try
+            {
+                LoadGenerator gen(cfg);
+                if (!connectAll(gen, plan.clients))
+                    printf("only %d of %u client(s) connected\n", gen.connected(), plan.clients);
+                LoadGenStats g0 = gen.stats();
+                StatsSnapshot s0 = StatsSnapshot::collect();
+                uint64_t c0 = cpuNs(plane_clk);
+                uint64_t t0 = sink_pkts.load();
+                ReplayResult r = replay(gen, &dev, plan, file, ropt);
+                gen.drain(500000000);
+                uint64_t c1 = cpuNs(plane_clk);
+                StatsSnapshot d = StatsSnapshot::collect() - s0;
+                LoadGenStats g = gen.stats() - g0;
+                gen.disconnect();
+
+                printResult(plan, ropt, r, g);
+                uint64_t fwd = d.udp_rx_pkts + d.tun_rx_pkts;
+                // Datagrams the kernel dropped before recvmmsg() show up only here
+                printf("server: udp rx %lu of %lu sent, tun tx %lu (sink %lu), tun rx %lu,"
+                       " udp tx %lu, hairpin %lu\n",
+                       (unsigned long)d.udp_rx_pkts,
+                       (unsigned long)(g.raw_tx + g.hello_tx + g.keepalive_tx),
+                       (unsigned long)d.tun_tx_pkts,
+                       (unsigned long)(sink_pkts.load() - t0), (unsigned long)d.tun_rx_pkts,
+                       (unsigned long)d.udp_tx_pkts, (unsigned long)d.hairpin_pkts);
+                printf("server drops: udp rx %lu, replay %lu, tun write %lu, udp tx %lu;"
+                       " cpu %.0f ns/pkt\n",
+                       (unsigned long)d.udp_rx_drops, (unsigned long)d.replay_drops,
+                       (unsigned long)d.tun_rx_drops, (unsigned long)d.udp_tx_drops,
+                       fwd ? (double)(c1 - c0) / fwd : 0.0);
+            }
+            catch (const std::exception &e)
+            {
+                error = e.what();
+            }
+            plane.stop();
+        });
+        plane.run();
+        driver.join();
+        sink_stop = true;
+        sink.join();
+        capture_stop();
+        if (!error.empty())
+        {
+            fprintf(stderr, "[ERROR] %s\n", error.c_str());
+            rc = 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "[ERROR] %s\n", e.what());
+        rc = 1;
+    }
+    log_flush();
+    log_shutdown();
+    return rc;
+}
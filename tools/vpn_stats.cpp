@@ -0,0 +1,107 @@
+/*
+    vpn_stats: reads the server's shared-memory metrics segment.
+
+    Usage:
+        vpn_stats [-n shm_name] [-i interval_ms] [-c count] [-a]
+
+    Without -i, prints every counter once (monotonic totals).
+    With -i, prints per-second rates of the counters that changed over
+    each interval; -a includes the ones that did not.
+
+    Reading never blocks the server (see utils/MetricsShm.h).
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/MetricsShm.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n shm_name] [-i interval_ms] [-c count] [-a]\n", argv0);
+}
+
+static void printTotals(const MetricsShmReader &r, const std::vector<uint64_t> &v)
+{
+    const MetricsShmHeader *h = r.header();
+    printf("pid %lu, %u counters, %lu publishes\n",
+           (unsigned long)h->pid, r.count(),
+           (unsigned long)h->publish_count.load(std::memory_order_relaxed));
+    for (uint32_t i = 0; i < r.count(); i++)
+        printf("%-32s %20lu\n", r.name(i), (unsigned long)v[i]);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = getenv("VPN_STATS_SHM");
+    if (!name || !*name)
+        name = METRICS_SHM_DEFAULT_NAME;
+    int interval_ms = 0;
+    long count = -1;
+    bool show_all = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:c:ah")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'c':
+            count = atol(optarg);
+            break;
+        case 'a':
+            show_all = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    MetricsShmReader reader;
+    if (!reader.open(name))
+    {
+        fprintf(stderr, "cannot open metrics shm %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+
+    std::vector<uint64_t> prev, cur;
+    uint64_t prev_ns = 0, cur_ns = 0;
+    reader.read(prev, prev_ns);
+
+    if (interval_ms <= 0)
+    {
+        printTotals(reader, prev);
+        return 0;
+    }
+
+    for (long n = 0; count < 0 || n < count; n++)
+    {
+        usleep((useconds_t)interval_ms * 1000);
+        reader.read(cur, cur_ns);
+        if (cur_ns == prev_ns)
+            continue; // nothing published yet; keep the older baseline
+
+        double seconds = (double)(cur_ns - prev_ns) / 1e9;
+        printf("---- %.3f sec ----\n", seconds);
+        for (uint32_t i = 0; i < reader.count(); i++)
+        {
+            uint64_t d = cur[i] - prev[i];
+            if (d || show_all)
+                printf("%-32s %14lu %14.1f/s\n", reader.name(i), (unsigned long)d, d / seconds);
+        }
+        fflush(stdout);
+        prev.swap(cur);
+        prev_ns = cur_ns;
+    }
+    return 0;
+}
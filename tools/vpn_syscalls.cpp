@@ -0,0 +1,186 @@
+/*
+    vpn_syscalls: reads the syscall hook segment (perf_hook_full.c).
+
+    Usage:
+        vpn_syscalls [-n shm_name] [-i interval_ms] [-c count] [-a]
+
+    Without -i, prints totals since the server started. With -i, prints
+    each interval's calls; -a includes calls that did not happen.
+
+    Latency columns are nanoseconds; "items" is messages per call for
+    recvmmsg/sendmmsg, bytes for read/write and ready fds for
+    select/epoll_wait. Percentiles are bucket upper bounds (within ~6%).
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/Histogram.h"
+#include "utils/SyscallHook.h"
+
+static_assert(SYSCALL_HOOK_BUCKETS == HIST_BUCKETS, "hook buckets must match utils/Histogram.h");
+
+struct CallTotals
+{
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+    uint64_t eagain = 0;
+    uint64_t total_ns = 0;
+    uint64_t items = 0;
+    HistogramSnapshot lat;
+    HistogramSnapshot items_hist;
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n shm_name] [-i interval_ms] [-c count] [-a]\n", argv0);
+}
+
+static uint64_t load(const uint64_t &v)
+{
+    return __atomic_load_n(&v, __ATOMIC_RELAXED);
+}
+
+static void readAll(const SyscallHookShm *shm, CallTotals *out)
+{
+    for (int c = 0; c < HOOK_CALL_COUNT; c++)
+    {
+        CallTotals &t = out[c];
+        t = CallTotals();
+        for (uint32_t s = 0; s < shm->shards; s++)
+        {
+            const SyscallHookStats &st = shm->shard[s].call[c];
+            t.calls += load(st.calls);
+            t.errors += load(st.errors);
+            t.eagain += load(st.eagain);
+            t.total_ns += load(st.total_ns);
+            t.items += load(st.items);
+            for (int b = 0; b < HIST_BUCKETS; b++)
+            {
+                t.lat.counts[b] += load(st.lat_hist[b]);
+                t.items_hist.counts[b] += load(st.items_hist[b]);
+            }
+        }
+    }
+}
+
+static void printCall(const char *name, const CallTotals &t, double seconds)
+{
+    uint64_t ok = t.calls - t.errors - t.eagain;
+    printf("%-10s %12lu", name, (unsigned long)t.calls);
+    if (seconds > 0)
+        printf(" %11.1f/s", t.calls / seconds);
+    printf(" err %lu again %lu | ns avg %.0f p50 %lu p99 %lu p99.9 %lu max %lu"
+           " | items avg %.1f p50 %lu p99 %lu\n",
+           (unsigned long)t.errors, (unsigned long)t.eagain,
+           t.calls ? (double)t.total_ns / t.calls : 0.0,
+           (unsigned long)t.lat.percentile(50), (unsigned long)t.lat.percentile(99),
+           (unsigned long)t.lat.percentile(99.9), (unsigned long)t.lat.max(),
+           ok ? (double)t.items / ok : 0.0,
+           (unsigned long)t.items_hist.percentile(50), (unsigned long)t.items_hist.percentile(99));
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = getenv("VPN_HOOK_SHM");
+    if (!name || !*name)
+        name = SYSCALL_HOOK_DEFAULT_NAME;
+    int interval_ms = 0;
+    long count = -1;
+    bool show_all = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:c:ah")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'c':
+            count = atol(optarg);
+            break;
+        case 'a':
+            show_all = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "cannot open hook shm %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SyscallHookShm))
+    {
+        fprintf(stderr, "%s: unexpected segment size\n", name);
+        close(fd);
+        return 1;
+    }
+    void *p = mmap(nullptr, sizeof(SyscallHookShm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        fprintf(stderr, "cannot map %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    const SyscallHookShm *shm = static_cast<const SyscallHookShm *>(p);
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SYSCALL_HOOK_MAGIC ||
+        shm->version != SYSCALL_HOOK_VERSION || shm->num_calls != HOOK_CALL_COUNT ||
+        shm->buckets != (uint32_t)HIST_BUCKETS || shm->shards > SYSCALL_HOOK_SHARDS)
+    {
+        fprintf(stderr, "%s: not a syscall hook segment of this version\n", name);
+        return 1;
+    }
+
+    static CallTotals prev[HOOK_CALL_COUNT], cur[HOOK_CALL_COUNT];
+    readAll(shm, prev);
+
+    if (interval_ms <= 0)
+    {
+        printf("pid %lu\n", (unsigned long)shm->pid);
+        for (int c = 0; c < HOOK_CALL_COUNT; c++)
+            if (prev[c].calls || show_all)
+                printCall(shm->names[c], prev[c], 0);
+        return 0;
+    }
+
+    for (long n = 0; count < 0 || n < count; n++)
+    {
+        usleep((useconds_t)interval_ms * 1000);
+        readAll(shm, cur);
+
+        double seconds = interval_ms / 1000.0;
+        printf("---- %.3f sec ----\n", seconds);
+        for (int c = 0; c < HOOK_CALL_COUNT; c++)
+        {
+            CallTotals d;
+            d.calls = cur[c].calls - prev[c].calls;
+            d.errors = cur[c].errors - prev[c].errors;
+            d.eagain = cur[c].eagain - prev[c].eagain;
+            d.total_ns = cur[c].total_ns - prev[c].total_ns;
+            d.items = cur[c].items - prev[c].items;
+            d.lat = cur[c].lat - prev[c].lat;
+            d.items_hist = cur[c].items_hist - prev[c].items_hist;
+            if (d.calls || show_all)
+                printCall(shm->names[c], d, seconds);
+            prev[c] = cur[c];
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
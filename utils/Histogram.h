@@ -0,0 +1,126 @@
+#ifndef UTILS_HISTOGRAM_H
+#define UTILS_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+    Fixed-memory log-linear latency histogram (HdrHistogram-style).
+
+    Values below 2^HIST_SUB_BITS get one bucket each. Above that, every
+    power-of-two range [2^e, 2^(e+1)) is split into 2^HIST_SUB_BITS equal
+    buckets, so any recorded value is off by at most 1/16 (~6%) of itself.
+    Values of 2^HIST_MAX_EXP and above land in the last bucket.
+
+    Recording is one bucket-index computation (a clz and two shifts) and
+    one single-writer relaxed increment. Histograms of different threads
+    merge by adding bucket counts, and interval values come from
+    subtracting an earlier snapshot, exactly like the plain counters.
+*/
+
+constexpr int HIST_SUB_BITS = 4;
+constexpr int HIST_SUB = 1 << HIST_SUB_BITS;
+constexpr int HIST_MAX_EXP = 40; // 2^40 cycles ~ 6 minutes at 3 GHz
+constexpr int HIST_BUCKETS = (HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB;
+
+inline int hist_index(uint64_t v)
+{
+    if (v < (uint64_t)HIST_SUB)
+        return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e >= HIST_MAX_EXP)
+        return HIST_BUCKETS - 1;
+    int mantissa = (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + mantissa;
+}
+
+/// Largest value that maps to bucket idx.
+inline uint64_t hist_bucket_upper(int idx)
+{
+    if (idx < HIST_SUB)
+        return (uint64_t)idx;
+    int e = idx / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t m = (uint64_t)(idx % HIST_SUB);
+    uint64_t width = 1ULL << (e - HIST_SUB_BITS);
+    return ((HIST_SUB + m) << (e - HIST_SUB_BITS)) + width - 1;
+}
+
+/**
+ * @brief Per-thread histogram, written by its owner thread only.
+ */
+struct AtomicHistogram
+{
+    std::atomic<uint64_t> counts[HIST_BUCKETS] = {};
+
+    inline void record(uint64_t v)
+    {
+        std::atomic<uint64_t> &c = counts[hist_index(v)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Plain copy used for merging, diffing and percentile queries.
+ */
+struct HistogramSnapshot
+{
+    uint64_t counts[HIST_BUCKETS] = {};
+
+    void merge(const AtomicHistogram &h)
+    {
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            counts[i] += h.counts[i].load(std::memory_order_relaxed);
+    }
+
+    void merge(const HistogramSnapshot &h)
+    {
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            counts[i] += h.counts[i];
+    }
+
+    HistogramSnapshot operator-(const HistogramSnapshot &earlier) const
+    {
+        HistogramSnapshot d;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            d.counts[i] = counts[i] - earlier.counts[i];
+        return d;
+    }
+
+    uint64_t total() const
+    {
+        uint64_t n = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            n += counts[i];
+        return n;
+    }
+
+    /// Value at or below which `p` percent of samples fall (bucket upper bound).
+    uint64_t percentile(double p) const
+    {
+        uint64_t n = total();
+        if (n == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)n + 0.5);
+        if (rank < 1)
+            rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return hist_bucket_upper(i);
+        }
+        return hist_bucket_upper(HIST_BUCKETS - 1);
+    }
+
+    /// Upper bound of the highest non-empty bucket.
+    uint64_t max() const
+    {
+        for (int i = HIST_BUCKETS - 1; i >= 0; i--)
+            if (counts[i])
+                return hist_bucket_upper(i);
+        return 0;
+    }
+};
+
+#endif // UTILS_HISTOGRAM_H
@@ -0,0 +1,393 @@
+#include "LogFormat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sys/types.h>
+
+using logdetail::Record;
+
+namespace logfmt
+{
+
+/* ---------- rendering ---------- */
+
+// Formats one conversion with the argument cast to the type its length
+// modifier asks for, so the output matches an inline printf.
+static int formatArg(char *out, size_t cap, const char *spec, const char *len, char conv,
+                     const Record &r, int ai)
+{
+    if (ai >= r.nargs)
+        return snprintf(out, cap, "%s", spec); // missing argument: print the spec
+    uint64_t v = r.vals[ai];
+    uint8_t t = r.types[ai];
+
+    switch (conv)
+    {
+    case 'd':
+    case 'i':
+        if (t != logdetail::ARG_INT)
+            break;
+        if (!strcmp(len, "hh"))
+            return snprintf(out, cap, spec, (int)(signed char)v);
+        if (!strcmp(len, "h"))
+            return snprintf(out, cap, spec, (int)(short)v);
+        if (!strcmp(len, "l"))
+            return snprintf(out, cap, spec, (long)v);
+        if (!strcmp(len, "ll") || !strcmp(len, "q"))
+            return snprintf(out, cap, spec, (long long)v);
+        if (!strcmp(len, "j"))
+            return snprintf(out, cap, spec, (intmax_t)v);
+        if (!strcmp(len, "z") || !strcmp(len, "t"))
+            return snprintf(out, cap, spec, (ssize_t)v);
+        return snprintf(out, cap, spec, (int)v);
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        if (t != logdetail::ARG_INT)
+            break;
+        if (!strcmp(len, "hh"))
+            return snprintf(out, cap, spec, (unsigned)(unsigned char)v);
+        if (!strcmp(len, "h"))
+            return snprintf(out, cap, spec, (unsigned)(unsigned short)v);
+        if (!strcmp(len, "l"))
+            return snprintf(out, cap, spec, (unsigned long)v);
+        if (!strcmp(len, "ll") || !strcmp(len, "q"))
+            return snprintf(out, cap, spec, (unsigned long long)v);
+        if (!strcmp(len, "j"))
+            return snprintf(out, cap, spec, (uintmax_t)v);
+        if (!strcmp(len, "z") || !strcmp(len, "t"))
+            return snprintf(out, cap, spec, (size_t)v);
+        return snprintf(out, cap, spec, (unsigned)v);
+    case 'c':
+        if (t != logdetail::ARG_INT)
+            break;
+        return snprintf(out, cap, spec, (int)v);
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+    {
+        if (t != logdetail::ARG_DBL)
+            break;
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        if (!strcmp(len, "L"))
+            return snprintf(out, cap, spec, (long double)d);
+        return snprintf(out, cap, spec, d);
+    }
+    case 's':
+    {
+        if (t != logdetail::ARG_STR)
+            break;
+        // Strings are stored without a terminator
+        char s[logdetail::STR_BYTES + 1];
+        size_t off = v >> 16, n = v & 0xFFFF;
+        memcpy(s, r.strs + off, n);
+        s[n] = '\0';
+        return snprintf(out, cap, spec, s);
+    }
+    case 'p':
+        if (t != logdetail::ARG_PTR && t != logdetail::ARG_INT)
+            break;
+        return snprintf(out, cap, spec, (void *)(uintptr_t)v);
+    default:
+        break;
+    }
+    return snprintf(out, cap, "<bad %s>", spec);
+}
+
+size_t formatMessage(const Record &r, char *out, size_t cap)
+{
+    size_t n = 0;
+    int ai = 0;
+    const char *f = r.fmt;
+    while (*f && n + 1 < cap)
+    {
+        if (*f != '%')
+        {
+            out[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            out[n++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conv
+        const char *start = f++;
+        while (*f && strchr("-+ #0", *f))
+            f++;
+        while (*f >= '0' && *f <= '9')
+            f++;
+        if (*f == '.')
+        {
+            f++;
+            while (*f >= '0' && *f <= '9')
+                f++;
+        }
+        char len[3] = {};
+        int ll = 0;
+        while (*f && strchr("hlLqjzt", *f) && ll < 2)
+            len[ll++] = *f++;
+        char conv = *f;
+        if (!conv)
+            break;
+        f++;
+
+        char spec[32];
+        size_t sl = (size_t)(f - start);
+        if (sl >= sizeof(spec))
+            sl = sizeof(spec) - 1;
+        memcpy(spec, start, sl);
+        spec[sl] = '\0';
+
+        int w = formatArg(out + n, cap - n, spec, len, conv, r, ai++);
+        if (w > 0)
+            n += std::min((size_t)w, cap - n - 1);
+    }
+    out[n] = '\0';
+    return n;
+}
+
+const char *levelTag(int lvl)
+{
+    return (lvl == LOG_ERROR) ? "[ERR] " :
+           (lvl == LOG_WARN)  ? "[WRN] " :
+           (lvl == LOG_INFO)  ? "[INF] " :
+                                "[DBG] ";
+}
+
+size_t formatLine(const Record &r, char *out, size_t cap)
+{
+    time_t t = (time_t)(r.time / 1000000000LL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    int n = snprintf(out, cap, "%02d:%02d:%02d %s",
+                     tm.tm_hour, tm.tm_min, tm.tm_sec, levelTag(r.lvl));
+    if (n < 0 || (size_t)n >= cap)
+        return 0;
+    return (size_t)n + formatMessage(r, out + n, cap - n);
+}
+
+/* ---------- varints ---------- */
+
+static inline uint8_t *putVarint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p >= end)
+            return false;
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/* ---------- encoding ---------- */
+
+size_t encodeFormat(uint32_t id, const char *fmt, uint8_t *out, size_t cap)
+{
+    size_t len = strlen(fmt);
+    if (len + 1 + 10 + 10 > cap)
+        return 0;
+    uint8_t *p = out;
+    *p++ = BLOG_FORMAT;
+    p = putVarint(p, id);
+    p = putVarint(p, len);
+    memcpy(p, fmt, len);
+    return (size_t)(p + len - out);
+}
+
+size_t encodeRecord(uint32_t id, const Record &r, int64_t &prev_ns, uint8_t *out)
+{
+    uint8_t *p = out;
+    *p++ = BLOG_RECORD;
+    p = putVarint(p, id);
+    *p++ = r.lvl;
+    p = putVarint(p, zigzag(r.time - prev_ns));
+    prev_ns = r.time;
+    *p++ = r.nargs;
+    for (int i = 0; i < r.nargs; i++)
+    {
+        uint64_t v = r.vals[i];
+        *p++ = r.types[i];
+        switch (r.types[i])
+        {
+        case logdetail::ARG_INT:
+            p = putVarint(p, zigzag((int64_t)v));
+            break;
+        case logdetail::ARG_DBL:
+            for (int b = 0; b < 8; b++)
+                *p++ = (uint8_t)(v >> (8 * b));
+            break;
+        case logdetail::ARG_PTR:
+            p = putVarint(p, v);
+            break;
+        case logdetail::ARG_STR:
+        {
+            size_t off = v >> 16, n = v & 0xFFFF;
+            p = putVarint(p, n);
+            memcpy(p, r.strs + off, n);
+            p += n;
+            break;
+        }
+        }
+    }
+    return (size_t)(p - out);
+}
+
+/* ---------- decoding ---------- */
+
+const char *BlogDecoder::format(uint32_t id) const
+{
+    return id < dict_.size() ? dict_[id].c_str() : nullptr;
+}
+
+// Leaves `p` at the start of the bad entry
+static BlogDecoder::Result corrupt(const uint8_t *&p, const uint8_t *start)
+{
+    p = start;
+    return BlogDecoder::CORRUPT;
+}
+
+BlogDecoder::Result BlogDecoder::next(const uint8_t *&p, const uint8_t *end,
+                                      Record &r, uint32_t &fmt_id)
+{
+    while (p < end)
+    {
+        if ((size_t)(end - p) >= sizeof(BLOG_MAGIC) &&
+            memcmp(p, BLOG_MAGIC, sizeof(BLOG_MAGIC)) == 0)
+        {
+            // New writer session: ids and timestamps start over
+            p += sizeof(BLOG_MAGIC);
+            dict_.clear();
+            prev_ns_ = 0;
+            session_++;
+            continue;
+        }
+
+        const uint8_t *start = p;
+        uint8_t kind = *p++;
+        uint64_t id;
+        if (!getVarint(p, end, id))
+            return corrupt(p, start);
+
+        if (kind == BLOG_FORMAT)
+        {
+            uint64_t len;
+            if (!getVarint(p, end, len) || len > (uint64_t)(end - p) || id != dict_.size())
+                return corrupt(p, start);
+            dict_.emplace_back((const char *)p, (size_t)len);
+            p += len;
+            continue;
+        }
+        if (kind != BLOG_RECORD || id >= dict_.size() || end - p < 2)
+            return corrupt(p, start);
+
+        r.fmt = dict_[id].c_str();
+        r.lvl = *p++;
+        uint64_t dt;
+        if (!getVarint(p, end, dt) || p >= end)
+            return corrupt(p, start);
+        prev_ns_ += unzigzag(dt);
+        r.time = prev_ns_;
+        r.nargs = 0;
+        r.str_used = 0;
+        uint8_t nargs = *p++;
+        if (nargs > logdetail::MAX_ARGS)
+            return corrupt(p, start);
+
+        bool ok = true;
+        for (int i = 0; i < nargs && ok; i++)
+        {
+            if (p >= end)
+            {
+                ok = false;
+                break;
+            }
+            uint8_t t = *p++;
+            uint64_t v = 0;
+            switch (t)
+            {
+            case logdetail::ARG_INT:
+                ok = getVarint(p, end, v);
+                v = (uint64_t)unzigzag(v);
+                break;
+            case logdetail::ARG_DBL:
+                if (end - p < 8)
+                {
+                    ok = false;
+                    break;
+                }
+                for (int b = 0; b < 8; b++)
+                    v |= (uint64_t)p[b] << (8 * b);
+                p += 8;
+                break;
+            case logdetail::ARG_PTR:
+                ok = getVarint(p, end, v);
+                break;
+            case logdetail::ARG_STR:
+            {
+                uint64_t n;
+                ok = getVarint(p, end, n) && n <= (uint64_t)(end - p) &&
+                     r.str_used + n <= (uint64_t)logdetail::STR_BYTES;
+                if (!ok)
+                    break;
+                memcpy(r.strs + r.str_used, p, n);
+                v = ((uint64_t)r.str_used << 16) | n;
+                r.str_used += (uint16_t)n;
+                p += n;
+                break;
+            }
+            default:
+                ok = false;
+            }
+            if (ok)
+            {
+                r.types[r.nargs] = t;
+                r.vals[r.nargs] = v;
+                r.nargs++;
+            }
+        }
+        if (!ok)
+            return corrupt(p, start);
+        fmt_id = (uint32_t)id;
+        return RECORD;
+    }
+    return END;
+}
+
+} // namespace logfmt
@@ -0,0 +1,94 @@
+#ifndef UTILS_LOGFORMAT_H
+#define UTILS_LOGFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils/logger.h"
+
+/*
+    Log record rendering and the binary log format, shared by the logger's
+    writer thread and tools/vpn_logdecode.cpp.
+
+    Binary log (VPN_LOG_FORMAT=binary, file only):
+
+        magic    "VPNBLOG1"                      starts every writer session
+        FORMAT   0x01 id:varint len:varint bytes  first use of a format string
+        RECORD   0x02 id:varint level:u8 dt:svarint nargs:u8 args...
+
+    Format ids are assigned by the writer in order of first use and are
+    valid until the next magic. dt is nanoseconds since the previous
+    RECORD of the session (the first one is absolute unix time). Each
+    argument is a type byte (logdetail::ArgType) followed by:
+
+        ARG_INT  svarint (zigzag)
+        ARG_DBL  8 bytes, little endian IEEE-754
+        ARG_PTR  varint
+        ARG_STR  len:varint bytes
+
+    Nothing is formatted when the record is written; the decoder
+    renders it with the same formatMessage() the text mode uses.
+*/
+
+namespace logfmt
+{
+
+/// printf-style rendering of a record's message. Returns the length.
+size_t formatMessage(const logdetail::Record &r, char *out, size_t cap);
+
+/// "[ERR] ", "[WRN] ", "[INF] " or "[DBG] "
+const char *levelTag(int lvl);
+
+/// "HH:MM:SS [LVL] message" without the newline. Returns the length.
+size_t formatLine(const logdetail::Record &r, char *out, size_t cap);
+
+constexpr char BLOG_MAGIC[8] = {'V', 'P', 'N', 'B', 'L', 'O', 'G', '1'};
+
+enum BlogKind : uint8_t
+{
+    BLOG_FORMAT = 1,
+    BLOG_RECORD = 2
+};
+
+/// Upper bound of an encoded RECORD (format strings are not included).
+constexpr size_t BLOG_MAX_RECORD = 16 + logdetail::MAX_ARGS * 11 + logdetail::STR_BYTES;
+
+size_t encodeFormat(uint32_t id, const char *fmt, uint8_t *out, size_t cap);
+
+/// `prev_ns` is the previous record's timestamp (0 at session start); updated.
+size_t encodeRecord(uint32_t id, const logdetail::Record &r, int64_t &prev_ns, uint8_t *out);
+
+/**
+ * @brief Streaming decoder for the binary log.
+ */
+class BlogDecoder
+{
+public:
+    enum Result
+    {
+        END,     ///< Clean end of input
+        RECORD,  ///< `r` holds a record; r.fmt points into the dictionary
+        CORRUPT  ///< Truncated or malformed input at `p`
+    };
+
+    /// Decodes up to the next RECORD, consuming magics and FORMATs on the way.
+    Result next(const uint8_t *&p, const uint8_t *end, logdetail::Record &r, uint32_t &fmt_id);
+
+    /// Format string of `id` in the current session, or nullptr.
+    const char *format(uint32_t id) const;
+    size_t formatCount() const { return dict_.size(); }
+
+    /// Number of writer sessions (magics) seen so far.
+    uint32_t session() const { return session_; }
+
+private:
+    std::vector<std::string> dict_;
+    uint32_t session_ = 0;
+    int64_t prev_ns_ = 0;
+};
+
+} // namespace logfmt
+
+#endif // UTILS_LOGFORMAT_H
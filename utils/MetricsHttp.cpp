@@ -0,0 +1,333 @@
+#include "MetricsHttp.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+
+static constexpr int POLL_MS = 200;           // how quickly stop() is noticed
+static constexpr int CLIENT_TIMEOUT_SEC = 2;  // slow scrapers are cut off
+
+/* ---------- ClientMetricsBoard ---------- */
+
+bool ClientMetricsBoard::tryPublish(std::vector<ClientMetrics> &rows)
+{
+    std::unique_lock<std::mutex> lk(mu_, std::try_to_lock);
+    if (!lk.owns_lock())
+        return false;
+    rows_.swap(rows);
+    return true;
+}
+
+void ClientMetricsBoard::copy(std::vector<ClientMetrics> &out)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    out.assign(rows_.begin(), rows_.end());
+}
+
+/* ---------- rendering ---------- */
+
+static void appendf(std::string &out, const char *fmt, ...)
+{
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out.append(line, std::min<size_t>((size_t)n, sizeof(line) - 1));
+}
+
+#if ENABLE_PROFILING
+// Exported with one bucket per power of two, so the bucket set is the
+// same on every scrape. The log-linear buckets nest exactly inside them.
+static void appendHistogram(std::string &out, const char *name,
+                            uint64_t sum, const HistogramSnapshot &h)
+{
+    appendf(out, "# TYPE vpn_%s histogram\n", name);
+    uint64_t cum = 0;
+    int idx = 0;
+    for (int e = HIST_SUB_BITS; e <= HIST_MAX_EXP; e++)
+    {
+        int end = (e - HIST_SUB_BITS + 1) * HIST_SUB; // first index of 2^e
+        for (; idx < end && idx < HIST_BUCKETS; idx++)
+            cum += h.counts[idx];
+        appendf(out, "vpn_%s_bucket{le=\"%lu\"} %lu\n", name, (1UL << e) - 1, cum);
+    }
+    for (; idx < HIST_BUCKETS; idx++)
+        cum += h.counts[idx];
+    appendf(out, "vpn_%s_bucket{le=\"+Inf\"} %lu\n", name, cum);
+    appendf(out, "vpn_%s_count %lu\n", name, cum);
+    appendf(out, "vpn_%s_sum %lu\n", name, sum);
+}
+#endif
+
+static void appendClientFamily(std::string &out, const std::vector<ClientMetrics> &rows,
+                               const char *name, const char *type,
+                               uint64_t (*value)(const ClientMetrics &))
+{
+    bool counter = strcmp(type, "counter") == 0;
+    appendf(out, "# TYPE vpn_client_%s %s\n", name, type);
+    for (const ClientMetrics &c : rows)
+    {
+        in_addr vpn{htonl(c.vpn_ip)};
+        in_addr udp{c.udp_ip};
+        char vpn_s[INET_ADDRSTRLEN], udp_s[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &vpn, vpn_s, sizeof(vpn_s));
+        inet_ntop(AF_INET, &udp, udp_s, sizeof(udp_s));
+        appendf(out, "vpn_client_%s%s{session=\"%u\",vpn_ip=\"%s\",endpoint=\"%s:%u\"} %lu\n",
+                name, counter ? "_total" : "", c.session_id, vpn_s, udp_s,
+                ntohs(c.udp_port), value(c));
+    }
+}
+
+void MetricsHttpServer::render(std::string &out)
+{
+    StatsSnapshot s = StatsSnapshot::collect();
+    clients_.copy(scrape_rows_);
+
+    out.clear();
+#define X(name)                                       \
+    appendf(out, "# TYPE vpn_" #name " counter\n");   \
+    appendf(out, "vpn_" #name "_total %lu\n", s.name);
+    STATS_COUNTERS(X)
+#undef X
+
+#if ENABLE_PROFILING
+#define X(name) appendHistogram(out, #name, s.name, s.name##_hist);
+    STATS_CYCLE_COUNTERS(X)
+#undef X
+#endif
+
+    appendf(out, "# TYPE vpn_clients gauge\nvpn_clients %zu\n", scrape_rows_.size());
+    appendClientFamily(out, scrape_rows_, "rx_pkts", "counter",
+                       [](const ClientMetrics &c) { return c.rx_pkts; });
+    appendClientFamily(out, scrape_rows_, "rx_bytes", "counter",
+                       [](const ClientMetrics &c) { return c.rx_bytes; });
+    appendClientFamily(out, scrape_rows_, "tx_pkts", "counter",
+                       [](const ClientMetrics &c) { return c.tx_pkts; });
+    appendClientFamily(out, scrape_rows_, "tx_bytes", "counter",
+                       [](const ClientMetrics &c) { return c.tx_bytes; });
+    appendClientFamily(out, scrape_rows_, "drops", "counter",
+                       [](const ClientMetrics &c) { return c.drops; });
+    appendClientFamily(out, scrape_rows_, "rx_seq_highest", "gauge",
+                       [](const ClientMetrics &c) { return c.rx_seq_top; });
+    appendClientFamily(out, scrape_rows_, "path_mtu", "gauge",
+                       [](const ClientMetrics &c) { return (uint64_t)c.path_mtu; });
+    appendClientFamily(out, scrape_rows_, "last_seen_seconds", "gauge",
+                       [](const ClientMetrics &c) { return (uint64_t)c.last_seen; });
+    appendClientFamily(out, scrape_rows_, "last_roam_seconds", "gauge",
+                       [](const ClientMetrics &c) { return (uint64_t)c.last_roam; });
+    out += "# EOF\n";
+}
+
+/* ---------- server ---------- */
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+    stop();
+}
+
+static bool isLoopback(const in_addr &a)
+{
+    return (ntohl(a.s_addr) >> 24) == 127;
+}
+
+bool MetricsHttpServer::listenOn(const char *spec)
+{
+    int fd;
+    if (strncmp(spec, "unix:", 5) == 0)
+    {
+        sockaddr_un sun{};
+        sun.sun_family = AF_UNIX;
+        const char *path = spec + 5;
+        if (!*path || strlen(path) >= sizeof(sun.sun_path))
+            return false;
+        strcpy(sun.sun_path, path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        unlink(path); // stale socket from a previous run
+        if (bind(fd, (sockaddr *)&sun, sizeof(sun)) < 0)
+        {
+            close(fd);
+            return false;
+        }
+        unix_path_ = path;
+    }
+    else
+    {
+        char host[64];
+        const char *colon = strrchr(spec, ':');
+        if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host))
+            return false;
+        memcpy(host, spec, colon - spec);
+        host[colon - spec] = '\0';
+
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t)atoi(colon + 1));
+        if (strcmp(host, "localhost") == 0)
+            strcpy(host, "127.0.0.1");
+        if (inet_pton(AF_INET, host, &sin.sin_addr) != 1)
+            return false;
+        if (!isLoopback(sin.sin_addr))
+        {
+            LOG(LOG_ERROR, "Metrics endpoint must be loopback or unix:, got %s", spec);
+            errno = EINVAL;
+            return false;
+        }
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (sockaddr *)&sin, sizeof(sin)) < 0)
+        {
+            close(fd);
+            return false;
+        }
+    }
+
+    if (listen(fd, 8) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    return true;
+}
+
+bool MetricsHttpServer::start()
+{
+    const char *spec = getenv("VPN_METRICS_LISTEN");
+    if (!spec || !*spec)
+        return true; // not configured
+
+    if (!listenOn(spec))
+    {
+        LOG(LOG_ERROR, "Could not listen for metrics on %s: %s", spec, strerror(errno));
+        return false;
+    }
+    LOG(LOG_INFO, "Metrics endpoint listening on %s", spec);
+
+    stop_ = false;
+    thread_ = std::thread(&MetricsHttpServer::run, this);
+    return true;
+}
+
+void MetricsHttpServer::stop()
+{
+    stop_ = true;
+    if (thread_.joinable())
+        thread_.join();
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    if (!unix_path_.empty())
+    {
+        unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+}
+
+void MetricsHttpServer::run()
+{
+    while (!stop_)
+    {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        int r = poll(&pfd, 1, POLL_MS);
+        if (r <= 0)
+            continue;
+
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        timeval tv{CLIENT_TIMEOUT_SEC, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        serve(fd);
+        close(fd);
+    }
+}
+
+static void sendAll(int fd, const char *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+void MetricsHttpServer::serve(int fd)
+{
+    // Only the request line matters; read until the end of the headers
+    char req[2048];
+    size_t got = 0;
+    while (got < sizeof(req) - 1)
+    {
+        ssize_t n = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0)
+            return;
+        got += (size_t)n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+            break;
+    }
+
+    bool is_get = strncmp(req, "GET ", 4) == 0;
+    const char *path = req + 4;
+    size_t path_len = is_get ? strcspn(path, " ?\r\n") : 0;
+    bool found = path_len == 8 && strncmp(path, "/metrics", 8) == 0;
+    if (is_get && path_len == 1 && path[0] == '/')
+        found = true;
+
+    std::string body;
+    const char *status;
+    const char *ctype = "text/plain; charset=utf-8";
+    if (!is_get)
+    {
+        status = "405 Method Not Allowed";
+        body = "only GET is supported\n";
+    }
+    else if (!found)
+    {
+        status = "404 Not Found";
+        body = "try /metrics\n";
+    }
+    else
+    {
+        status = "200 OK";
+        ctype = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+        render(body);
+    }
+
+    char head[256];
+    int hn = snprintf(head, sizeof(head),
+                      "HTTP/1.1 %s\r\n"
+                      "Content-Type: %s\r\n"
+                      "Content-Length: %zu\r\n"
+                      "Connection: close\r\n\r\n",
+                      status, ctype, body.size());
+    sendAll(fd, head, (size_t)hn);
+    sendAll(fd, body.data(), body.size());
+}
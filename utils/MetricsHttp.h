@@ -0,0 +1,103 @@
+#ifndef UTILS_METRICSHTTP_H
+#define UTILS_METRICSHTTP_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    OpenMetrics (Prometheus) scrape endpoint.
+
+    A dedicated thread accepts one connection at a time on a loopback TCP
+    port or a unix socket and answers GET /metrics. Every scrape renders
+    from copies only:
+
+      - global counters and histograms: StatsSnapshot::collect(), the same
+        relaxed reads the stats reporter does
+      - per-client rows: a ClientMetricsBoard the data thread refreshes
+        once per maintenance tick with try_lock, so it never waits on a
+        scrape
+
+    Enabled by VPN_METRICS_LISTEN, e.g. "127.0.0.1:9477" or
+    "unix:/run/cpp_vpn_metrics.sock". Non-loopback addresses are refused.
+
+        curl -s http://127.0.0.1:9477/metrics
+        curl -s --unix-socket /run/cpp_vpn_metrics.sock http://x/metrics
+*/
+
+/**
+ * @brief One client's row in the scrape output (plain copy).
+ */
+struct ClientMetrics
+{
+    uint32_t session_id;
+    uint32_t vpn_ip;   ///< Host order
+    uint32_t udp_ip;   ///< Network order
+    uint16_t udp_port; ///< Network order
+    uint16_t path_mtu;
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+    uint64_t drops;
+    uint64_t rx_seq_top;  ///< Highest sequence number received
+    time_t last_seen;
+    time_t last_roam;     ///< 0 = never roamed
+};
+
+/**
+ * @brief Hand-off of per-client rows from the data thread to the scraper.
+ */
+class ClientMetricsBoard
+{
+public:
+    /**
+     * @brief Swaps `rows` in if the scraper is not copying right now.
+     *
+     * Never blocks. On success `rows` holds the previous buffer, so
+     * steady-state publishing does not allocate.
+     */
+    bool tryPublish(std::vector<ClientMetrics> &rows);
+
+    /// Copies the latest rows (scraper side).
+    void copy(std::vector<ClientMetrics> &out);
+
+private:
+    std::mutex mu_;
+    std::vector<ClientMetrics> rows_;
+};
+
+class MetricsHttpServer
+{
+public:
+    MetricsHttpServer() = default;
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer &) = delete;
+    MetricsHttpServer &operator=(const MetricsHttpServer &) = delete;
+
+    /// Starts listening if VPN_METRICS_LISTEN is set. Returns false on error.
+    bool start();
+    void stop(); ///< Joins the thread; safe to call twice
+
+    ClientMetricsBoard &clients() { return clients_; }
+
+private:
+    bool listenOn(const char *spec);
+    void run();
+    void serve(int fd);
+    void render(std::string &out);
+
+    int listen_fd_ = -1;
+    std::string unix_path_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    ClientMetricsBoard clients_;
+    std::vector<ClientMetrics> scrape_rows_; ///< Scraper-thread scratch
+};
+
+#endif // UTILS_METRICSHTTP_H
@@ -0,0 +1,235 @@
+#include "MetricsShm.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t unixNowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t alignUp(size_t v, size_t a)
+{
+    return (v + a - 1) & ~(a - 1);
+}
+
+/* ---------- writer ---------- */
+
+// True if the segment behind `fd` belongs to a process that is still
+// running. A segment too short to hold a header, or with no pid yet, is
+// treated as left behind by a crash during open().
+static bool ownerAlive(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MetricsShmHeader))
+        return false;
+    void *p = mmap(nullptr, sizeof(MetricsShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    pid_t pid = (pid_t) static_cast<const MetricsShmHeader *>(p)->pid;
+    munmap(p, sizeof(MetricsShmHeader));
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+MetricsShmWriter::~MetricsShmWriter()
+{
+    close();
+}
+
+bool MetricsShmWriter::open(const char *name, const char *const *names, uint32_t count)
+{
+    close();
+
+    size_t names_off = alignUp(sizeof(MetricsShmHeader), 64);
+    size_t values_off = alignUp(names_off + (size_t)count * METRICS_NAME_LEN, 64);
+    size_t total = values_off + (size_t)count * sizeof(uint64_t);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST)
+    {
+        // Replace a segment left behind by a dead instance, never a live one
+        int old = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+        bool alive = old >= 0 && ownerAlive(old);
+        if (old >= 0)
+            ::close(old);
+        if (alive)
+        {
+            errno = EEXIST;
+            return false;
+        }
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    dev_ = st.st_dev;
+    ino_ = st.st_ino;
+    if (ftruncate(fd, (off_t)total) < 0)
+    {
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+
+    // ftruncate zero-fills: magic and seq start at 0
+    char *base = static_cast<char *>(p);
+    hdr_ = reinterpret_cast<MetricsShmHeader *>(base);
+    values_ = reinterpret_cast<std::atomic<uint64_t> *>(base + values_off);
+    size_ = total;
+    strncpy(name_, name, sizeof(name_) - 1);
+
+    hdr_->version = METRICS_SHM_VERSION;
+    hdr_->name_len = METRICS_NAME_LEN;
+    hdr_->num_counters = count;
+    hdr_->names_offset = (uint32_t)names_off;
+    hdr_->values_offset = (uint32_t)values_off;
+    hdr_->total_size = (uint32_t)total;
+    hdr_->pid = (uint64_t)getpid();
+    hdr_->start_unix_ns = unixNowNs();
+
+    for (uint32_t i = 0; i < count; i++)
+        strncpy(base + names_off + (size_t)i * METRICS_NAME_LEN, names[i], METRICS_NAME_LEN - 1);
+
+    hdr_->magic.store(METRICS_SHM_MAGIC, std::memory_order_release);
+    return true;
+}
+
+void MetricsShmWriter::publish(const uint64_t *values, uint32_t count)
+{
+    if (!hdr_)
+        return;
+    if (count > hdr_->num_counters)
+        count = hdr_->num_counters;
+
+    uint64_t s = hdr_->seq.load(std::memory_order_relaxed);
+    hdr_->seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (uint32_t i = 0; i < count; i++)
+        values_[i].store(values[i], std::memory_order_relaxed);
+    hdr_->publish_unix_ns.store(unixNowNs(), std::memory_order_relaxed);
+    hdr_->publish_count.store(hdr_->publish_count.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+
+    hdr_->seq.store(s + 2, std::memory_order_release);
+}
+
+void MetricsShmWriter::close()
+{
+    if (!hdr_)
+        return;
+    munmap(hdr_, size_);
+    // The name may now point at a newer instance's segment; leave that one
+    int fd = shm_open(name_, O_RDONLY | O_CLOEXEC, 0);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_dev == dev_ && st.st_ino == ino_)
+            shm_unlink(name_);
+        ::close(fd);
+    }
+    hdr_ = nullptr;
+    values_ = nullptr;
+    size_ = 0;
+}
+
+/* ---------- reader ---------- */
+
+MetricsShmReader::~MetricsShmReader()
+{
+    close();
+}
+
+bool MetricsShmReader::open(const char *name)
+{
+    close();
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MetricsShmHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    hdr_ = static_cast<const MetricsShmHeader *>(p);
+    size_ = (size_t)st.st_size;
+
+    if (hdr_->magic.load(std::memory_order_acquire) != METRICS_SHM_MAGIC ||
+        hdr_->version != METRICS_SHM_VERSION ||
+        hdr_->total_size > size_)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MetricsShmReader::close()
+{
+    if (!hdr_)
+        return;
+    munmap(const_cast<MetricsShmHeader *>(hdr_), size_);
+    hdr_ = nullptr;
+    size_ = 0;
+}
+
+const char *MetricsShmReader::name(uint32_t i) const
+{
+    return reinterpret_cast<const char *>(hdr_) + hdr_->names_offset +
+           (size_t)i * hdr_->name_len;
+}
+
+void MetricsShmReader::read(std::vector<uint64_t> &out, uint64_t &publish_ns) const
+{
+    uint32_t n = count();
+    out.resize(n);
+    const std::atomic<uint64_t> *values = reinterpret_cast<const std::atomic<uint64_t> *>(
+        reinterpret_cast<const char *>(hdr_) + hdr_->values_offset);
+
+    while (true)
+    {
+        uint64_t s1 = hdr_->seq.load(std::memory_order_acquire);
+        if (s1 & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = values[i].load(std::memory_order_relaxed);
+        publish_ns = hdr_->publish_unix_ns.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (hdr_->seq.load(std::memory_order_relaxed) == s1)
+            return;
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef UTILS_METRICSSHM_H
+#define UTILS_METRICSSHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+/*
+    Shared-memory metrics segment (POSIX shm, /dev/shm/<name>).
+
+    The stats reporter thread publishes every counter here; external
+    tools (tools/vpn_stats.cpp) map it read-only and poll at any rate.
+    Readers never block or slow the server: the segment is guarded by a
+    seqlock, so a reader that races a publish just retries its copy.
+
+    Layout (all offsets from the start of the segment):
+
+        MetricsShmHeader
+        names   [num_counters][name_len]   NUL-padded, written once
+        values  [num_counters] uint64_t    monotonic, rewritten each publish
+
+    The writer fills in the names before storing `magic`, so a reader
+    that sees the right magic and version also sees a complete table.
+    Adding a field at the end of the header or a new counter does not
+    need a version bump; readers go by the offsets and names.
+*/
+
+constexpr uint32_t METRICS_SHM_MAGIC = 0x4D4E5056; // "VPNM"
+constexpr uint16_t METRICS_SHM_VERSION = 1;
+constexpr uint16_t METRICS_NAME_LEN = 32;
+constexpr const char *METRICS_SHM_DEFAULT_NAME = "/cpp_vpn_metrics";
+
+struct MetricsShmHeader
+{
+    std::atomic<uint32_t> magic;
+    uint16_t version;
+    uint16_t name_len;
+    uint32_t num_counters;
+    uint32_t names_offset;
+    uint32_t values_offset;
+    uint32_t total_size;
+    uint64_t pid;
+    uint64_t start_unix_ns;
+
+    alignas(64) std::atomic<uint64_t> seq; ///< Odd while a publish is in progress
+    std::atomic<uint64_t> publish_unix_ns;
+    std::atomic<uint64_t> publish_count;
+};
+
+/**
+ * @brief Writer side, owned by the stats reporter thread.
+ */
+class MetricsShmWriter
+{
+public:
+    MetricsShmWriter() = default;
+    ~MetricsShmWriter();
+
+    MetricsShmWriter(const MetricsShmWriter &) = delete;
+    MetricsShmWriter &operator=(const MetricsShmWriter &) = delete;
+
+    /**
+     * @brief Creates the segment and writes the names table.
+     *
+     * An existing segment is replaced only if the pid stored in it is no
+     * longer running; a live owner makes this fail with errno EEXIST.
+     *
+     * @return false if shm could not be created; the server runs without it
+     */
+    bool open(const char *name, const char *const *names, uint32_t count);
+
+    /// Publishes `count` values under the seqlock. No-op if not open.
+    void publish(const uint64_t *values, uint32_t count);
+
+    /// Unmaps the segment and unlinks it if the name still refers to ours.
+    void close();
+
+    bool isOpen() const { return hdr_ != nullptr; }
+
+private:
+    MetricsShmHeader *hdr_ = nullptr;
+    std::atomic<uint64_t> *values_ = nullptr;
+    size_t size_ = 0;
+    char name_[64] = {};
+    dev_t dev_ = 0; ///< Identity of our segment, checked before unlinking
+    ino_t ino_ = 0;
+};
+
+/**
+ * @brief Reader side, used by external tools. Maps the segment read-only.
+ */
+class MetricsShmReader
+{
+public:
+    MetricsShmReader() = default;
+    ~MetricsShmReader();
+
+    MetricsShmReader(const MetricsShmReader &) = delete;
+    MetricsShmReader &operator=(const MetricsShmReader &) = delete;
+
+    /// Maps the segment and checks magic / version.
+    bool open(const char *name);
+    void close();
+
+    uint32_t count() const { return hdr_ ? hdr_->num_counters : 0; }
+    const char *name(uint32_t i) const;
+    const MetricsShmHeader *header() const { return hdr_; }
+
+    /**
+     * @brief Copies a consistent set of values (retries while a publish races).
+     * @param publish_ns receives the publish time of the copied values
+     */
+    void read(std::vector<uint64_t> &out, uint64_t &publish_ns) const;
+
+private:
+    const MetricsShmHeader *hdr_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif // UTILS_METRICSSHM_H
@@ -0,0 +1,421 @@
+#include "PacketCapture.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "version.h"
+#include "utils/PcapFormat.h"
+#include "utils/counter_definition.h"
+#include "utils/logger.h"
+
+using namespace pcapfmt;
+
+/* Tunables */
+static constexpr int MAX_SNAPLEN = 2048;
+static constexpr size_t DEFAULT_RING = 4096;
+static constexpr size_t OUT_BUF_SIZE = 256 * 1024;
+static constexpr int WRITER_IDLE_MS = 10;
+
+std::atomic<uint8_t> capdetail::g_points{0};
+
+/* ---------- ring (Vyukov bounded queue, as in the logger) ---------- */
+
+struct alignas(64) Entry
+{
+    std::atomic<uint64_t> seq;
+    int64_t ts_ns;      ///< CLOCK_REALTIME
+    uint32_t peer_ip;   ///< Network order (udp only)
+    uint16_t peer_port; ///< Network order (udp only)
+    uint16_t len;       ///< Original length
+    uint16_t caplen;
+    uint8_t point;
+    uint8_t dir;
+    unsigned char data[MAX_SNAPLEN];
+};
+
+static Entry *g_ring = nullptr;
+static size_t g_ring_mask = 0;
+alignas(64) static std::atomic<uint64_t> g_enqueue_pos{0};
+alignas(64) static uint64_t g_dequeue_pos = 0; // writer thread only
+
+/* ---------- writer state ---------- */
+
+static int g_fd = -1;
+static bool g_pcapng = true;
+static int g_snaplen = MAX_SNAPLEN;
+static uint16_t g_udp_port = 0;
+static unsigned char g_out[OUT_BUF_SIZE];
+static size_t g_out_pos = 0;
+static uint64_t g_written = 0;
+
+static std::thread g_writer;
+static std::mutex g_mu; // writer sleep only, never taken by record()
+static std::condition_variable g_cv;
+static bool g_stop = false;
+
+/* ---------- producers ---------- */
+
+void capdetail::record(CapturePoint point, CaptureDir dir, const void *data, int len,
+                       const sockaddr_in *peer)
+{
+    if (len <= 0)
+        return;
+
+    uint64_t pos = g_enqueue_pos.load(std::memory_order_relaxed);
+    Entry *e;
+    while (true)
+    {
+        e = &g_ring[pos & g_ring_mask];
+        uint64_t seq = e->seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)seq - (int64_t)pos;
+        if (dif == 0)
+        {
+            if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (dif < 0)
+        {
+            // Writer is behind: lose this packet rather than wait
+            STAT_ADD(capture_drops, 1);
+            return;
+        }
+        else
+        {
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    e->ts_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    e->point = point;
+    e->dir = dir;
+    e->len = (uint16_t)std::min(len, 0xFFFF);
+    e->caplen = (uint16_t)std::min(len, g_snaplen);
+    e->peer_ip = peer ? peer->sin_addr.s_addr : 0;
+    e->peer_port = peer ? peer->sin_port : 0;
+    memcpy(e->data, data, e->caplen);
+
+    e->seq.store(pos + 1, std::memory_order_release);
+    STAT_ADD(capture_pkts, 1);
+}
+
+/* ---------- file output (writer thread) ---------- */
+
+static void flushOut()
+{
+    size_t off = 0;
+    while (off < g_out_pos)
+    {
+        ssize_t w = write(g_fd, g_out + off, g_out_pos - off);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_RATELIMITED(LOG_ERROR, "capture write: %s", strerror(errno));
+            break;
+        }
+        off += (size_t)w;
+    }
+    g_out_pos = 0;
+}
+
+static void put(const void *p, size_t n)
+{
+    if (g_out_pos + n > OUT_BUF_SIZE)
+        flushOut();
+    memcpy(g_out + g_out_pos, p, n);
+    g_out_pos += n;
+}
+
+static void put32(uint32_t v)
+{
+    put(&v, 4);
+}
+
+static void putOption(uint16_t code, const void *val, uint16_t len)
+{
+    uint16_t hdr[2] = {code, len};
+    put(hdr, 4);
+    put(val, len);
+    static const uint8_t zeros[4] = {};
+    put(zeros, pad4(len) - len);
+}
+
+static void putEndOfOpt()
+{
+    uint16_t hdr[2] = {OPT_ENDOFOPT, 0};
+    put(hdr, 4);
+}
+
+static void writeIdb(const char *name)
+{
+    uint16_t name_len = (uint16_t)strlen(name);
+    // type, length, link type, snaplen, if_name, if_tsresol, end, length
+    uint32_t len = 16 + (4 + pad4(name_len)) + (4 + 4) + 4 + 4;
+    put32(BLOCK_IDB);
+    put32(len);
+    uint16_t lt[2] = {LINKTYPE_RAW, 0};
+    put(lt, 4);
+    put32((uint32_t)g_snaplen + OUTER_HEADER);
+    putOption(OPT_IF_NAME, name, name_len);
+    uint8_t tsresol = 9; // nanoseconds
+    putOption(OPT_IF_TSRESOL, &tsresol, 1);
+    putEndOfOpt();
+    put32(len);
+}
+
+static void writeFileHeader()
+{
+    if (!g_pcapng)
+    {
+        PcapFileHeader h{PCAP_MAGIC_NS, 2, 4, 0, 0, (uint32_t)g_snaplen + OUTER_HEADER,
+                         LINKTYPE_RAW};
+        put(&h, sizeof(h));
+        return;
+    }
+
+    char appl[64];
+    int appl_len = snprintf(appl, sizeof(appl), "vpn_server %d.%d build %d",
+                            PROJECT_VERSION_MAJOR, PROJECT_VERSION_MINOR, PROJECT_BUILD_NUMBER);
+    // type, length, byte order, version, section length, shb_userappl, end, length
+    uint32_t len = 24 + (4 + pad4((uint32_t)appl_len)) + 4 + 4;
+    put32(BLOCK_SHB);
+    put32(len);
+    put32(BYTE_ORDER_MAGIC);
+    uint16_t version[2] = {1, 0};
+    put(version, 4);
+    int64_t section_len = -1; // not known in advance
+    put(&section_len, 8);
+    putOption(OPT_SHB_USERAPPL, appl, (uint16_t)appl_len);
+    putEndOfOpt();
+    put32(len);
+
+    writeIdb("udp");
+    writeIdb("tun");
+}
+
+// Minimal IPv4 + UDP header around an outer datagram, so tools decode it
+static void outerHeader(const Entry &e, uint8_t *h)
+{
+    memset(h, 0, OUTER_HEADER);
+    uint16_t total = (uint16_t)std::min<uint32_t>((uint32_t)e.len + OUTER_HEADER, 0xFFFF);
+    h[0] = 0x45;
+    h[2] = (uint8_t)(total >> 8);
+    h[3] = (uint8_t)total;
+    h[8] = 64;
+    h[9] = 17;
+    uint16_t server_port = htons(g_udp_port);
+    // Client on the left for inbound, on the right for outbound
+    if (e.dir == CAP_IN)
+    {
+        memcpy(h + 12, &e.peer_ip, 4);
+        memcpy(h + 20, &e.peer_port, 2);
+        memcpy(h + 22, &server_port, 2);
+    }
+    else
+    {
+        memcpy(h + 16, &e.peer_ip, 4);
+        memcpy(h + 20, &server_port, 2);
+        memcpy(h + 22, &e.peer_port, 2);
+    }
+    uint16_t udp_len = (uint16_t)(total - 20);
+    h[24] = (uint8_t)(udp_len >> 8);
+    h[25] = (uint8_t)udp_len;
+
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2)
+        sum += (uint32_t)((h[i] << 8) | h[i + 1]);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    h[10] = (uint8_t)(~sum >> 8);
+    h[11] = (uint8_t)~sum;
+}
+
+static void writeEntry(const Entry &e)
+{
+    uint8_t outer[OUTER_HEADER];
+    uint32_t prefix = 0;
+    if (e.point == CAP_UDP)
+    {
+        outerHeader(e, outer);
+        prefix = OUTER_HEADER;
+    }
+    uint32_t caplen = prefix + e.caplen;
+    uint32_t origlen = prefix + e.len;
+    // type, length, fixed part, data, epb_flags, end, length
+    uint32_t block_len = 8 + sizeof(EpbFixed) + pad4(caplen) + (4 + 4) + 4 + 4;
+    static const uint8_t zeros[4] = {};
+
+    if (!g_pcapng)
+    {
+        PcapRecordHeader r{(uint32_t)(e.ts_ns / 1000000000LL),
+                           (uint32_t)(e.ts_ns % 1000000000LL), caplen, origlen};
+        put(&r, sizeof(r));
+    }
+    else
+    {
+        put32(BLOCK_EPB);
+        put32(block_len);
+        EpbFixed f{e.point == CAP_UDP ? IFACE_UDP : IFACE_TUN,
+                   (uint32_t)((uint64_t)e.ts_ns >> 32), (uint32_t)e.ts_ns, caplen, origlen};
+        put(&f, sizeof(f));
+    }
+    if (prefix)
+        put(outer, prefix);
+    put(e.data, e.caplen);
+    if (g_pcapng)
+    {
+        put(zeros, pad4(caplen) - caplen);
+        uint32_t flags = e.dir == CAP_IN ? EPB_INBOUND : EPB_OUTBOUND;
+        putOption(OPT_EPB_FLAGS, &flags, 4);
+        putEndOfOpt();
+        put32(block_len);
+    }
+}
+
+// Writes everything committed so far. Returns the number of packets.
+static size_t drain()
+{
+    size_t count = 0;
+    while (true)
+    {
+        Entry &e = g_ring[g_dequeue_pos & g_ring_mask];
+        if (e.seq.load(std::memory_order_acquire) != g_dequeue_pos + 1)
+            break; // empty, or the next producer has not committed yet
+
+        writeEntry(e);
+
+        e.seq.store(g_dequeue_pos + g_ring_mask + 1, std::memory_order_release);
+        g_dequeue_pos++;
+        count++;
+    }
+    return count;
+}
+
+static void writer_main()
+{
+    while (true)
+    {
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lk(g_mu);
+            stopping = g_stop;
+        }
+        size_t n = drain();
+        g_written += n;
+        if (n)
+            flushOut();
+        if (stopping && n == 0)
+            break;
+        if (n == 0)
+        {
+            std::unique_lock<std::mutex> lk(g_mu);
+            g_cv.wait_for(lk, std::chrono::milliseconds(WRITER_IDLE_MS), [] { return g_stop; });
+        }
+    }
+    flushOut();
+}
+
+/* ---------- public API ---------- */
+
+void capture_start(uint16_t udp_port)
+{
+    const char *path = getenv("VPN_CAPTURE_FILE");
+    if (!path || !*path || g_fd >= 0)
+        return;
+
+    const char *format = getenv("VPN_CAPTURE_FORMAT");
+    g_pcapng = !(format && strcmp(format, "pcap") == 0);
+
+    uint8_t points = CAP_UDP | CAP_TUN;
+    if (const char *what = getenv("VPN_CAPTURE_WHAT"))
+    {
+        if (strcmp(what, "udp") == 0)
+            points = CAP_UDP;
+        else if (strcmp(what, "tun") == 0)
+            points = CAP_TUN;
+    }
+
+    g_snaplen = MAX_SNAPLEN;
+    if (const char *snap = getenv("VPN_CAPTURE_SNAPLEN"))
+    {
+        if (atoi(snap) > 0)
+            g_snaplen = std::min(atoi(snap), MAX_SNAPLEN);
+    }
+
+    size_t slots = DEFAULT_RING;
+    if (const char *ring = getenv("VPN_CAPTURE_RING"))
+    {
+        size_t want = (size_t)strtoul(ring, nullptr, 0);
+        if (want >= 64)
+        {
+            slots = 64;
+            while (slots < want)
+                slots <<= 1;
+        }
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG(LOG_ERROR, "Capture: cannot open %s: %s", path, strerror(errno));
+        return;
+    }
+
+    // Allocated once: a producer that saw capture on may still be writing
+    // into the ring of an earlier session
+    if (!g_ring)
+    {
+        g_ring = new Entry[slots];
+        g_ring_mask = slots - 1;
+    }
+    slots = g_ring_mask + 1;
+    for (size_t i = 0; i < slots; i++)
+        g_ring[i].seq.store(i, std::memory_order_relaxed);
+    g_enqueue_pos.store(0, std::memory_order_relaxed);
+    g_dequeue_pos = 0;
+    g_written = 0;
+    g_udp_port = udp_port;
+    g_fd = fd;
+    g_out_pos = 0;
+    writeFileHeader();
+    g_stop = false;
+    g_writer = std::thread(writer_main);
+
+    capdetail::g_points.store(points, std::memory_order_release);
+    LOG(LOG_INFO, "Capture: writing %s to %s (%s, snaplen %d, ring %zu)",
+        points == (CAP_UDP | CAP_TUN) ? "udp+tun" : points == CAP_UDP ? "udp" : "tun",
+        path, g_pcapng ? "pcapng" : "pcap", g_snaplen, slots);
+}
+
+void capture_stop()
+{
+    if (g_fd < 0)
+        return;
+    // Producers that already passed the check finish on the ring, which
+    // stays allocated; the writer takes whatever they commit before it stops
+    capdetail::g_points.store(0, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lk(g_mu);
+        g_stop = true;
+    }
+    g_cv.notify_all();
+    g_writer.join();
+
+    close(g_fd);
+    g_fd = -1;
+    LOG(LOG_INFO, "Capture: %lu packet(s) written", (unsigned long)g_written);
+}
@@ -0,0 +1,86 @@
+#ifndef UTILS_PACKETCAPTURE_H
+#define UTILS_PACKETCAPTURE_H
+
+#include <atomic>
+#include <cstdint>
+#include <netinet/in.h>
+
+/*
+    Packet capture from the data loop to pcapng / pcap.
+
+    Each captured packet is copied (up to the snap length) into a bounded
+    lock-free ring with its timestamp; a writer thread turns the entries
+    into file blocks. When the ring is full the packet is not captured and
+    capture_drops counts it, so a slow disk never stalls forwarding.
+
+    Two capture points (see utils/PcapFormat.h for the file layout):
+
+        udp  outer datagrams as they are on the wire (still encrypted),
+             behind a synthesized IPv4/UDP header: client address and
+             port <-> 0.0.0.0:<server port>
+        tun  inner IPv4 packets: decrypted packets from clients (inbound,
+             before the TUN write or hairpin) and packets read from the
+             TUN for clients (outbound, before encryption)
+
+    Inbound is always "from a client". tools/vpn_replay feeds a capture
+    back into a server.
+
+    Environment:
+        VPN_CAPTURE_FILE     output path; capture is off when unset
+        VPN_CAPTURE_FORMAT   pcapng (default) or pcap
+        VPN_CAPTURE_WHAT     all (default), udp or tun
+        VPN_CAPTURE_SNAPLEN  bytes kept per packet, default and max 2048
+        VPN_CAPTURE_RING     ring entries, rounded up to a power of two
+                             (default 4096)
+*/
+
+enum CapturePoint : uint8_t
+{
+    CAP_UDP = 1,
+    CAP_TUN = 2
+};
+
+enum CaptureDir : uint8_t
+{
+    CAP_IN = 1, ///< From a client
+    CAP_OUT = 2 ///< To a client
+};
+
+/// Reads VPN_CAPTURE_*, opens the file and starts the writer thread.
+/// `udp_port` is the server port shown in the synthesized outer headers.
+void capture_start(uint16_t udp_port);
+
+/// Writes out what is still queued and closes the file.
+void capture_stop();
+
+namespace capdetail
+{
+/// CapturePoint bits being captured; 0 when capture is off
+extern std::atomic<uint8_t> g_points;
+
+void record(CapturePoint point, CaptureDir dir, const void *data, int len,
+            const sockaddr_in *peer);
+} // namespace capdetail
+
+static inline bool capture_on(CapturePoint point)
+{
+    return __builtin_expect(capdetail::g_points.load(std::memory_order_relaxed) & point, 0);
+}
+
+/// One outer datagram exchanged with `peer`
+#define CAPTURE_UDP(dir, data, len, peer)                                 \
+    do                                                                    \
+    {                                                                     \
+        if (capture_on(CAP_UDP))                                          \
+            capdetail::record(CAP_UDP, (dir), (data), (len), &(peer));    \
+    } while (0)
+
+/// One inner IPv4 packet
+#define CAPTURE_TUN(dir, data, len)                                       \
+    do                                                                    \
+    {                                                                     \
+        if (capture_on(CAP_TUN))                                          \
+            capdetail::record(CAP_TUN, (dir), (data), (len), nullptr);    \
+    } while (0)
+
+#endif // UTILS_PACKETCAPTURE_H
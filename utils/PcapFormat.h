@@ -0,0 +1,98 @@
+#ifndef UTILS_PCAPFORMAT_H
+#define UTILS_PCAPFORMAT_H
+
+#include <cstdint>
+
+/*
+    pcap / pcapng constants shared by the capture writer
+    (utils/PacketCapture.cpp) and tools/vpn_replay.cpp.
+
+    pcapng (default) is one section with two interfaces:
+
+        SHB   section header
+        IDB   interface 0 "udp", LINKTYPE_RAW, if_tsresol 9 (ns)
+        IDB   interface 1 "tun", LINKTYPE_RAW, if_tsresol 9 (ns)
+        EPB*  one per packet, epb_flags = direction
+
+    Classic pcap (VPN_CAPTURE_FORMAT=pcap) is the nanosecond variant
+    (magic a1b23c4d) with LINKTYPE_RAW and no interface or direction.
+
+    All fields are written in host byte order; readers go by the byte
+    order magic.
+*/
+
+namespace pcapfmt
+{
+
+/* Link types */
+constexpr uint16_t LINKTYPE_NULL = 0;     ///< BSD loopback, 4-byte address family
+constexpr uint16_t LINKTYPE_ETHERNET = 1;
+constexpr uint16_t LINKTYPE_RAW = 101;    ///< Bare IPv4 / IPv6
+constexpr uint16_t LINKTYPE_LINUX_SLL = 113;
+constexpr uint16_t LINKTYPE_IPV4 = 228;
+
+/* Classic pcap */
+constexpr uint32_t PCAP_MAGIC_US = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+
+struct PcapFileHeader
+{
+    uint32_t magic;
+    uint16_t version_major; ///< 2
+    uint16_t version_minor; ///< 4
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct PcapRecordHeader
+{
+    uint32_t ts_sec;
+    uint32_t ts_frac; ///< us or ns, by the file magic
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+
+/* pcapng */
+constexpr uint32_t BLOCK_SHB = 0x0A0D0D0A;
+constexpr uint32_t BLOCK_IDB = 0x00000001;
+constexpr uint32_t BLOCK_SPB = 0x00000003;
+constexpr uint32_t BLOCK_EPB = 0x00000006;
+constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+
+constexpr uint16_t OPT_ENDOFOPT = 0;
+constexpr uint16_t OPT_SHB_USERAPPL = 4;
+constexpr uint16_t OPT_IF_NAME = 2;
+constexpr uint16_t OPT_IF_TSRESOL = 9;
+constexpr uint16_t OPT_EPB_FLAGS = 2;
+
+/// Low two bits of epb_flags
+constexpr uint32_t EPB_INBOUND = 1;
+constexpr uint32_t EPB_OUTBOUND = 2;
+
+/// Fixed part of an EPB after the block type and length
+struct EpbFixed
+{
+    uint32_t interface_id;
+    uint32_t ts_high;
+    uint32_t ts_low;
+    uint32_t caplen;
+    uint32_t origlen;
+};
+
+/// Interface ids of our own captures
+constexpr uint32_t IFACE_UDP = 0;
+constexpr uint32_t IFACE_TUN = 1;
+
+/// IPv4 + UDP header the writer puts in front of each outer datagram
+constexpr int OUTER_HEADER = 28;
+
+inline uint32_t pad4(uint32_t n)
+{
+    return (n + 3) & ~3u;
+}
+
+} // namespace pcapfmt
+
+#endif // UTILS_PCAPFORMAT_H
@@ -0,0 +1,230 @@
+#include "StatsReporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "utils/logger.h"
+
+// Same order as the StatsSnapshot fields, so publish() is a plain copy
+static const char *const k_counter_names[] = {
+#define X(name) #name,
+    STATS_ALL_COUNTERS(X)
+#undef X
+};
+static constexpr uint32_t k_num_counters = sizeof(k_counter_names) / sizeof(k_counter_names[0]);
+
+StatsReporter::StatsReporter(int interval_ms, int publish_ms)
+    : interval_ms_(interval_ms), publish_ms_(std::min(publish_ms, interval_ms))
+{
+}
+
+StatsReporter::~StatsReporter()
+{
+    stop();
+}
+
+void StatsReporter::start()
+{
+    const char *log_env = getenv("VPN_STATS_LOG");
+    log_enabled_ = !(log_env && strcmp(log_env, "0") == 0);
+    openShm();
+
+    stop_ = false;
+    thread_ = std::thread(&StatsReporter::run, this);
+}
+
+void StatsReporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+    shm_.close();
+}
+
+void StatsReporter::openShm()
+{
+    const char *name = getenv("VPN_STATS_SHM");
+    if (!name || !*name)
+        name = METRICS_SHM_DEFAULT_NAME;
+    if (strcmp(name, "off") == 0)
+        return;
+
+    if (shm_.open(name, k_counter_names, k_num_counters))
+        LOG(LOG_INFO, "Metrics published in shm %s (%u counters)", name, k_num_counters);
+    else if (errno == EEXIST)
+        LOG(LOG_WARN, "Metrics shm %s is owned by another running process; "
+            "set VPN_STATS_SHM to publish under a different name", name);
+    else
+        LOG(LOG_WARN, "Could not create metrics shm %s: %s", name, strerror(errno));
+}
+
+void StatsReporter::publish(const StatsSnapshot &s)
+{
+    uint64_t values[k_num_counters];
+    uint32_t i = 0;
+#define X(name) values[i++] = s.name;
+    STATS_ALL_COUNTERS(X)
+#undef X
+    shm_.publish(values, i);
+}
+
+void StatsReporter::run()
+{
+    using clock = std::chrono::steady_clock;
+
+    StatsSnapshot prev = StatsSnapshot::collect();
+    clock::time_point prev_t = clock::now();
+    publish(prev);
+
+    std::unique_lock<std::mutex> lk(mu_);
+    while (!stop_)
+    {
+        cv_.wait_for(lk, std::chrono::milliseconds(publish_ms_), [this] { return stop_; });
+        if (stop_)
+            break;
+
+        StatsSnapshot cur = StatsSnapshot::collect();
+        publish(cur);
+
+        clock::time_point now = clock::now();
+        if (now - prev_t < std::chrono::milliseconds(interval_ms_))
+            continue;
+
+        double seconds = std::chrono::duration<double>(now - prev_t).count();
+        if (log_enabled_)
+            report(cur - prev, seconds);
+
+        prev = cur;
+        prev_t = now;
+    }
+}
+
+static inline double perPkt(uint64_t cycles, uint64_t pkts)
+{
+    return pkts ? (double)cycles / pkts : 0.0;
+}
+
+#if ENABLE_PROFILING
+static void logLatency(const char *name, const HistogramSnapshot &h)
+{
+    uint64_t n = h.total();
+    if (n == 0)
+        return;
+    LOG(LOG_INFO, "Latency (cycles) %s: n=%lu p50=%lu p99=%lu p99.9=%lu max=%lu",
+        name, n, h.percentile(50), h.percentile(99), h.percentile(99.9), h.max());
+}
+#endif
+
+void StatsReporter::report(const StatsSnapshot &d, double seconds)
+{
+    if (seconds <= 0)
+        seconds = 1;
+
+    // ---- Mbps ----
+    double udp_mbps = (static_cast<double>(d.udp_rx_bytes) * 8.0) / (seconds * 1000000.0);
+    max_udp_mbps_ = std::max(max_udp_mbps_, udp_mbps);
+    if (d.udp_rx_pkts > 0)
+    { // Only track min when there is actually traffic
+        min_udp_mbps_ = (min_udp_mbps_ < 0) ? udp_mbps : std::min(min_udp_mbps_, udp_mbps);
+    }
+
+    double tun_mbps = (static_cast<double>(d.tun_tx_bytes) * 8.0) / (seconds * 1000000.0);
+    max_tun_mbps_ = std::max(max_tun_mbps_, tun_mbps);
+    if (d.tun_tx_pkts > 0)
+    {
+        min_tun_mbps_ = (min_tun_mbps_ < 0) ? tun_mbps : std::min(min_tun_mbps_, tun_mbps);
+    }
+
+    // ---- Batching efficiency ----
+    double avg_pkts_per_rx_batch = 0.0;
+    double avg_pkts_per_tx_batch = 0.0;
+    double avg_rx_batch_size = 0.0;
+    double avg_tx_batch_size = 0.0;
+    if (d.udp_rx_batches > 0)
+    {
+        avg_pkts_per_rx_batch = static_cast<double>(d.udp_rx_pkts) / d.udp_rx_batches;
+        max_avg_pkts_per_rx_batch_ = std::max(max_avg_pkts_per_rx_batch_, avg_pkts_per_rx_batch);
+        avg_rx_batch_size = static_cast<double>(d.udp_rx_batch_limit) / d.udp_rx_batches;
+    }
+    if (d.udp_tx_batches > 0)
+    {
+        avg_pkts_per_tx_batch = static_cast<double>(d.udp_tx_pkts) / d.udp_tx_batches;
+        max_avg_pkts_per_tx_batch_ = std::max(max_avg_pkts_per_tx_batch_, avg_pkts_per_tx_batch);
+        avg_tx_batch_size = static_cast<double>(d.udp_tx_batch_limit) / d.udp_tx_batches;
+    }
+
+    double loop_ns = (double)(d.loop_work_ns + d.loop_poll_ns + d.loop_wait_ns);
+    auto loopPct = [&](uint64_t ns) { return loop_ns > 0 ? 100.0 * ns / loop_ns : 0.0; };
+
+    double compress_ratio =
+        d.compress_out_bytes ? (double)d.compress_in_bytes / d.compress_out_bytes : 0;
+
+    // ---- Always print functional stats ----
+    LOG(LOG_INFO,
+        "---- Stats (last %ld sec) ----\n"
+        "UDP RX: %lu pkts, %lu bytes, %.2f Mbps (max: %.2f, min: %.2f)\n"
+        "TUN TX: %lu pkts, %lu bytes, %.2f Mbps (max: %.2f, min: %.2f)\n"
+        "Handshake pkts: %lu, failures: %lu, control queue drops: %lu\n"
+        "Drops - TUN RX: %lu, UDP TX: %lu, UDP RX: %lu, Replay: %lu, Log: %lu\n"
+        "EAGAIN - TUN read: %lu, UDP recv: %lu\n"
+        "FEC - repair TX: %lu, repair RX: %lu, recovered: %lu\n"
+        "Compression - in: %lu bytes, out: %lu bytes, ratio: %.2f, skipped: %lu, errors: %lu\n"
+        "PMTU - probes: %lu, acks: %lu, MSS clamped: %lu\n"
+        "Hairpin pkts: %lu\n"
+        "TX queue - queued: %lu, TUN reads throttled: %lu\n"
+        "Loop - work: %.1f%%, busy poll: %.1f%%, blocked: %.1f%%\n"
+        "UDP RX batches: %lu, avg pkts/batch: %.2f (max avg: %.2f), avg batch size: %.1f\n"
+        "UDP TX batches: %lu, avg pkts/batch: %.2f (max avg: %.2f), avg batch size: %.1f, "
+        "latency flushes: %lu\n",
+        (long)(seconds + 0.5),
+        d.udp_rx_pkts, d.udp_rx_bytes, udp_mbps, max_udp_mbps_,
+        (min_udp_mbps_ < 0 ? 0 : min_udp_mbps_),
+        d.tun_tx_pkts, d.tun_tx_bytes, tun_mbps, max_tun_mbps_,
+        (min_tun_mbps_ < 0 ? 0 : min_tun_mbps_),
+        d.handshake_pkts, d.handshake_failures, d.ctrl_drops,
+        d.tun_rx_drops, d.udp_tx_drops, d.udp_rx_drops, d.replay_drops, d.log_drops,
+        d.tun_read_eagain, d.udp_recv_eagain,
+        d.fec_repair_tx, d.fec_repair_rx, d.fec_recovered,
+        d.compress_in_bytes, d.compress_out_bytes, compress_ratio,
+        d.compress_skipped, d.decompress_errors,
+        d.pmtu_probes_tx, d.pmtu_acks_rx, d.mss_clamped,
+        d.hairpin_pkts,
+        d.udp_tx_queued, d.tun_rx_throttled,
+        loopPct(d.loop_work_ns), loopPct(d.loop_poll_ns), loopPct(d.loop_wait_ns),
+        d.udp_rx_batches, avg_pkts_per_rx_batch, max_avg_pkts_per_rx_batch_, avg_rx_batch_size,
+        d.udp_tx_batches, avg_pkts_per_tx_batch, max_avg_pkts_per_tx_batch_, avg_tx_batch_size,
+        d.udp_tx_latency_flushes);
+
+#if ENABLE_PROFILING
+    // ---- Profiling-only stats ----
+    LOG(LOG_INFO,
+        "Enc cycles/pkt: %.2f, Dec cycles/pkt: %.2f\n"
+        "Lookup cycles/pkt: %.2f, RX userspace cycles/pkt: %.2f\n"
+        "RX syscall cycles/pkt: %.2f, TX syscall cycles/pkt: %.2f, TUN write cycles/pkt: %.2f, TUN read cycles/pkt: %.2f\n"
+        "Compress cycles/pkt: %.2f, Decompress cycles/pkt: %.2f\n",
+        perPkt(d.enc_cycles, d.udp_tx_pkts),
+        perPkt(d.dec_cycles, d.udp_rx_pkts),
+        perPkt(d.lookup_cycles, d.udp_rx_pkts),
+        perPkt(d.rx_userspace_cycles, d.udp_rx_pkts),
+        perPkt(d.rx_syscall_cycles, d.udp_rx_pkts),
+        perPkt(d.tx_syscall_cycles, d.udp_tx_pkts),
+        perPkt(d.tun_write_cycles, d.tun_tx_pkts),
+        perPkt(d.tun_read_cycles, d.tun_rx_pkts),
+        // Includes the packets that were tried and then sent uncompressed
+        perPkt(d.compress_cycles, d.tun_rx_pkts),
+        perPkt(d.decompress_cycles, d.decompress_pkts));
+
+    // ---- Tail latency, one line per stage that saw samples ----
+#define X(name) logLatency(#name, d.name##_hist);
+    STATS_CYCLE_COUNTERS(X)
+#undef X
+#endif
+
+    log_flush();
+}
@@ -0,0 +1,62 @@
+#ifndef UTILS_STATSREPORTER_H
+#define UTILS_STATSREPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "utils/counter_definition.h"
+#include "utils/MetricsShm.h"
+
+/**
+ * @brief Background thread that publishes the per-thread counters.
+ *
+ * Every publish interval it collects a StatsSnapshot and copies the raw
+ * counters into the shared-memory segment (utils/MetricsShm.h). Every
+ * log interval it also diffs against the previous logged snapshot and
+ * writes the "---- Stats" block. The data plane never formats, resets
+ * or locks anything for stats.
+ *
+ * Environment:
+ *   VPN_STATS_SHM  segment name (default /cpp_vpn_metrics), "off" disables
+ *   VPN_STATS_LOG  "0" disables the text block (shm only)
+ */
+class StatsReporter
+{
+public:
+    explicit StatsReporter(int interval_ms = 1000, int publish_ms = 100);
+    ~StatsReporter();
+
+    StatsReporter(const StatsReporter &) = delete;
+    StatsReporter &operator=(const StatsReporter &) = delete;
+
+    void start();
+    void stop(); ///< Joins the thread; safe to call twice
+
+private:
+    void run();
+    void report(const StatsSnapshot &d, double seconds);
+
+    void openShm();
+    void publish(const StatsSnapshot &s);
+
+    int interval_ms_;
+    int publish_ms_;
+    bool log_enabled_ = true;
+    MetricsShmWriter shm_;
+    std::thread thread_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    // Min / Max tracking across intervals
+    double max_udp_mbps_ = 0.0;
+    double min_udp_mbps_ = -1.0; // -1 = no traffic seen yet
+    double max_tun_mbps_ = 0.0;
+    double min_tun_mbps_ = -1.0;
+    double max_avg_pkts_per_rx_batch_ = 0.0;
+    double max_avg_pkts_per_tx_batch_ = 0.0;
+};
+
+#endif // UTILS_STATSREPORTER_H
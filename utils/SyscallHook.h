@@ -0,0 +1,77 @@
+#ifndef UTILS_SYSCALLHOOK_H
+#define UTILS_SYSCALLHOOK_H
+
+#include <stdint.h>
+
+/*
+    Shared-memory layout of the LD_PRELOAD syscall hook (perf_hook_full.c),
+    read by tools/vpn_syscalls.cpp. Plain C so both sides can include it.
+
+        LD_PRELOAD=./libperf_hook_full.so ./vpn_server
+
+    Every interposed call records its latency (ns) and an item count into
+    log-linear histograms with the same buckets as utils/Histogram.h:
+
+        recvmmsg / sendmmsg   messages per call
+        read / write          bytes per call
+        select / epoll_wait   ready descriptors per call (latency includes
+                              the time spent blocked)
+
+    Counters are monotonic and only ever incremented, so readers need no
+    lock; they sum the shards and diff two reads for rates. Each thread
+    owns one shard (plain stores, no locked instructions) until the shards
+    run out; later threads share the last one with atomic adds.
+
+    Environment (server side): VPN_HOOK_SHM segment name, "off" disables.
+*/
+
+#define SYSCALL_HOOK_MAGIC 0x4B4E5056u /* "VPNK" */
+#define SYSCALL_HOOK_VERSION 1
+#define SYSCALL_HOOK_DEFAULT_NAME "/cpp_vpn_syscalls"
+
+#define SYSCALL_HOOK_SHARDS 8
+#define SYSCALL_HOOK_SUB_BITS 4  /* == HIST_SUB_BITS */
+#define SYSCALL_HOOK_MAX_EXP 40  /* == HIST_MAX_EXP */
+#define SYSCALL_HOOK_BUCKETS ((SYSCALL_HOOK_MAX_EXP - SYSCALL_HOOK_SUB_BITS + 1) << SYSCALL_HOOK_SUB_BITS)
+
+enum SyscallHookCall
+{
+    HOOK_RECVMMSG,
+    HOOK_SENDMMSG,
+    HOOK_READ,
+    HOOK_WRITE,
+    HOOK_SELECT,
+    HOOK_EPOLL_WAIT,
+    HOOK_CALL_COUNT
+};
+
+struct SyscallHookStats
+{
+    uint64_t calls;
+    uint64_t errors;   /* -1 returns other than EAGAIN / EINTR */
+    uint64_t eagain;   /* EAGAIN, EWOULDBLOCK or EINTR */
+    uint64_t total_ns;
+    uint64_t items;
+    uint64_t lat_hist[SYSCALL_HOOK_BUCKETS];
+    uint64_t items_hist[SYSCALL_HOOK_BUCKETS];
+};
+
+struct SyscallHookShard
+{
+    struct SyscallHookStats call[HOOK_CALL_COUNT];
+};
+
+struct SyscallHookShm
+{
+    uint32_t magic;    /* stored last */
+    uint16_t version;
+    uint16_t num_calls;
+    uint32_t buckets;
+    uint32_t shards;
+    uint64_t pid;
+    uint64_t start_unix_ns;
+    char names[HOOK_CALL_COUNT][16];
+    struct SyscallHookShard shard[SYSCALL_HOOK_SHARDS];
+};
+
+#endif /* UTILS_SYSCALLHOOK_H */
@@ -0,0 +1,252 @@
+#include "Trace.h"
+
+static const char *const k_stage_names[TS_STAGE_COUNT] = {
+    "udp_recv", "udp_pkt", "lookup", "decrypt", "decompress", "tun_write", "fec_repair",
+    "handshake", "tun_read", "tun_pkt", "compress", "encrypt", "udp_send",
+};
+
+const char *traceStageName(int stage)
+{
+    return (stage >= 0 && stage < TS_STAGE_COUNT) ? k_stage_names[stage] : "unknown";
+}
+
+#if ENABLE_TRACING
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/logger.h"
+
+thread_local TraceRing *t_trace_ring = nullptr;
+
+static std::atomic<TraceRing *> g_rings{nullptr}; // never freed: the dumper may be reading
+
+// tsc -> time anchor taken at trace_start(); the rate is measured at dump time
+static uint64_t g_tsc0 = 0;
+static int64_t g_ns0 = 0;
+
+static volatile sig_atomic_t g_dump_requested = 0;
+static std::thread g_dumper;
+static std::mutex g_mu;
+static std::condition_variable g_cv;
+static bool g_stop = false;
+static std::string g_prefix = "vpn_trace";
+static TraceFormat g_format = TRACE_CHROME;
+
+static constexpr int DUMP_POLL_MS = 100;
+
+static int64_t monoNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+TraceRing *trace_attach()
+{
+    TraceRing *r = new TraceRing();
+    r->tid = (int)syscall(SYS_gettid);
+    pthread_getname_np(pthread_self(), r->name, sizeof(r->name));
+
+    r->next = g_rings.load(std::memory_order_relaxed);
+    while (!g_rings.compare_exchange_weak(r->next, r, std::memory_order_release,
+                                          std::memory_order_relaxed))
+        ;
+    t_trace_ring = r;
+    return r;
+}
+
+// Events of `r` that were not overwritten while being copied, oldest first
+static void snapshot(const TraceRing *r, std::vector<TraceEvent> &out)
+{
+    out.clear();
+    uint64_t end = r->head.load(std::memory_order_acquire);
+    uint64_t begin = end > TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+    for (uint64_t i = begin; i < end; i++)
+        out.push_back(r->ev[i & (TRACE_RING_EVENTS - 1)]);
+
+    // The owner may have lapped the oldest slots meanwhile; its in-flight
+    // write (index == head) reuses slot head - TRACE_RING_EVENTS too
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    uint64_t valid = head >= TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS + 1 : 0;
+    if (valid > begin)
+        out.erase(out.begin(), out.begin() + std::min<uint64_t>(valid - begin, out.size()));
+
+    // Spans are recorded when they end; order them by start, parents first
+    std::sort(out.begin(), out.end(), [](const TraceEvent &a, const TraceEvent &b) {
+        return a.tsc != b.tsc ? a.tsc < b.tsc : a.cycles > b.cycles;
+    });
+}
+
+static void writeChrome(FILE *f, const TraceRing *r, const std::vector<TraceEvent> &evs,
+                        double us_per_tsc, bool &first)
+{
+    int pid = (int)getpid();
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+               "\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", pid, r->tid, r->name);
+    first = false;
+    for (const TraceEvent &e : evs)
+    {
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"vpn\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"pid\":%d,\"tid\":%d,\"args\":{\"session\":%u,\"len\":%u}}",
+                traceStageName(e.stage), (double)(e.tsc - g_tsc0) * us_per_tsc,
+                e.cycles * us_per_tsc, pid, r->tid, e.session, e.len);
+    }
+}
+
+struct OpenSpan
+{
+    const TraceEvent *e;
+    uint64_t end;
+    uint64_t child_cycles;
+};
+
+// One sample for the innermost open span, weighted by its self time
+static void writePerfSample(FILE *f, const TraceRing *r, const std::vector<OpenSpan> &stack,
+                            double us_per_tsc)
+{
+    const OpenSpan &top = stack.back();
+    uint64_t self = top.e->cycles > top.child_cycles ? top.e->cycles - top.child_cycles : 0;
+    double t = (double)(top.e->tsc - g_tsc0) * us_per_tsc / 1e6;
+    fprintf(f, "vpn_server %d/%d [000] %.6f: %lu cycles:\n",
+            (int)getpid(), r->tid, t, (unsigned long)self);
+    for (size_t i = stack.size(); i-- > 0;)
+        fprintf(f, "\t%x %s (vpn_server)\n", (unsigned)stack[i].e->stage,
+                traceStageName(stack[i].e->stage));
+    fputc('\n', f);
+}
+
+static void writePerf(FILE *f, const TraceRing *r, const std::vector<TraceEvent> &evs,
+                      double us_per_tsc)
+{
+    std::vector<OpenSpan> stack;
+    for (const TraceEvent &e : evs)
+    {
+        while (!stack.empty() && stack.back().end <= e.tsc)
+        {
+            writePerfSample(f, r, stack, us_per_tsc);
+            stack.pop_back();
+        }
+        if (!stack.empty())
+            stack.back().child_cycles += e.cycles;
+        stack.push_back({&e, e.tsc + e.cycles, 0});
+    }
+    while (!stack.empty())
+    {
+        writePerfSample(f, r, stack, us_per_tsc);
+        stack.pop_back();
+    }
+}
+
+long trace_dump(const char *path, TraceFormat fmt)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+
+    uint64_t tsc1 = trace_now();
+    int64_t ns1 = monoNs();
+    double us_per_tsc = (ns1 > g_ns0 && tsc1 > g_tsc0)
+                            ? (double)(ns1 - g_ns0) / 1e3 / (double)(tsc1 - g_tsc0)
+                            : 0.0;
+
+    long total = 0;
+    bool first = true;
+    std::vector<TraceEvent> evs;
+    evs.reserve(TRACE_RING_EVENTS);
+
+    if (fmt == TRACE_CHROME)
+        fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (TraceRing *r = g_rings.load(std::memory_order_acquire); r; r = r->next)
+    {
+        snapshot(r, evs);
+        total += (long)evs.size();
+        if (fmt == TRACE_CHROME)
+            writeChrome(f, r, evs, us_per_tsc, first);
+        else
+            writePerf(f, r, evs, us_per_tsc);
+    }
+    if (fmt == TRACE_CHROME)
+        fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0)
+        return -1;
+    return total;
+}
+
+static void handle_sigusr1(int)
+{
+    g_dump_requested = 1;
+}
+
+static void dumper_main()
+{
+    unsigned seq = 0;
+    std::unique_lock<std::mutex> lk(g_mu);
+    while (!g_stop)
+    {
+        g_cv.wait_for(lk, std::chrono::milliseconds(DUMP_POLL_MS), [] { return g_stop; });
+        if (!g_dump_requested)
+            continue;
+        g_dump_requested = 0;
+
+        std::string path = g_prefix + "." + std::to_string(seq++) +
+                           (g_format == TRACE_CHROME ? ".json" : ".perf");
+        long n = trace_dump(path.c_str(), g_format);
+        if (n < 0)
+            LOG(LOG_ERROR, "Trace dump to %s failed: %s", path.c_str(), strerror(errno));
+        else
+            LOG(LOG_INFO, "Trace dump: %ld event(s) written to %s", n, path.c_str());
+    }
+}
+
+void trace_start()
+{
+    const char *prefix = getenv("VPN_TRACE_FILE");
+    if (prefix && *prefix)
+        g_prefix = prefix;
+    const char *format = getenv("VPN_TRACE_FORMAT");
+    g_format = (format && strcmp(format, "perf") == 0) ? TRACE_PERF : TRACE_CHROME;
+
+    g_tsc0 = trace_now();
+    g_ns0 = monoNs();
+
+    struct sigaction sa{};
+    sa.sa_handler = handle_sigusr1;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+
+    g_stop = false;
+    g_dumper = std::thread(dumper_main);
+    LOG(LOG_INFO, "Tracing enabled: kill -USR1 %d dumps to %s.<n>.%s",
+        (int)getpid(), g_prefix.c_str(), g_format == TRACE_CHROME ? "json" : "perf");
+}
+
+void trace_stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(g_mu);
+        g_stop = true;
+    }
+    g_cv.notify_all();
+    if (g_dumper.joinable())
+        g_dumper.join();
+}
+
+#endif // ENABLE_TRACING
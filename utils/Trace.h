@@ -0,0 +1,124 @@
+#ifndef UTILS_TRACE_H
+#define UTILS_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef ENABLE_TRACING
+#define ENABLE_TRACING 0
+#endif
+
+/*
+    Per-packet tracing (cmake -DENABLE_TRACING=ON).
+
+    Every TRACE_START/TRACE_END pair stores one event (start tsc, cycles,
+    session, length, stage) in a ring owned by the calling thread; the
+    oldest events are overwritten. Nothing is formatted or locked on the
+    packet path.
+
+    SIGUSR1 (or trace_dump()) writes the rings out:
+
+        chrome  Chrome trace JSON, one complete event per span with the
+                session and length as args (chrome://tracing, Perfetto)
+        perf    `perf script` style samples, one per span weighted by its
+                self time with the enclosing spans as the stack, ready for
+                stackcollapse-perf.pl | flamegraph.pl
+
+    Environment:
+        VPN_TRACE_FILE    dump path prefix (default vpn_trace); each dump
+                          writes <prefix>.<n>.json or <prefix>.<n>.perf
+        VPN_TRACE_FORMAT  chrome (default) or perf
+*/
+
+enum TraceStage : uint16_t
+{
+    TS_UDP_RECV,    ///< recvmmsg() call, len = datagrams
+    TS_UDP_PKT,     ///< One datagram, header check to TUN write / hairpin
+    TS_LOOKUP,
+    TS_DECRYPT,
+    TS_DECOMPRESS,
+    TS_TUN_WRITE,
+    TS_FEC_REPAIR,
+    TS_HANDSHAKE,
+    TS_TUN_READ,    ///< read() on the TUN device
+    TS_TUN_PKT,     ///< One TUN packet, route lookup to TX queueing
+    TS_COMPRESS,
+    TS_ENCRYPT,
+    TS_UDP_SEND,    ///< sendmmsg() call, len = datagrams
+    TS_STAGE_COUNT
+};
+
+const char *traceStageName(int stage);
+
+struct TraceEvent
+{
+    uint64_t tsc;      ///< Span start
+    uint32_t cycles;
+    uint32_t session;  ///< Host order, 0 if not known at that stage
+    uint16_t len;
+    uint16_t stage;
+};
+
+enum TraceFormat
+{
+    TRACE_CHROME,
+    TRACE_PERF
+};
+
+#if ENABLE_TRACING
+
+#include <x86intrin.h>
+
+constexpr uint32_t TRACE_RING_EVENTS = 1 << 16; // per thread, power of two
+
+struct TraceRing
+{
+    std::atomic<uint64_t> head{0}; ///< Events ever written
+    TraceEvent ev[TRACE_RING_EVENTS];
+    int tid = 0;
+    char name[16] = {};
+    TraceRing *next = nullptr;
+};
+
+/// Reads VPN_TRACE_*, installs the SIGUSR1 handler and starts the dump thread.
+void trace_start();
+void trace_stop();
+
+/// Writes every thread's ring to `path`. Returns the number of events.
+long trace_dump(const char *path, TraceFormat fmt);
+
+/// Ring of the calling thread, created on first use.
+TraceRing *trace_attach();
+
+extern thread_local TraceRing *t_trace_ring;
+
+static inline uint64_t trace_now() { return __rdtsc(); }
+
+static inline void trace_record(TraceStage stage, uint64_t t0, uint32_t session, uint32_t len)
+{
+    uint64_t d = trace_now() - t0;
+    TraceRing *r = t_trace_ring ? t_trace_ring : trace_attach();
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    TraceEvent &e = r->ev[h & (TRACE_RING_EVENTS - 1)];
+    e.tsc = t0;
+    e.cycles = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    e.session = session;
+    e.len = len > UINT16_MAX ? UINT16_MAX : (uint16_t)len;
+    e.stage = stage;
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+#define TRACE_START(var) uint64_t var = trace_now()
+#define TRACE_END(var, stage, session, len) trace_record(stage, var, session, len)
+
+#else
+
+inline void trace_start() {}
+inline void trace_stop() {}
+
+#define TRACE_START(var) do {} while (0)
+#define TRACE_END(var, stage, session, len) do {} while (0)
+
+#endif
+
+#endif // UTILS_TRACE_H
@@ -1,3 +1,55 @@
 #include "counter_definition.h"
 
-Stats global_stats;
+#include "utils/logger.h"
+
+static StatsBlock g_stats_blocks[STATS_MAX_THREADS];
+static std::atomic<int> g_stats_threads{0};
+
+thread_local StatsBlock *t_stats = nullptr;
+
+StatsBlock *stats_register_thread()
+{
+    int idx = g_stats_threads.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= STATS_MAX_THREADS)
+    {
+        LOG(LOG_WARN, "More than %d stats threads, sharing the last counter block",
+            STATS_MAX_THREADS);
+        idx = STATS_MAX_THREADS - 1;
+    }
+    t_stats = &g_stats_blocks[idx];
+    return t_stats;
+}
+
+StatsSnapshot StatsSnapshot::collect()
+{
+    StatsSnapshot s;
+    int n = g_stats_threads.load(std::memory_order_relaxed);
+    if (n > STATS_MAX_THREADS)
+        n = STATS_MAX_THREADS;
+
+    for (int i = 0; i < n; i++)
+    {
+        const StatsBlock &b = g_stats_blocks[i];
+#define X(name) s.name += b.name.load(std::memory_order_relaxed);
+        STATS_ALL_COUNTERS(X)
+#undef X
+
+#define X(name) s.name##_hist.merge(b.name##_hist);
+        STATS_CYCLE_COUNTERS(X)
+#undef X
+    }
+    return s;
+}
+
+StatsSnapshot StatsSnapshot::operator-(const StatsSnapshot &earlier) const
+{
+    StatsSnapshot d;
+#define X(name) d.name = name - earlier.name;
+    STATS_ALL_COUNTERS(X)
+#undef X
+
+#define X(name) d.name##_hist = name##_hist - earlier.name##_hist;
+    STATS_CYCLE_COUNTERS(X)
+#undef X
+    return d;
+}
@@ -2,255 +2,139 @@
 #define UTILS_COUNTER_DEFINITION_H
 
 #include <cstdint>
-#include <iostream>
-#include <ctime>
-#include <cfloat>
+#include <atomic>
 
-#include "utils/logger.h"
 #include "utils/profiling.h" // <-- IMPORTANT
-
-struct Stats
-{
-    // ============================================================
-    // Packet counters (ALWAYS ENABLED)
-    // ============================================================
-
-    uint64_t udp_rx_pkts = 0;
-    uint64_t udp_rx_bytes = 0;
-
-    uint64_t tun_tx_pkts = 0;
-    uint64_t tun_tx_bytes = 0;
-
-    uint64_t tun_rx_pkts = 0;
-    uint64_t tun_rx_bytes = 0;
-
-    uint64_t udp_tx_pkts = 0;
-    uint64_t udp_tx_bytes = 0;
-
-    // ============================================================
-    // Control / error counters (ALWAYS ENABLED)
-    // ============================================================
-
-    uint64_t handshake_pkts = 0;
-    uint64_t handshake_failures = 0;
-
-    uint64_t tun_rx_drops = 0;
-    uint64_t udp_tx_drops = 0;
-    uint64_t udp_rx_drops = 0;
-
-    uint64_t tun_read_eagain = 0;
-    uint64_t udp_recv_eagain = 0;
-
-    // ============================================================
-    // Batching (ALWAYS ENABLED)
-    // ============================================================
-
-    uint64_t udp_rx_batches = 0;
-    uint64_t udp_tx_batches = 0;
-
-    double avg_pkts_per_rx_batch = 0.0;
-    double avg_pkts_per_tx_batch = 0.0;
-
-    double max_avg_pkts_per_rx_batch = 0.0;
-    double max_avg_pkts_per_tx_batch = 0.0;
-
+#include "utils/Histogram.h"
+
+/*
+    Data-plane counters.
+
+    Every thread that touches the data plane owns one cache-line aligned
+    StatsBlock and is its only writer, so STAT_ADD is a relaxed load + store
+    (a plain `add` on x86, no lock prefix, no false sharing).
+
+    Counters are monotonic and never reset. The reporter thread
+    (utils/StatsReporter.h) sums all blocks into a StatsSnapshot and
+    diffs consecutive snapshots to get per-interval rates, so no
+    formatting or resetting happens on the packet path.
+
+    In profiling builds every cycle counter also has a latency histogram
+    (<name>_hist) fed by the same PROFILE_SCOPE_END, so the reporter can
+    print p50 / p99 / p99.9 / max next to the per-packet averages.
+
+    To add a counter, add one X(name) line to the matching list below.
+*/
+
+// ============================================================
+// Packet / control / error counters (ALWAYS ENABLED)
+// ============================================================
+#define STATS_COUNTERS(X)                                                  \
+    /* Packet counters */                                                  \
+    X(udp_rx_pkts) X(udp_rx_bytes)                                         \
+    X(tun_tx_pkts) X(tun_tx_bytes)                                         \
+    X(tun_rx_pkts) X(tun_rx_bytes)                                         \
+    X(udp_tx_pkts) X(udp_tx_bytes)                                         \
+    /* Control / error counters */                                         \
+    X(handshake_pkts) X(handshake_failures) X(ctrl_drops)                  \
+    X(tun_rx_drops) X(udp_tx_drops) X(udp_rx_drops) X(replay_drops)        \
+    X(log_drops)                                                           \
+    X(tun_read_eagain) X(udp_recv_eagain)                                  \
+    /* FEC */                                                              \
+    X(fec_repair_tx) X(fec_repair_rx) X(fec_recovered)                     \
+    /* Compression: in/out = original/compressed size of PKT_DATA_LZ4 */   \
+    X(compress_in_bytes) X(compress_out_bytes) X(compress_skipped)         \
+    X(decompress_pkts) X(decompress_errors)                                \
+    /* PMTU / MSS */                                                       \
+    X(pmtu_probes_tx) X(pmtu_acks_rx) X(mss_clamped)                       \
+    /* client -> client, forwarded without a TUN round trip */             \
+    X(hairpin_pkts)                                                        \
+    /* Packet capture (VPN_CAPTURE_FILE) */                                \
+    X(capture_pkts) X(capture_drops)                                       \
+    /* TX backpressure: datagrams queued for EPOLLOUT, TUN reads held off */ \
+    X(udp_tx_queued) X(tun_rx_throttled)                                   \
+    /* Data loop time: handling packets / busy polling empty queues /    \
+       blocked in epoll_wait */                                           \
+    X(loop_work_ns) X(loop_poll_ns) X(loop_wait_ns)                        \
+    /* Batching; *_batch_limit sums the adaptive batch size in force at  \
+       each call, so limit / batches is the average size chosen */        \
+    X(udp_rx_batches) X(udp_tx_batches)                                    \
+    X(udp_rx_batch_limit) X(udp_tx_batch_limit) X(udp_tx_latency_flushes)
+
+// ============================================================
+// Cycle accumulators + histograms (PROFILING ONLY)
+//   udp_to_tun_cycles: recvmmsg() return -> TUN write done, per packet
+// ============================================================
 #if ENABLE_PROFILING
-    // ============================================================
-    // Cycle accumulators (PROFILING ONLY)
-    // ============================================================
-
-    uint64_t enc_cycles = 0;
-    uint64_t dec_cycles = 0;
-    uint64_t lookup_cycles = 0;
-    uint64_t rx_userspace_cycles = 0;
-
-    uint64_t rx_syscall_cycles = 0;
-    uint64_t tx_syscall_cycles = 0;
-    uint64_t tun_write_cycles = 0;
-    uint64_t tun_read_cycles = 0;
-    // ============================================================
-    // Derived metrics (PROFILING ONLY)
-    // ============================================================
-
-    double enc_cyc_per_pkt = 0.0;
-    double dec_cyc_per_pkt = 0.0;
-    double lookup_cyc_per_pkt = 0.0;
-    double rx_userspace_cyc_per_pkt = 0.0;
-
-    double rx_syscall_cyc_per_pkt = 0.0;
-    double tx_syscall_cyc_per_pkt = 0.0;
-    double tun_write_cyc_per_pkt = 0.0;
-    double tun_read_cyc_per_pkt = 0.0;
+#define STATS_CYCLE_COUNTERS(X)                                            \
+    X(enc_cycles) X(dec_cycles) X(lookup_cycles) X(rx_userspace_cycles)    \
+    X(rx_syscall_cycles) X(tx_syscall_cycles)                              \
+    X(tun_write_cycles) X(tun_read_cycles)                                 \
+    X(compress_cycles) X(decompress_cycles)                                \
+    X(udp_to_tun_cycles)
+#else
+#define STATS_CYCLE_COUNTERS(X)
 #endif
 
-    // ============================================================
-    // Timekeeping
-    // ============================================================
-
-    time_t last_reset_time = time(nullptr);
-
-    // ============================================================
-    // Min / Max tracking (ALWAYS ENABLED)
-    // ============================================================
-
-    double max_udp_mbps = 0.0;
-    double min_udp_mbps = DBL_MAX; // Use DBL_MAX from <cfloat>
-    double max_tun_mbps = 0.0;
-    double min_tun_mbps = DBL_MAX;
-
-    // ============================================================
-    // Reset
-    // ============================================================
-
-    void reset_Stats()
-    {
-        udp_rx_pkts = udp_rx_bytes = 0;
-        tun_tx_pkts = tun_tx_bytes = 0;
-        tun_rx_pkts = tun_rx_bytes = 0;
-        udp_tx_pkts = udp_tx_bytes = 0;
-
-        handshake_pkts = handshake_failures = 0;
-        tun_rx_drops = udp_tx_drops = udp_rx_drops = 0;
-
-        tun_read_eagain = udp_recv_eagain = 0;
-
-        udp_rx_batches = udp_tx_batches = 0;
+#define STATS_ALL_COUNTERS(X) STATS_COUNTERS(X) STATS_CYCLE_COUNTERS(X)
 
-        avg_pkts_per_rx_batch = 0.0;
-        avg_pkts_per_tx_batch = 0.0;
-
-#if ENABLE_PROFILING
-        enc_cycles = dec_cycles = 0;
-        lookup_cycles = 0;
-        rx_userspace_cycles = 0;
-        rx_syscall_cycles = 0;
-        tx_syscall_cycles = 0;
-        tun_write_cycles = 0;
-        tun_read_cycles = 0;
-
-#endif
-
-        last_reset_time = time(nullptr);
-    }
-
-    // ============================================================
-    // Print
-    // ============================================================
-
-    void print_Stats()
-    {
-        time_t now = time(nullptr);
-        if (last_reset_time == 0)
-        {
-            last_reset_time = now;
-            return;
-        }
-
-        time_t delta = now - last_reset_time;
-        if (delta == 0)
-            delta = 1;
-
-        // ---- Mbps ----
-        // Use double for the calculation
-        double udp_mbps = (static_cast<double>(udp_rx_bytes) * 8.0) / (static_cast<double>(delta) * 1000000.0);
-
-        max_udp_mbps = std::max(max_udp_mbps, udp_mbps);
-        if (udp_rx_pkts > 0)
-        { // Only track min when there is actually traffic
-            min_udp_mbps = std::min(min_udp_mbps, udp_mbps);
-        }
-
-        double tun_mbps = (static_cast<double>(tun_tx_bytes) * 8.0) / (static_cast<double>(delta) * 1000000.0);
-        max_tun_mbps = std::max(max_tun_mbps, tun_mbps);
-        if (tun_tx_pkts > 0)
-        { // Only track min when there is actually traffic
-            min_tun_mbps = std::min(min_tun_mbps, tun_mbps);
-        }
-
-        // ---- Batching efficiency ----
-        if (udp_rx_batches > 0)
-        {
-            avg_pkts_per_rx_batch =
-                static_cast<double>(udp_rx_pkts) / udp_rx_batches;
-            max_avg_pkts_per_rx_batch =
-                std::max(max_avg_pkts_per_rx_batch, avg_pkts_per_rx_batch);
-        }
-
-        if (udp_tx_batches > 0)
-        {
-            avg_pkts_per_tx_batch =
-                static_cast<double>(udp_tx_pkts) / udp_tx_batches;
-            max_avg_pkts_per_tx_batch =
-                std::max(max_avg_pkts_per_tx_batch, avg_pkts_per_tx_batch);
-        }
-
-#if ENABLE_PROFILING
-        enc_cyc_per_pkt =
-            udp_tx_pkts ? (double)enc_cycles / udp_tx_pkts : 0;
+/**
+ * @brief One writer thread's counters, padded to whole cache lines.
+ */
+struct alignas(64) StatsBlock
+{
+#define X(name) std::atomic<uint64_t> name{0};
+    STATS_ALL_COUNTERS(X)
+#undef X
 
-        dec_cyc_per_pkt =
-            udp_rx_pkts ? (double)dec_cycles / udp_rx_pkts : 0;
+#define X(name) AtomicHistogram name##_hist;
+    STATS_CYCLE_COUNTERS(X)
+#undef X
+};
 
-        lookup_cyc_per_pkt =
-            udp_rx_pkts ? (double)lookup_cycles / udp_rx_pkts : 0;
+/**
+ * @brief Plain-integer copy of the counters, summed over all threads.
+ */
+struct StatsSnapshot
+{
+#define X(name) uint64_t name = 0;
+    STATS_ALL_COUNTERS(X)
+#undef X
 
-        rx_userspace_cyc_per_pkt =
-            udp_rx_pkts ? (double)rx_userspace_cycles / udp_rx_pkts : 0;
+#define X(name) HistogramSnapshot name##_hist;
+    STATS_CYCLE_COUNTERS(X)
+#undef X
 
-        rx_syscall_cyc_per_pkt =
-            udp_rx_pkts ? (double)rx_syscall_cycles / udp_rx_pkts : 0;
+    /// Sums every registered StatsBlock (relaxed loads, safe from any thread).
+    static StatsSnapshot collect();
 
-        tx_syscall_cyc_per_pkt =
-            udp_tx_pkts ? (double)tx_syscall_cycles / udp_tx_pkts : 0;
+    /// Per-interval values: this - earlier.
+    StatsSnapshot operator-(const StatsSnapshot &earlier) const;
+};
 
-        tun_write_cyc_per_pkt =
-            tun_tx_pkts ? (double)tun_write_cycles / tun_tx_pkts : 0;
+/// Threads beyond this many share the last block (counts may be lost there).
+constexpr int STATS_MAX_THREADS = 16;
 
-        tun_read_cyc_per_pkt =
-            tun_rx_pkts ? (double)tun_read_cycles / tun_rx_pkts : 0;
-#endif
+extern thread_local StatsBlock *t_stats;
 
-        // ---- Always print functional stats ----
-        LOG(LOG_INFO,
-            "---- Stats (last %ld sec) ----\n"
-            "UDP RX: %lu pkts, %lu bytes, %.2f Mbps (max: %.2f, min: %.2f)\n"
-            "TUN TX: %lu pkts, %lu bytes, %.2f Mbps (max: %.2f, min: %.2f)\n"
-            "Handshake pkts: %lu, failures: %lu\n"
-            "Drops - TUN RX: %lu, UDP TX: %lu, UDP RX: %lu\n"
-            "EAGAIN - TUN read: %lu, UDP recv: %lu\n"
-            "UDP RX batches: %lu, avg pkts/batch: %.2f (max avg: %.2f)\n"
-            "UDP TX batches: %lu, avg pkts/batch: %.2f (max avg: %.2f)\n",
-            delta,
-            udp_rx_pkts, udp_rx_bytes, udp_mbps, max_udp_mbps,
-            (min_udp_mbps == DBL_MAX ? 0 : min_udp_mbps),
-            tun_tx_pkts, tun_tx_bytes, tun_mbps, max_tun_mbps,
-            (min_tun_mbps == DBL_MAX ? 0 : min_tun_mbps),
-            handshake_pkts, handshake_failures,
-            tun_rx_drops, udp_tx_drops, udp_rx_drops,
-            tun_read_eagain, udp_recv_eagain,
-            udp_rx_batches, avg_pkts_per_rx_batch, max_avg_pkts_per_rx_batch,
-            udp_tx_batches, avg_pkts_per_tx_batch, max_avg_pkts_per_tx_batch);
+/// Claims a StatsBlock for the calling thread. Called lazily by stats_local().
+StatsBlock *stats_register_thread();
 
-#if ENABLE_PROFILING
-        // ---- Profiling-only stats ----
-        LOG(LOG_INFO,
-            "Enc cycles/pkt: %.2f, Dec cycles/pkt: %.2f\n"
-            "Lookup cycles/pkt: %.2f, RX userspace cycles/pkt: %.2f\n"
-            "RX syscall cycles/pkt: %.2f, TX syscall cycles/pkt: %.2f, TUN write cycles/pkt: %.2f, TUN read cycles/pkt: %.2f\n",
-            enc_cyc_per_pkt,
-            dec_cyc_per_pkt,
-            lookup_cyc_per_pkt,
-            rx_userspace_cyc_per_pkt,
-            rx_syscall_cyc_per_pkt,
-            tx_syscall_cyc_per_pkt,
-            tun_write_cyc_per_pkt,
-            tun_read_cyc_per_pkt);
-#endif
-
-        log_flush();
-    }
-};
+inline StatsBlock &stats_local()
+{
+    StatsBlock *b = t_stats;
+    if (__builtin_expect(b == nullptr, 0))
+        b = stats_register_thread();
+    return *b;
+}
+
+// Single-writer increment: no atomic RMW needed, readers see whole values.
+inline void stat_add(std::atomic<uint64_t> &c, uint64_t v)
+{
+    c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
 
-extern Stats global_stats;
+#define STAT_ADD(field, v) stat_add(stats_local().field, (v))
+#define HIST_RECORD(field, v) stats_local().field.record(v)
 
 #endif
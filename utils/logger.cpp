@@ -4,64 +4,340 @@
 #include <fcntl.h>
 #include <cstring>
 #include <cstdio>
-#include <cstdarg>
 #include <ctime>
 #include <sys/types.h>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "version.h" // <--- Include the generated file
+#include "utils/counter_definition.h"
+#include "utils/LogFormat.h"
 
-static int g_log_fd = -1;
+using logdetail::Record;
+
+static std::atomic<int> g_log_fd{-1};
 
 /* Tunables */
 static constexpr size_t LOG_BUF_SIZE = 64 * 1024;
+static constexpr size_t RING_SLOTS = 1024;       // power of two
+static constexpr int WRITER_IDLE_MS = 10;        // writer poll period when idle
+static constexpr size_t MAX_LINE = 2048 + 64;    // formatted message + prefix
+static constexpr int64_t SUPPRESS_REPORT_NS = 1000000000; // LOG_RATELIMITED summaries
+
+static_assert((RING_SLOTS & (RING_SLOTS - 1)) == 0, "RING_SLOTS must be a power of two");
+
+/* ---------- ring (Vyukov bounded queue) ---------- */
+
+struct alignas(64) Cell
+{
+    std::atomic<uint64_t> seq;
+    Record rec;
+};
+
+static Cell g_ring[RING_SLOTS];
+alignas(64) static std::atomic<uint64_t> g_enqueue_pos{0};
+alignas(64) static uint64_t g_dequeue_pos = 0; // writer thread only
+static std::atomic<uint64_t> g_written_pos{0};  // records fully written out
+static std::atomic<uint64_t> g_dropped{0};
+
+// LOG_RATELIMITED sites, pushed on first use and never removed
+static std::atomic<LogRateLimiter *> g_limiters{nullptr};
+
+/* ---------- writer state (writer thread only) ---------- */
 
 static char g_buf[LOG_BUF_SIZE];
 static size_t g_pos = 0;
+static uint64_t g_dropped_reported = 0;
+
+// Binary mode (VPN_LOG_FORMAT=binary): format pointer -> id of this session
+static bool g_binary = false;
+static std::unordered_map<const char *, uint32_t> g_fmt_ids;
+static int64_t g_prev_ns = 0;
+
+static std::thread g_writer;
+static std::atomic<bool> g_stop{false};
+static std::mutex g_wake_mu; // writer sleep + log_flush() waits only, never taken by LOG()
+static std::condition_variable g_wake_cv;
+static std::condition_variable g_written_cv;
+
+/* ---------- producers ---------- */
+
+namespace logdetail
+{
+
+Record *acquire(uint64_t &pos_out)
+{
+    if (g_log_fd.load(std::memory_order_relaxed) < 0)
+        return nullptr;
+
+    uint64_t pos = g_enqueue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        Cell &c = g_ring[pos & (RING_SLOTS - 1)];
+        uint64_t seq = c.seq.load(std::memory_order_acquire);
+        int64_t dif = (int64_t)seq - (int64_t)pos;
+        if (dif == 0)
+        {
+            if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                pos_out = pos;
+                Record &r = c.rec;
+                timespec ts;
+                clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+                r.time = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+                r.nargs = 0;
+                r.str_used = 0;
+                return &r;
+            }
+        }
+        else if (dif < 0)
+        {
+            // Writer has not freed this slot yet: ring full
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+        {
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void commit(uint64_t pos)
+{
+    g_ring[pos & (RING_SLOTS - 1)].seq.store(pos + 1, std::memory_order_release);
+}
 
-/* ---------- internals ---------- */
+} // namespace logdetail
+
+uint64_t log_dropped()
+{
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+LogRateLimiter::LogRateLimiter(LogLevel lvl, const char *fmt_, uint32_t per_sec, uint32_t burst)
+    : level(lvl), fmt(fmt_)
+{
+    if (per_sec == 0)
+        per_sec = 1;
+    if (burst == 0)
+        burst = 1;
+    interval_ns_ = 1000000000ULL / per_sec;
+    burst_ns_ = interval_ns_ * (burst - 1);
+
+    next = g_limiters.load(std::memory_order_relaxed);
+    while (!g_limiters.compare_exchange_weak(next, this, std::memory_order_release,
+                                             std::memory_order_relaxed))
+        ;
+}
+
+/* ---------- writer thread ---------- */
 
 static inline void flush_internal()
 {
-    if (g_log_fd < 0 || g_pos == 0)
+    int fd = g_log_fd.load(std::memory_order_relaxed);
+    if (fd < 0 || g_pos == 0)
         return;
 
-    ssize_t n = write(g_log_fd, g_buf, g_pos);
+    ssize_t n = write(fd, g_buf, g_pos);
     (void)n;            // best effort
     g_pos = 0;
 }
 
 static inline void ensure_space(size_t need)
 {
-    if (need > LOG_BUF_SIZE)
-        return; // drop oversized log
-
     if (g_pos + need > LOG_BUF_SIZE)
         flush_internal();
 }
 
+static void appendText(const Record &r)
+{
+    static char line[MAX_LINE];
+    size_t n = logfmt::formatLine(r, line, sizeof(line) - 1);
+    line[n++] = '\n';
+    ensure_space(n);
+    memcpy(g_buf + g_pos, line, n);
+    g_pos += n;
+}
+
+static void appendBinary(const Record &r)
+{
+    auto it = g_fmt_ids.find(r.fmt);
+    if (it == g_fmt_ids.end())
+    {
+        uint32_t id = (uint32_t)g_fmt_ids.size();
+        it = g_fmt_ids.emplace(r.fmt, id).first;
+        size_t need = strlen(r.fmt) + 32;
+        if (need > LOG_BUF_SIZE)
+            return;
+        ensure_space(need);
+        g_pos += logfmt::encodeFormat(id, r.fmt, (uint8_t *)g_buf + g_pos, need);
+    }
+    ensure_space(logfmt::BLOG_MAX_RECORD);
+    g_pos += logfmt::encodeRecord(it->second, r, g_prev_ns, (uint8_t *)g_buf + g_pos);
+}
+
+static inline void append(const Record &r)
+{
+    if (g_binary)
+        appendBinary(r);
+    else
+        appendText(r);
+}
+
+static bool reportDrops()
+{
+    uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+    if (dropped == g_dropped_reported)
+        return false;
+    uint64_t d = dropped - g_dropped_reported;
+    g_dropped_reported = dropped;
+    STAT_ADD(log_drops, d);
+
+    static Record r;
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    r.fmt = "Logger ring full, dropped %lu record(s)";
+    r.lvl = LOG_WARN;
+    r.time = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    r.nargs = 0;
+    r.str_used = 0;
+    logdetail::capture(r, d);
+    append(r);
+    return true;
+}
+
+// One summary per rate-limited site that dropped calls since the last sweep
+static bool reportSuppressed()
+{
+    static int64_t last_ns = 0;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if (now - last_ns < SUPPRESS_REPORT_NS)
+        return false;
+    last_ns = now;
+
+    bool any = false;
+    static Record r;
+    for (LogRateLimiter *l = g_limiters.load(std::memory_order_acquire); l; l = l->next)
+    {
+        uint64_t n = l->takeSuppressed();
+        if (n == 0)
+            continue;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        r.fmt = "%lu similar message(s) suppressed: %s";
+        r.lvl = (uint8_t)l->level;
+        r.time = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        r.nargs = 0;
+        r.str_used = 0;
+        logdetail::capture(r, n);
+        logdetail::capture(r, l->fmt);
+        append(r);
+        any = true;
+    }
+    return any;
+}
+
+// Formats everything committed so far. Returns the number of records.
+static size_t drain()
+{
+    size_t count = 0;
+    while (true)
+    {
+        Cell &c = g_ring[g_dequeue_pos & (RING_SLOTS - 1)];
+        if (c.seq.load(std::memory_order_acquire) != g_dequeue_pos + 1)
+            break; // empty, or the next producer has not committed yet
+
+        append(c.rec);
+
+        c.seq.store(g_dequeue_pos + RING_SLOTS, std::memory_order_release);
+        g_dequeue_pos++;
+        count++;
+    }
+    return count;
+}
+
+static void writer_main()
+{
+    while (true)
+    {
+        bool stopping = g_stop.load(std::memory_order_acquire);
+        size_t n = drain();
+        bool reported = reportDrops();
+        reported |= reportSuppressed();
+        if (reported && n == 0)
+            flush_internal();
+        if (n)
+        {
+            flush_internal();
+            {
+                std::lock_guard<std::mutex> lk(g_wake_mu);
+                g_written_pos.store(g_dequeue_pos, std::memory_order_release);
+            }
+            g_written_cv.notify_all();
+        }
+        if (stopping && n == 0)
+            break;
+        if (n == 0)
+        {
+            std::unique_lock<std::mutex> lk(g_wake_mu);
+            g_wake_cv.wait_for(lk, std::chrono::milliseconds(WRITER_IDLE_MS));
+        }
+    }
+    flush_internal();
+}
+
 /* ---------- public API ---------- */
 
+static void start_writer()
+{
+    for (size_t i = 0; i < RING_SLOTS; i++)
+        g_ring[i].seq.store(i, std::memory_order_relaxed);
+    g_enqueue_pos.store(0, std::memory_order_relaxed);
+    g_dequeue_pos = 0;
+    g_written_pos.store(0, std::memory_order_relaxed);
+    g_fmt_ids.clear();
+    g_prev_ns = 0;
+    g_pos = 0;
+    if (g_binary)
+    {
+        // Every session starts with the magic; ids restart after it
+        memcpy(g_buf, logfmt::BLOG_MAGIC, sizeof(logfmt::BLOG_MAGIC));
+        g_pos = sizeof(logfmt::BLOG_MAGIC);
+    }
+    g_stop = false;
+    g_writer = std::thread(writer_main);
+}
+
 void log_init_file(const char* path)
 {
     int fd = open(path,
-                  O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | O_NONBLOCK,
+                  O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
                   0644);
     if (fd < 0)
         return;
 
+    start_writer();
     g_log_fd = fd;
 }
 
 void log_init()
 {
     const char* env = getenv("VPN_LOG_FILE");
+    const char* format = getenv("VPN_LOG_FORMAT");
+    bool want_binary = format && strcmp(format, "binary") == 0;
     if (env && *env) {
+        g_binary = want_binary;
         log_init_file(env);
     } else {
-        int flags = fcntl(STDERR_FILENO, F_GETFL, 0);
-        if (flags >= 0)
-            fcntl(STDERR_FILENO, F_SETFL, flags | O_NONBLOCK);
-
+        // Only the writer thread blocks on stderr now; keep it blocking
+        start_writer();
         g_log_fd = STDERR_FILENO;
     }
 
@@ -72,69 +348,34 @@ void log_init()
         PROJECT_VERSION_MINOR,
         PROJECT_BUILD_NUMBER);
     LOG(LOG_INFO, "Logger initialized at time %ld", time(nullptr));
+    if (want_binary && !g_binary)
+        LOG(LOG_WARN, "VPN_LOG_FORMAT=binary needs VPN_LOG_FILE; logging text to stderr");
 }
 
-
 void log_shutdown()
 {
-    flush_internal();
+    if (!g_writer.joinable())
+        return;
 
-    if (g_log_fd >= 0 && g_log_fd != STDERR_FILENO)
-        close(g_log_fd);
+    g_stop.store(true, std::memory_order_release);
+    g_wake_cv.notify_all();
+    g_writer.join();
 
-    g_log_fd = -1;
+    int fd = g_log_fd.exchange(-1);
+    if (fd >= 0 && fd != STDERR_FILENO)
+        close(fd);
 }
 
 void log_flush()
 {
-    flush_internal();
-}
-
-void log_write(LogLevel lvl, const char* fmt, ...)
-{
-    if (g_log_fd < 0)
+    if (!g_writer.joinable())
         return;
 
-    /* timestamp */
-    char ts[32];
-    time_t t = time(nullptr);
-    struct tm tm;
-    localtime_r(&t, &tm);
-
-    int ts_len = snprintf(ts, sizeof(ts),
-                          "%02d:%02d:%02d ",
-                          tm.tm_hour, tm.tm_min, tm.tm_sec);
-
-    const char* lvl_str =
-        (lvl == LOG_ERROR) ? "[ERR] " :
-        (lvl == LOG_WARN)  ? "[WRN] " :
-        (lvl == LOG_INFO)  ? "[INF] " :
-                             "[DBG] ";
-
-    char msg[512];
-
-    va_list ap;
-    va_start(ap, fmt);
-    int msg_len = vsnprintf(msg, sizeof(msg), fmt, ap);
-    va_end(ap);
-
-    if (msg_len <= 0)
-        return;
-
-    size_t total =
-        ts_len + strlen(lvl_str) + msg_len + 1;
-
-    ensure_space(total);
-
-    memcpy(g_buf + g_pos, ts, ts_len);
-    g_pos += ts_len;
-
-    size_t lvl_len = strlen(lvl_str);
-    memcpy(g_buf + g_pos, lvl_str, lvl_len);
-    g_pos += lvl_len;
-
-    memcpy(g_buf + g_pos, msg, msg_len);
-    g_pos += msg_len;
-
-    g_buf[g_pos++] = '\n';
+    uint64_t target = g_enqueue_pos.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lk(g_wake_mu);
+    g_wake_cv.notify_all();
+    // Bounded: a producer that claimed a slot but never commits must not hang us
+    g_written_cv.wait_for(lk, std::chrono::seconds(1), [&] {
+        return g_written_pos.load(std::memory_order_acquire) >= target;
+    });
 }
@@ -1,5 +1,10 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <type_traits>
 
 enum LogLevel {
     LOG_ERROR = 0,
@@ -8,11 +13,202 @@ enum LogLevel {
     LOG_DEBUG
 };
 
+/*
+    Asynchronous logger.
+
+    LOG() never formats and never calls write(). It claims a slot in a
+    bounded lock-free ring (Vyukov MPMC queue, used multi-producer /
+    single-consumer), stores the format pointer plus the raw arguments
+    and returns. C strings are copied into the slot, so buffers such as
+    inet_ntoa()'s may be reused right after the call.
+
+    A writer thread started by log_init() drains the ring, runs the
+    printf-style formatting and batches the output into one write() per
+    drain. When the ring is full the record is dropped and counted; the
+    writer reports the count and adds it to the log_drops stat.
+
+    With VPN_LOG_FORMAT=binary (and VPN_LOG_FILE) the writer skips the
+    formatting too and writes compact varint records instead; see
+    utils/LogFormat.h and tools/vpn_logdecode.cpp.
+
+    The format string must be a literal (only its pointer is stored).
+*/
+
 void log_init();                         // auto: env / default stderr
 void log_init_file(const char* path);    // explicit file
-void log_shutdown();                     // flush + close
+void log_shutdown();                     // drain, stop writer, close
+
+void log_flush();                        // wait until queued records are written
+uint64_t log_dropped();                  // records lost to a full ring so far
+
+namespace logdetail
+{
+
+enum ArgType : uint8_t
+{
+    ARG_INT,  ///< Any integer or enum, sign-extended to 64 bits
+    ARG_DBL,
+    ARG_PTR,
+    ARG_STR   ///< Copied into Record::strs, value = offset << 16 | length
+};
+
+constexpr int MAX_ARGS = 48;     // the stats block is one record
+constexpr int STR_BYTES = 384;   // shared by all string arguments of a record
+
+struct Record
+{
+    const char *fmt;
+    int64_t time;   ///< Unix time, nanoseconds
+    uint8_t lvl;
+    uint8_t nargs;
+    uint16_t str_used;
+    uint8_t types[MAX_ARGS];
+    uint64_t vals[MAX_ARGS];
+    char strs[STR_BYTES];
+};
+
+/// Claims a ring slot (nullptr if the logger is off or the ring is full).
+Record *acquire(uint64_t &pos);
+/// Hands a filled slot to the writer.
+void commit(uint64_t pos);
+
+inline void put(Record &r, ArgType t, uint64_t v)
+{
+    r.types[r.nargs] = t;
+    r.vals[r.nargs] = v;
+    r.nargs++;
+}
+
+inline void putStr(Record &r, const char *s)
+{
+    if (!s)
+        s = "(null)";
+    size_t room = STR_BYTES - r.str_used;
+    size_t len = strnlen(s, room);
+    memcpy(r.strs + r.str_used, s, len);
+    put(r, ARG_STR, ((uint64_t)r.str_used << 16) | len);
+    r.str_used += (uint16_t)len;
+}
+
+template <typename T>
+inline void capture(Record &r, T v)
+{
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *>)
+        putStr(r, v);
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        double d = (double)v;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        put(r, ARG_DBL, bits);
+    }
+    else if constexpr (std::is_pointer_v<U>)
+        put(r, ARG_PTR, (uint64_t)(uintptr_t)v);
+    else if constexpr (std::is_enum_v<U>)
+        put(r, ARG_INT, (uint64_t)(int64_t)v);
+    else
+    {
+        static_assert(std::is_integral_v<U>, "unsupported LOG() argument type");
+        if constexpr (std::is_signed_v<U>)
+            put(r, ARG_INT, (uint64_t)(int64_t)v);
+        else
+            put(r, ARG_INT, (uint64_t)v);
+    }
+}
 
-void log_write(LogLevel lvl, const char* fmt, ...);
-void log_flush();
+} // namespace logdetail
+
+template <typename... Args>
+inline void log_write(LogLevel lvl, const char *fmt, Args... args)
+{
+    static_assert(sizeof...(Args) <= logdetail::MAX_ARGS, "too many LOG() arguments");
+
+    uint64_t pos;
+    logdetail::Record *r = logdetail::acquire(pos);
+    if (!r)
+        return;
+    r->fmt = fmt;
+    r->lvl = (uint8_t)lvl;
+    (logdetail::capture(*r, args), ...);
+    logdetail::commit(pos);
+}
 
 #define LOG(lvl, fmt, ...) log_write(lvl, fmt, ##__VA_ARGS__)
+
+/*
+    Packet-path logging.
+
+    LOG_RATELIMITED gives each call site its own token bucket (refill
+    LOG_RATE_PER_SEC, burst LOG_RATE_BURST). Calls over the limit cost a
+    clock read and an atomic add and are only counted; the writer thread
+    logs "N message(s) suppressed" for the site once per second.
+
+    HOT_LOG compiles out entirely (arguments included) when its level is
+    more verbose than HOT_LOG_LEVEL, which CMake sets (default: WARN).
+*/
+
+constexpr uint32_t LOG_RATE_PER_SEC = 10;
+constexpr uint32_t LOG_RATE_BURST = 20;
+
+class LogRateLimiter
+{
+public:
+    LogRateLimiter(LogLevel lvl, const char *fmt,
+                   uint32_t per_sec = LOG_RATE_PER_SEC, uint32_t burst = LOG_RATE_BURST);
+
+    /// Takes a token, or counts the call as suppressed.
+    bool allow()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        uint64_t now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+        // GCRA form of a token bucket: tat_ runs ahead of `now` by one
+        // interval per token in use
+        uint64_t tat = tat_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            uint64_t base = tat > now ? tat : now;
+            if (base - now > burst_ns_)
+            {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (tat_.compare_exchange_weak(tat, base + interval_ns_, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    /// Writer thread: suppressed calls since the previous call.
+    uint64_t takeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+
+    const LogLevel level;
+    const char *const fmt;
+    LogRateLimiter *next = nullptr; ///< Registry of all sites, walked by the writer
+
+private:
+    uint64_t interval_ns_;
+    uint64_t burst_ns_;
+    std::atomic<uint64_t> tat_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+#define LOG_RATELIMITED(lvl, fmt, ...)                      \
+    do                                                      \
+    {                                                       \
+        static LogRateLimiter _log_rl((lvl), (fmt));        \
+        if (_log_rl.allow())                                \
+            LOG(lvl, fmt, ##__VA_ARGS__);                   \
+    } while (0)
+
+#ifndef HOT_LOG_LEVEL
+#define HOT_LOG_LEVEL 1 // LOG_WARN
+#endif
+
+#define HOT_LOG(lvl, fmt, ...)                              \
+    do                                                      \
+    {                                                       \
+        if constexpr ((int)(lvl) <= HOT_LOG_LEVEL)          \
+            LOG(lvl, fmt, ##__VA_ARGS__);                   \
+    } while (0)
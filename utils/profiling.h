@@ -34,13 +34,17 @@ static inline uint64_t rdtsc_ordered()
 
 #endif
 
-#define STAT_ADD(x, v) ((x) += (v))
-
-
 #if ENABLE_PROFILING
 
+// Adds the elapsed cycles to `stat` and records them in `stat`_hist
 #define PROFILE_SCOPE_START(var) uint64_t var = RDTSC()
-#define PROFILE_SCOPE_END(var, stat) STAT_ADD(stat, (RDTSC() - (var)))
+#define PROFILE_SCOPE_END(var, stat)              \
+    do                                            \
+    {                                             \
+        uint64_t _prof_d = RDTSC() - (var);       \
+        STAT_ADD(stat, _prof_d);                  \
+        HIST_RECORD(stat##_hist, _prof_d);        \
+    } while (0)
 
 #else
 